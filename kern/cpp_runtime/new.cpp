@@ -27,37 +27,40 @@ SOFTWARE.
 #include <stdint.h>
 
 #include "utils/logging.hpp"
+#include "mem/slab.hpp"
 
 long allocs;
 
 void *operator new(size_t size) noexcept
 {
     //log_serial("heap alloc : %zd\n", ++allocs);
+    if (auto ptr = slab_alloc(size)) return ptr;
     return kmalloc(size);
 }
 
 void *operator new[](size_t size) noexcept
 {
     //log_serial("heap array alloc : %zd\n", ++allocs);
+    if (auto ptr = slab_alloc(size)) return ptr;
     return kmalloc(size);
 }
 
 void operator delete(void *p) noexcept
 {
-    kfree(p);
+    if (!slab_free(p)) kfree(p);
 }
 
 void operator delete[](void *p) noexcept
 {
-    kfree(p);
+    if (!slab_free(p)) kfree(p);
 }
 
 void operator delete(void *p, size_t) noexcept
 {
-    kfree(p);
+    if (!slab_free(p)) kfree(p);
 }
 
 void operator delete[](void *p, size_t) noexcept
 {
-    kfree(p);
+    if (!slab_free(p)) kfree(p);
 }
@@ -132,7 +132,7 @@ void AcpiOsSleep(UINT64 Milliseconds)
 
 void AcpiOsStall(UINT32 Microseconds)
 {
-    Timer::sleep(Microseconds*1000);
+    Timer::udelay(Microseconds);
 }
 
 UINT64 AcpiOsGetTimer()
@@ -32,8 +32,11 @@ SOFTWARE.
 #include "utils/nop.hpp"
 #include "time/timer.hpp"
 #include "mem/memmap.hpp"
+#include "tasking/waitqueue.hpp"
+#include "utils/noncopyable.hpp"
 
 #include "i686/interrupts/isr.hpp"
+#include "i686/interrupts/interrupts.hpp"
 
 
 namespace ahci
@@ -42,9 +45,310 @@ namespace ahci
 volatile detail::HBAMem* volatile mem;
 
 alignas(1024) detail::CommandList cmdlists[32];
-alignas(128)  detail::CommandTable cmdtables[32];
+detail::CommandTable* cmdtables[32];
 alignas(256)  detail::ReceivedFIS rcvfis[32];
 
+namespace
+{
+// Each slot of a port has its own command table : a requester reserves a slot, issues its command in it
+// and sleeps until the interrupt handler sees the command complete, while the others use the other slots
+struct PortState
+{
+    uint32_t slot_mask { 1 }; // usable slots, one unless the port queues with NCQ
+    bool ncq { false };
+
+    uint32_t reserved { 0 };
+    bool exclusive { false }; // a non queued command is waiting for the port or running
+    bool recovering { false };
+
+    // updated by the interrupt handler
+    volatile uint32_t issued { 0 };
+    volatile uint32_t done { 0 };
+    volatile uint32_t failed { 0 };
+    volatile bool halted { false }; // the port stopped on an error and must be restarted
+
+    tasking::WaitQueue slot_wait;
+    tasking::WaitQueue completion_wait;
+};
+PortState port_states[32];
+
+// in case an interrupt was missed
+constexpr uint32_t completion_poll_ms { 10 };
+constexpr uint32_t command_timeout_ms { 5000 };
+
+// moves the slots the HBA is done with from issued to done, or every issued slot to failed on an error
+void collect_completions(size_t port)
+{
+    InterruptLock lock;
+
+    auto& state = port_states[port];
+    auto& hw = mem->ports[port];
+
+    const uint32_t status = hw.is;
+    hw.is = status;
+
+    // every command in flight has failed, and a stopped port clears ci
+    if (state.halted) return;
+
+    if (status & detail::pxis_tfes)
+    {
+        // the device aborts its queue on an error
+        state.failed |= state.issued;
+        state.issued = 0;
+        state.halted = true;
+        return;
+    }
+
+    const uint32_t finished = state.issued & ~(hw.sact | hw.ci);
+    state.done |= finished;
+    state.issued &= ~finished;
+}
+
+// issues the command prepared in slot and waits for its completion, returns false if it failed
+bool execute(size_t port, int slot, bool queued)
+{
+    auto& state = port_states[port];
+    auto& hw = mem->ports[port];
+    const uint32_t bit = 1u << slot;
+
+    {
+        InterruptLock lock;
+
+        state.done &= ~bit;
+        state.failed &= ~bit;
+        state.issued |= bit;
+
+        if (queued) hw.sact = bit;
+        hw.ci = bit;	// Issue command
+    }
+    detail::flush_commands(port);
+
+    uint32_t waited { 0 };
+    while (!state.completion_wait.wait([&state, bit]{ return (state.done | state.failed) & bit; }, completion_poll_ms))
+    {
+        collect_completions(port);
+
+        waited += completion_poll_ms;
+        if (waited >= command_timeout_ms && !((state.done | state.failed) & bit))
+        {
+            warn("AHCI command timed out on port %d\n", port);
+
+            {
+                InterruptLock lock;
+                state.halted = true;
+            }
+            // the HBA mustn't go on with commands whose requesters gave up on them and release their buffers
+            detail::stop_port(port);
+
+            InterruptLock lock;
+            state.failed |= state.issued;
+            state.issued = 0;
+        }
+    }
+
+    return !(state.failed & bit);
+}
+
+// restarts a halted port from the slot of one of the failed commands, the others have failed with it
+void recover_port(size_t port, int slot)
+{
+    using namespace detail;
+
+    auto& state = port_states[port];
+    if (!state.halted || state.recovering) return;
+
+    state.recovering = true;
+
+    err("AHCI port %d stopped on an error (task file 0x%x), restarting it\n", port, mem->ports[port].tfd);
+
+    stop_port(port);
+    clear_errs(port);
+    mem->ports[port].is = ~0;
+    start_port(port);
+
+    state.halted = false;
+
+    // the device refuses queued commands until its NCQ error log is read
+    if (state.ncq)
+    {
+        uint16_t log[256];
+
+        CommandHeader* cmdheader = &(cmdlists[port].hdrs[slot]);
+        cmdheader->cfl = sizeof(FisRegH2D)/sizeof(uint32_t);	// Command FIS size
+        cmdheader->write = 0;
+        cmdheader->atapi = false;
+
+        CommandTable* cmdtbl = &cmdtables[port][slot];
+        memset(cmdtbl, 0, sizeof(CommandTable));
+        cmdheader->prdtl = fill_prdt(*cmdtbl, log, sizeof(log));
+
+        FisRegH2D *cmdfis = reinterpret_cast<FisRegH2D*>(&cmdtbl->command_fis);
+        cmdfis->fis_type = FISType::RegH2D;
+        cmdfis->c = 1;	// Command
+        cmdfis->command = ata_read_log_ext;
+        cmdfis->lba0 = ncq_error_log;
+        cmdfis->countl = 1;
+
+        if (!execute(port, slot, false))
+        {
+            warn("Could not read the NCQ error log of AHCI port %d\n", port);
+
+            // the failure halted the port again
+            stop_port(port);
+            clear_errs(port);
+            mem->ports[port].is = ~0;
+            start_port(port);
+        }
+        state.halted = false;
+    }
+
+    state.recovering = false;
+    state.completion_wait.wake_all();
+}
+
+// runs the command prepared in slot once the port works, restarting it if the command fails
+bool run_command(size_t port, int slot, bool queued)
+{
+    auto& state = port_states[port];
+
+    state.completion_wait.wait([&state]{ return !state.halted && !state.recovering; });
+
+    // a non queued command has the port for itself, but the device may still be busy
+    if (!queued && !Timer::sleep_until([&]{return !(mem->ports[port].tfd & (detail::ata_busy | detail::ata_drq));}, 500))
+    {
+        warn("AHCI port %d is hung\n", port);
+        return false;
+    }
+
+    if (!execute(port, slot, queued))
+    {
+        recover_port(port, slot);
+        // until the recovery has stopped the port, the HBA might still write to our buffers
+        state.completion_wait.wait([&state]{ return !state.halted && !state.recovering; });
+        return false;
+    }
+
+    return true;
+}
+
+// reserves a slot of a port for its lifetime, waiting for one if they're all in use.
+// An exclusive slot waits for the commands in flight to complete, and keeps the others free until it's released
+class SlotLock : NonCopyable
+{
+public:
+    SlotLock(size_t port, bool exclusive)
+        : m_state(port_states[port]), m_exclusive(exclusive)
+    {
+        if (m_exclusive)
+        {
+            // the new requesters wait from now on, then the port drains
+            m_state.slot_wait.wait([this]{ return !m_state.exclusive; });
+            m_state.exclusive = true;
+            m_state.slot_wait.wait([this]{ return m_state.reserved == 0; });
+            m_slot = 0;
+        }
+        else
+        {
+            m_state.slot_wait.wait([this]
+            {
+                const uint32_t free = m_state.slot_mask & ~m_state.reserved;
+                if (m_state.exclusive || !free) return false;
+
+                m_slot = __builtin_ctz(free);
+                return true;
+            });
+        }
+
+        m_state.reserved |= 1u << m_slot;
+    }
+
+    ~SlotLock()
+    {
+        m_state.reserved &= ~(1u << m_slot);
+        if (m_exclusive) m_state.exclusive = false;
+
+        m_state.slot_wait.wake_all();
+    }
+
+    int slot() const
+    {
+        return m_slot;
+    }
+
+private:
+    PortState& m_state;
+    bool m_exclusive;
+    int m_slot { 0 };
+};
+
+void set_lba(detail::FisRegH2D& fis, uint64_t sector)
+{
+    fis.lba0 = sector&0xFF;
+    fis.lba1 = (sector>>8)&0xFF;
+    fis.lba2 = (sector>>16)&0xFF;
+    fis.device = 1<<6;	// LBA mode
+
+    fis.lba3 = (sector>>24)&0xFF;
+    fis.lba4 = (sector>>32)&0xFF;
+    fis.lba5 = (sector>>40)&0xFF;
+}
+
+bool issue_transfer(size_t port, uint64_t sector, size_t count, const void* buf, bool write)
+{
+    using namespace detail;
+
+    const bool queued = port_states[port].ncq;
+    SlotLock lock(port, false);
+    const int slot = lock.slot();
+
+    CommandHeader* cmdheader = &(cmdlists[port].hdrs[slot]);
+
+    cmdheader->cfl = sizeof(FisRegH2D)/sizeof(uint32_t);	// Command FIS size
+    cmdheader->write = write;
+    cmdheader->atapi = false;
+
+    CommandTable* cmdtbl = &cmdtables[port][slot];
+    memset(cmdtbl, 0, sizeof(CommandTable));
+
+    cmdheader->prdtl = fill_prdt(*cmdtbl, buf, count*512);	// PRDT entries count
+    if (!cmdheader->prdtl)
+    {
+        warn("AHCI %s buffer is too scattered\n", write ? "write" : "read");
+        return false;
+    }
+
+    // Setup command
+    FisRegH2D *cmdfis = reinterpret_cast<FisRegH2D*>(&cmdtbl->command_fis);
+
+    cmdfis->fis_type = FISType::RegH2D;
+    cmdfis->c = 1;	// Command
+    set_lba(*cmdfis, sector);
+
+    if (queued)
+    {
+        // the sector count moves to the feature register, the count register holds the tag
+        cmdfis->command = write ? ata_write_fpdma_queued : ata_read_fpdma_queued;
+        cmdfis->featurel = count&0xFF;
+        cmdfis->featureh = (count>>8)&0xFF;
+        cmdfis->countl = slot << 3;
+    }
+    else
+    {
+        cmdfis->command = write ? ata_write_dma_ex : ata_read_dma_ex;
+        cmdfis->countl = count&0xFF;
+        cmdfis->counth = (count>>8)&0xFF;
+    }
+
+    if (!run_command(port, slot, queued))
+    {
+        err("%s disk error on AHCI port %d\n", write ? "Write" : "Read", port);
+        return false;
+    }
+
+    return true;
+}
+}
+
 bool available()
 {
     return !pci::find_devices(0x1, 0x6, 0x1).empty();
@@ -97,7 +401,7 @@ bool init()
 
     isr::register_handler(detail::get_interrupt_line(), &detail::ahci_isr);
 
-    //mem->ghc |= detail::ghd_int_enable;
+    mem->ghc |= detail::ghd_int_enable;
 
     detail::init_interface();
 
@@ -137,6 +441,7 @@ ahci::Disk::Disk(uint16_t port)
     : DiskImpl<ahci::Disk>()
 {
     m_port = port;
+    (void)enable_caching(true);
 }
 
 void ahci::Disk::update_id_data() const
@@ -145,6 +450,7 @@ void ahci::Disk::update_id_data() const
     if (detail::issue_identify_command(m_port, &data))
     {
         m_id_data = data;
+        detail::setup_queueing(m_port, data);
     }
 
     if (!m_id_data)
@@ -157,14 +463,38 @@ void ahci::Disk::update_id_data() const
 kpp::expected<MemBuffer, DiskError> ahci::Disk::read_sector(size_t sector, size_t count) const
 {
     MemBuffer data(count * sector_size());
-    if (detail::do_read(m_port, sector, count, (uint16_t*)data.data()))
+
+    auto result = read_sector_into(sector, data);
+    if (!result) return kpp::make_unexpected(result.error());
+
+    return std::move(data);
+}
+
+[[nodiscard]]
+kpp::expected<kpp::dummy_t, DiskError> ahci::Disk::read_sector_into(size_t sector, gsl::span<uint8_t> dest) const
+{
+    const size_t count = dest.size() / sector_size();
+
+    // the HBA transfers words : an odd buffer goes through a bounce buffer, others get the DMA directly
+    if ((uintptr_t)dest.data() % 2)
     {
-        return std::move(data);
+        MemBuffer bounce(dest.size());
+        if (!detail::do_read(m_port, sector, count, (uint16_t*)bounce.data()))
+        {
+            return kpp::make_unexpected(DiskError{DiskError::Unknown});
+        }
+
+        std::copy(bounce.begin(), bounce.end(), dest.begin());
+        copied_bytes += bounce.size();
+        return {};
     }
-    else
+
+    if (!detail::do_read(m_port, sector, count, (uint16_t*)dest.data()))
     {
         return kpp::make_unexpected(DiskError{DiskError::Unknown});
     }
+
+    return {};
 }
 
 [[nodiscard]]
@@ -172,7 +502,7 @@ kpp::expected<kpp::dummy_t, DiskError> ahci::Disk::write_sector(size_t sector, g
 {
     const size_t count = data.size() / sector_size() + (data.size()%sector_size()?1:0);
 
-    if (!detail::issue_write_command(m_port, sector, count, (const uint16_t*)data.data()))
+    if (!detail::do_write(m_port, sector, count, (const uint16_t*)data.data()))
     {
         return kpp::make_unexpected(DiskError{DiskError::Unknown});
     }
@@ -211,7 +541,18 @@ void detail::get_ahci_ownership()
 
 bool detail::ahci_isr(const registers *)
 {
-    log(Debug, "Interrupt !!\n");
+    const uint32_t pending = mem->is;
+
+    for (size_t port { 0 }; port < 32; ++port)
+    {
+        if (!(pending & (1u << port))) continue;
+
+        collect_completions(port);
+        port_states[port].completion_wait.wake_all();
+    }
+
+    mem->is = pending;
+
     return true;
 }
 
@@ -239,201 +580,70 @@ void detail::mkprd(PrdtEntry& entry, uint64_t addr, size_t bytes)
     entry.i = 1;
 }
 
-bool detail::issue_read_command(size_t port, uint64_t sector, size_t count, uint16_t* buf)
+size_t detail::fill_prdt(CommandTable& table, const void* buf, size_t bytes)
 {
-    int slot = free_slot(port);
-    if (slot < 0)
-    {
-        warn("No more AHCI slots available\n");
-        return false;
-    }
-
-    //CommandHeader *cmdheader = reinterpret_cast<CommandHeader*>(mem->ports[port].clb);
-    CommandHeader* cmdheader = &(cmdlists[port].hdrs[slot]);
-
-    cmdheader->cfl = sizeof(FisRegH2D)/sizeof(uint32_t);	// Command FIS size
-    cmdheader->write = 0;		// Read from device
-    cmdheader->prdtl = ((count-1)>>4) + 1;	// PRDT entries count
-
-    cmdheader->atapi = false;
+    size_t count { 0 };
+    uint64_t run_phys { 0 };
+    size_t run_len { 0 };
 
-    //CommandTable *cmdtbl = reinterpret_cast<CommandTable*>(cmdheader->ctba);
-    CommandTable* cmdtbl = &cmdtables[port];
-    memset(cmdtbl, 0, sizeof(CommandTable) +
-           (cmdheader->prdtl-1)*sizeof(PrdtEntry));
-    // 8K bytes (16 sectors) per PRDT
-
-    int i;
-    for (i=0; i<cmdheader->prdtl-1; i++)
+    auto add_run = [&]
     {
-        mkprd(cmdtbl->entries[i], Memory::physical_address(buf), 4*1024*1024);
-        buf += 4*1024*1024;
-        count -= 8;	// 16 sectors
-    }
-    mkprd(cmdtbl->entries[i], Memory::physical_address(buf), count*512);
-
-    // Setup command
-    FisRegH2D *cmdfis = reinterpret_cast<FisRegH2D*>(&cmdtbl->command_fis);
-    //FisRegH2D *cmdfis = (FisRegH2D*)&rcvfis[port];
-
-    cmdfis->fis_type = FISType::RegH2D;
-    cmdfis->c = 1;	// Command
-    cmdfis->command = ata_read_dma_ex;
+        if (count == prdt_max) return false;
+        mkprd(table.entries[count++], run_phys, run_len);
+        return true;
+    };
 
-    cmdfis->lba0 = sector&0xFF;
-    cmdfis->lba1 = (sector>>8)&0xFF;
-    cmdfis->lba2 = (sector>>16)&0xFF;
-    cmdfis->device = 1<<6;	// LBA mode
-
-    cmdfis->lba3 = (sector>>24)&0xFF;
-    cmdfis->lba4 = (sector>>32)&0xFF;
-    cmdfis->lba5 = (sector>>40)&0xFF;
-
-    cmdfis->countl = count&0xFF;
-    cmdfis->counth = (count>>8)&0xFF;
-
-    if (!Timer::sleep_until([&]{return !(mem->ports[port].tfd & (ata_busy | ata_drq));}, 500))
+    // the buffer is only virtually contiguous, its pages are checked one by one
+    for (uintptr_t addr = (uintptr_t)buf; addr < (uintptr_t)buf + bytes;)
     {
-        warn("AHCI port %d is hung\n", port);
-        return false;
-    }
+        const size_t len = std::min<uintptr_t>(Memory::page(addr) + Memory::page_size(), (uintptr_t)buf + bytes) - addr;
+        const uint64_t phys = Memory::physical_address((const void*)addr);
 
-    mem->ports[port].is = ~0; // clear interrupt flags
-    mem->ports[port].ci = 1<<slot;	// Issue command
-    flush_commands(port);
-
-    // Wait for completion
-    while (true)
-    {
-        // In some longer duration reads, it may be helpful to spin on the DPS bit
-        // in the PxIS port field as well (1 << 5)
-        if (((mem->ports[port].sact | mem->ports[port].ci) & (1<<slot)) == 0 &&
-                (mem->ports[port].is & pxis_dps) == 0)
-            break;
-        if (check_errors(port))	// Task file error
+        if (run_len && phys == run_phys + run_len && run_len + len <= prd_max_bytes)
         {
-            err("Read disk error on AHCI port %d\n", port);
-            return false;
+            run_len += len;
+        }
+        else
+        {
+            if (run_len && !add_run()) return 0;
+            run_phys = phys;
+            run_len = len;
         }
-    }
 
-    // Check again
-    if (check_errors(port))
-    {
-        err("::Read disk error on AHCI port %d\n", port);
-        return false;
+        addr += len;
     }
 
-    return true;
+    if (run_len && !add_run()) return 0;
+
+    return count;
 }
 
-bool detail::issue_write_command(size_t port, uint64_t sector, size_t count, const uint16_t* buf)
+bool detail::issue_read_command(size_t port, uint64_t sector, size_t count, uint16_t* buf)
 {
-    int slot = free_slot(port);
-    if (slot < 0)
-    {
-        warn("No more AHCI slots available\n");
-        return false;
-    }
-
-    CommandHeader *cmdheader = &(cmdlists[port].hdrs[slot]);
-    cmdheader += slot;
-
-    cmdheader->cfl = sizeof(FisRegH2D)/sizeof(uint32_t);	// Command FIS size
-    cmdheader->write = 1;		// Write to device
-    cmdheader->prdtl = ((count-1)>>4) + 1;	// PRDT entries count
-    cmdheader->atapi = false;
-
-    //CommandTable *cmdtbl = reinterpret_cast<CommandTable*>(cmdheader->ctba);
-    CommandTable *cmdtbl = &cmdtables[port];
-    memset(cmdtbl, 0, sizeof(CommandTable) +
-           (cmdheader->prdtl-1)*sizeof(PrdtEntry));
-
-    int i;
-    for (i=0; i<cmdheader->prdtl-1; i++)
-    {
-        mkprd(cmdtbl->entries[i], Memory::physical_address(buf), 4*1024*1024);
-        buf += 4*1024*1024;
-        count -= 8;	// 16 sectors
-    }
-
-    mkprd(cmdtbl->entries[i], Memory::physical_address(buf), count*512);
-
-    // Setup command
-    FisRegH2D *cmdfis = reinterpret_cast<FisRegH2D*>(&cmdtbl->command_fis);
-
-    cmdfis->fis_type = FISType::RegH2D;
-    cmdfis->c = 1;	// Command
-    cmdfis->command = ata_write_dma_ex;
-
-    cmdfis->lba0 = sector&0xFF;
-    cmdfis->lba1 = (sector>>8)&0xFF;
-    cmdfis->lba2 = (sector>>16)&0xFF;
-    cmdfis->device = 1<<6;	// LBA mode
-
-    cmdfis->lba3 = (sector>>24)&0xFF;
-    cmdfis->lba4 = (sector>>32)&0xFF;
-    cmdfis->lba5 = (sector>>40)&0xFF;
-
-    cmdfis->countl = count&0xFF;
-    cmdfis->counth = (count>>8)&0xFF;
-
-    if (!Timer::sleep_until([&]{return !(mem->ports[port].tfd & (ata_busy | ata_drq));}, 500))
-    {
-        warn("AHCI port %d is hung\n", port);
-        return false;
-    }
-
-    mem->ports[port].is = ~0; // clear interrupt flags
-    mem->ports[port].ci = 1<<slot;	// Issue command
-    flush_commands(port);
-    // Wait for completion
-    while (true)
-    {
-        // In some longer duration reads, it may be helpful to spin on the DPS bit
-        // in the PxIS port field as well (1 << 5)
-        if (((mem->ports[port].sact | mem->ports[port].ci) & (1<<slot)) == 0)
-            break;
-        if (mem->ports[port].is & pxis_tfes)	// Task file error
-        {
-            warn("Write disk error on AHCI port %d\n", port);
-            return false;
-        }
-    }
-
-    // Check again
-    if (mem->ports[port].is & pxis_tfes)
-    {
-        warn("Write disk error on AHCI port %d\n", port);
-        return false;
-    }
+    return issue_transfer(port, sector, count, buf, false);
+}
 
-    return true;
+bool detail::issue_write_command(size_t port, uint64_t sector, size_t count, const uint16_t* buf)
+{
+    return issue_transfer(port, sector, count, buf, true);
 }
 
 bool detail::issue_identify_command(size_t port, ide::identify_data* buf)
 {
-    int slot = free_slot(port);
-    if (slot < 0)
-    {
-        warn("No more AHCI slots available\n");
-        return false;
-    }
+    SlotLock lock(port, true);
+    const int slot = lock.slot();
 
     CommandHeader* cmdheader = &(cmdlists[port].hdrs[slot]);
 
     cmdheader->cfl = sizeof(FisRegH2D)/sizeof(uint32_t);	// Command FIS size
     cmdheader->write = 0;		// Read from device
-    cmdheader->prdtl = 1;	// PRDT entries count
-
     cmdheader->atapi = false;
 
-    CommandTable* cmdtbl = &cmdtables[port];
-    memset(cmdtbl, 0, sizeof(CommandTable) +
-           (cmdheader->prdtl-1)*sizeof(PrdtEntry));
-    // 8K bytes (16 sectors) per PRDT
+    CommandTable* cmdtbl = &cmdtables[port][slot];
+    memset(cmdtbl, 0, sizeof(CommandTable));
 
-    mkprd(cmdtbl->entries[0], Memory::physical_address(buf), 512);
+    // the identify data can cross a page boundary
+    cmdheader->prdtl = fill_prdt(*cmdtbl, buf, 512);
 
     // Setup command
     FisRegH2D *cmdfis = reinterpret_cast<FisRegH2D*>(&cmdtbl->command_fis);
@@ -442,35 +652,9 @@ bool detail::issue_identify_command(size_t port, ide::identify_data* buf)
     cmdfis->c = 1;	// Command
     cmdfis->command = ata_identify;
 
-    if (!Timer::sleep_until([&]{return !(mem->ports[port].tfd & (ata_busy | ata_drq));}, 500))
-    {
-        warn("AHCI port %d is hung\n", port);
-        return false;
-    }
-
-    mem->ports[port].is = ~0; // clear interrupt flags
-    mem->ports[port].ci = 1<<slot;	// Issue command
-    flush_commands(port);
-
-    // Wait for completion
-    while (true)
-    {
-        // In some longer duration reads, it may be helpful to spin on the DPS bit
-        // in the PxIS port field as well (1 << 5)
-        if (((mem->ports[port].sact | mem->ports[port].ci) & (1<<slot)) == 0 &&
-                (mem->ports[port].is & pxis_dps) == 0)
-            break;
-        if (check_errors(port))	// Task file error
-        {
-            err("Read disk error on AHCI port %d\n", port);
-            return false;
-        }
-    }
-
-    // Check again
-    if (check_errors(port))
+    if (!run_command(port, slot, false))
     {
-        err("::Read disk error on AHCI port %d\n", port);
+        err("Identify error on AHCI port %d\n", port);
         return false;
     }
 
@@ -479,12 +663,8 @@ bool detail::issue_identify_command(size_t port, ide::identify_data* buf)
 
 bool detail::issue_cache_flush_command(size_t port)
 {
-    int slot = free_slot(port);
-    if (slot < 0)
-    {
-        warn("No more AHCI slots available\n");
-        return false;
-    }
+    SlotLock lock(port, true);
+    const int slot = lock.slot();
 
     CommandHeader* cmdheader = &(cmdlists[port].hdrs[slot]);
 
@@ -494,9 +674,8 @@ bool detail::issue_cache_flush_command(size_t port)
 
     cmdheader->atapi = false;
 
-    CommandTable* cmdtbl = &cmdtables[port];
-    memset(cmdtbl, 0, sizeof(CommandTable) +
-           (cmdheader->prdtl-1)*sizeof(PrdtEntry));
+    CommandTable* cmdtbl = &cmdtables[port][slot];
+    memset(cmdtbl, 0, sizeof(CommandTable));
 
     // Setup command
     FisRegH2D *cmdfis = reinterpret_cast<FisRegH2D*>(&cmdtbl->command_fis);
@@ -505,39 +684,33 @@ bool detail::issue_cache_flush_command(size_t port)
     cmdfis->c = 1;	// Command
     cmdfis->command = ata_flush_ext;
 
-    if (!Timer::sleep_until([&]{return !(mem->ports[port].tfd & (ata_busy | ata_drq));}, 500))
+    if (!run_command(port, slot, false))
     {
-        warn("AHCI port %d is hung\n", port);
+        err("Cache flush error on AHCI port %d\n", port);
         return false;
     }
 
-    mem->ports[port].is = ~0; // clear interrupt flags
-    mem->ports[port].ci = 1<<slot;	// Issue command
-    flush_commands(port);
+    return true;
+}
 
-    // Wait for completion
-    while (true)
-    {
-        // In some longer duration reads, it may be helpful to spin on the DPS bit
-        // in the PxIS port field as well (1 << 5)
-        if (((mem->ports[port].sact | mem->ports[port].ci) & (1<<slot)) == 0 &&
-                (mem->ports[port].is & pxis_dps) == 0)
-            break;
-        if (check_errors(port))	// Task file error
-        {
-            err("Read disk error on AHCI port %d\n", port);
-            return false;
-        }
-    }
+void detail::setup_queueing(size_t port, const ide::identify_data& data)
+{
+    auto& state = port_states[port];
 
-    // Check again
-    if (check_errors(port))
+    // 0xFFFF or 0 when the words aren't reported
+    const bool device_ncq = data.sata_capabilities != 0xFFFF && (data.sata_capabilities & sata_cap_ncq);
+    if (!mem->sncq || !device_ncq)
     {
-        err("::Read disk error on AHCI port %d\n", port);
-        return false;
+        log(Info, "AHCI port %d doesn't support NCQ, commands are issued one at a time\n", port);
+        return;
     }
 
-    return true;
+    const size_t depth = std::min<size_t>(mem->ncs + 1, (data.queue_depth & 0x1F) + 1);
+
+    state.slot_mask = depth == 32 ? ~uint32_t(0) : (1u << depth) - 1;
+    state.ncq = true;
+
+    log(Info, "AHCI port %d : NCQ, queue depth %d\n", port, depth);
 }
 
 void detail::init_interface()
@@ -551,25 +724,46 @@ void detail::init_interface()
     }
 }
 
+namespace
+{
+// any buffer of this size spans at most prdt_max pages, and the count fits in a command
+constexpr size_t max_command_sectors = (detail::prdt_max - 1) * Memory::page_size() / 512;
+}
+
 bool detail::do_read(size_t port, uint64_t sector, size_t count, uint16_t *buf)
 {
-#if 0
-    /*static*/ uint16_t temp[256];
-    for (size_t i { 0 }; i < count; ++i)
+    while (count)
+    {
+        const size_t len = std::min(count, max_command_sectors);
+        if (!issue_read_command(port, sector, len, buf))
+        {
+            return false;
+        }
+
+        sector += len;
+        count -= len;
+        buf += len*512/sizeof(uint16_t);
+    }
+
+    return true;
+}
+
+bool detail::do_write(size_t port, uint64_t sector, size_t count, const uint16_t *buf)
+{
+    while (count)
     {
-        if (!issue_read_command(port, sector + i, 1, temp))
+        const size_t len = std::min(count, max_command_sectors);
+        if (!issue_write_command(port, sector, len, buf))
         {
             return false;
         }
 
-        memcpy(buf, temp, 512);
-        buf += 256;
+        sector += len;
+        count -= len;
+        buf += len*512/sizeof(uint16_t);
     }
 
     return true;
-#else
-    return issue_read_command(port, sector, count, buf);
-#endif
 }
 
 }
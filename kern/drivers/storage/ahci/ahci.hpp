@@ -54,6 +54,8 @@ protected:
     [[nodiscard]]
     virtual kpp::expected<MemBuffer, DiskError> read_sector(size_t sector, size_t count) const override;
     [[nodiscard]]
+    virtual kpp::expected<kpp::dummy_t, DiskError> read_sector_into(size_t sector, gsl::span<uint8_t> dest) const override;
+    [[nodiscard]]
     virtual kpp::expected<kpp::dummy_t, DiskError> write_sector(size_t sector, gsl::span<const uint8_t> data) override;
 
 private:
@@ -263,6 +265,10 @@ struct alignas(1024) [[gnu::packed]] CommandList
 };
 static_assert(sizeof(CommandList) == 1024);
 
+// a command table fills 1K, a transfer of (prdt_max-1) pages always fits in it
+static constexpr size_t prdt_max = 56;
+static constexpr size_t prd_max_bytes = 4*1024*1024;
+
 struct alignas(128) [[gnu::packed]] CommandTable
 {
     uint8_t command_fis[64];
@@ -271,8 +277,9 @@ struct alignas(128) [[gnu::packed]] CommandTable
 
     uint8_t resv[48];
 
-    PrdtEntry entries[];
+    PrdtEntry entries[prdt_max];
 };
+static_assert(sizeof(CommandTable) == 1024);
 
 static constexpr uint32_t cap_s64a = 1<<31;
 static constexpr uint32_t cap_sncq = 1<<30;
@@ -294,6 +301,8 @@ static constexpr uint32_t ssts_det = 1<<0;
 
 static constexpr uint32_t int_dma_setup = 1<<2;
 static constexpr uint32_t int_dhr_setup = 1<<0;
+static constexpr uint32_t int_pio_setup = 1<<1;
+static constexpr uint32_t int_set_device_bits = 1<<3;
 
 static constexpr uint32_t pxis_tfes = 1<<30;
 static constexpr uint32_t pxis_hbfs = 1<<29;
@@ -303,14 +312,23 @@ static constexpr uint32_t pxis_ifns = 1<<26;
 static constexpr uint32_t pxis_ofs = 1<<24;
 static constexpr uint32_t pxis_dps = 1<<5;
 
+static constexpr uint32_t completion_ints = int_dhr_setup | int_pio_setup | int_dma_setup |
+                                            int_set_device_bits | pxis_tfes;
+
 static constexpr uint32_t ata_read_dma_ex = 0x25;
 static constexpr uint32_t ata_write_dma_ex = 0x35;
+static constexpr uint32_t ata_read_fpdma_queued = 0x60;
+static constexpr uint32_t ata_write_fpdma_queued = 0x61;
+static constexpr uint32_t ata_read_log_ext = 0x2F;
 static constexpr uint32_t ata_identify = 0xEC;
 static constexpr uint32_t ata_flush_ext = 0xEA;
 
 static constexpr uint32_t ata_busy = 1<<7;
 static constexpr uint32_t ata_drq = 1<<3;
 
+static constexpr uint16_t sata_cap_ncq = 1<<8;
+static constexpr uint8_t ncq_error_log = 0x10;
+
 enum class PortType
 {
     SATA,
@@ -329,6 +347,8 @@ uint8_t get_interrupt_line();
 void get_ahci_ownership();
 
 void mkprd(PrdtEntry& entry, uint64_t addr, size_t bytes);
+// one entry per physically contiguous range of buf, returns the entry count or 0 if they don't fit in the table
+size_t fill_prdt(CommandTable& table, const void* buf, size_t bytes);
 [[nodiscard]] bool issue_read_command(size_t port, uint64_t sector, size_t count, uint16_t* buf);
 [[nodiscard]] bool issue_write_command(size_t port, uint64_t sector, size_t count, const uint16_t* buf);
 [[nodiscard]] bool issue_identify_command(size_t port, ide::identify_data* buf);
@@ -336,9 +356,14 @@ void mkprd(PrdtEntry& entry, uint64_t addr, size_t bytes);
 
 uint32_t flush_commands(size_t port);
 
+// queues up to the depth the device reports when both it and the HBA support NCQ, one command at a time otherwise
+void setup_queueing(size_t port, const ide::identify_data& data);
+
 void init_interface();
 
+// split the transfer in commands whose buffer fits in a command table, buf must be word aligned
 [[nodiscard]] bool do_read(size_t port, uint64_t sector, size_t count, uint16_t* buf);
+[[nodiscard]] bool do_write(size_t port, uint64_t sector, size_t count, const uint16_t* buf);
 
 PortType get_port_type(size_t port);
 void init_port(size_t port);
@@ -348,8 +373,6 @@ void init_memory(size_t port);
 void init_port_interrupts(size_t port);
 void stop_port(size_t port);
 void start_port(size_t port);
-int free_slot(size_t port);
-bool check_errors(size_t port);
 
 }
 
@@ -357,7 +380,8 @@ extern volatile detail::HBAMem* volatile mem;
 
 extern detail::CommandList cmdlists[32];
 extern detail::ReceivedFIS rcvfis[32];
-extern detail::CommandTable cmdtables[32];
+// a command table per slot, allocated for the ports with a device
+extern detail::CommandTable* cmdtables[32];
 
 }
 
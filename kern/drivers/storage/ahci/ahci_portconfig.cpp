@@ -119,51 +119,40 @@ void detail::init_memory(size_t port)
         mem->ports[port].fbu = 0;
     }
 
-    memset(&cmdtables[port], 0, sizeof(cmdtables[port]));
-
-    for (size_t i { 0 }; i < mem->ncs; ++i)
-    {
-        cmdlists[port].hdrs[i].prdtl = 8;
-        cmdlists[port].hdrs[i].ctba = Memory::physical_address(&cmdtables[port]);
-        if (mem->s64a)
-        {
-            cmdlists[port].hdrs[i].ctbau = 0;
-        }
-    }
-}
-
-void detail::init_port_interrupts(size_t port)
-{
-    mem->ports[port].ie |= int_dhr_setup;
-    mem->ports[port].ie |= int_dma_setup;
-}
-
-int detail::free_slot(size_t port)
-{
     if (get_port_type(port) == PortType::Null)
     {
-        return -1;
+        return;
     }
-    if (!(mem->pi & (1<<port)))
+
+    // a table for each of the 32 slots, 8 pages
+    constexpr size_t tables_order { 3 };
+    constexpr size_t tables_size = 32*sizeof(CommandTable);
+    static_assert((Memory::page_size() << tables_order) == tables_size);
+    if (!cmdtables[port])
     {
-        return -1;
+        const uintptr_t tables = Memory::allocate_physical_pages(tables_order);
+        assert(tables);
+        cmdtables[port] = static_cast<CommandTable*>(Memory::mmap(tables, tables_size));
     }
+    memset(cmdtables[port], 0, tables_size);
 
-    // If not set in SACT and CI, the slot is free
-    uint32_t slots = (mem->ports[port].sact | mem->ports[port].ci);
-
-    for (int i = 0; i < mem->ncs; i++)
+    // ncs is the slot count minus one
+    for (size_t i { 0 }; i <= mem->ncs; ++i)
     {
-        if ((slots&1) == 0)
+        cmdlists[port].hdrs[i].ctba = Memory::physical_address(&cmdtables[port][i]);
+        if (mem->s64a)
         {
-            return i;
+            cmdlists[port].hdrs[i].ctbau = 0;
         }
-        slots >>= 1;
     }
-
-    return -1;
 }
 
+void detail::init_port_interrupts(size_t port)
+{
+    // the interrupt handler acknowledges them and wakes the processes waiting for the completed commands
+    mem->ports[port].is = ~0;
+    mem->ports[port].ie = completion_ints;
+}
 
 void detail::stop_port(size_t port)
 {
@@ -197,38 +186,4 @@ void detail::start_port(size_t port)
     mem->ports[port].cmd |= pxcmd_fre;
 }
 
-bool detail::check_errors(size_t port)
-{
-    if (mem->ports[port].is & pxis_tfes)
-    {
-        if (mem->ports[port].is & pxis_hbfs)
-        {
-            warn("AHCI software error port %d\n", port);
-        }
-
-        mem->ports[port].cmd &= ~pxcmd_st;
-        mem->ports[port].serr &= 0xFFFF0000;
-
-        if (!Timer::sleep_until([&]{return (mem->ports[port].cmd & pxcmd_cr) == 0;}, 500))
-        {
-            reset_port(port);
-            return true;
-        }
-
-        mem->ports[port].cmd |= pxcmd_st;
-
-        if (!((mem->ports[port].is & pxis_ifns) || (mem->ports[port].is & pxis_ofs)))
-        {
-            // Fatal error, reset the port
-            reset_port(port);
-        }
-
-        return true;
-    }
-    else
-    {
-        return false;
-    }
-}
-
 }
@@ -27,6 +27,8 @@ SOFTWARE.
 
 #include <vector.hpp>
 
+#include "writeback.hpp"
+
 #include "utils/stlutils.hpp"
 #include "utils/messagebus.hpp"
 #include "utils/memutils.hpp"
@@ -42,12 +44,7 @@ void Disk::system_init()
 {
     MessageBus::register_handler<SyncDisksCache>([](const SyncDisksCache&)
     {
-        for (Disk& disk : disks())
-        {
-            auto result = disk.flush_cache();
-            if (!result)
-                err("Could not flush disk %s : %s\n", disk.drive_name().c_str(), result.error().to_string());
-        }
+        writeback::sync_all();
     });
 
     MessageBus::register_handler<ShutdownMessage>([](const ShutdownMessage&)
@@ -59,7 +56,6 @@ void Disk::system_init()
 Disk::Disk()
     : m_cache(*this)
 {
-    (void)enable_caching(true);
 }
 
 Disk::~Disk() = default;
@@ -76,31 +72,43 @@ void Disk::set_read_only(bool val)
 
 kpp::expected<MemBuffer, DiskError> Disk::read(size_t offset, size_t size) const
 {
-    //LOCK(read_lock);
+    MemBuffer data(size);
 
-    const size_t sect_size = sector_size();
+    auto result = read_into(offset, data);
+    if (!result) return kpp::make_unexpected(result.error());
 
-    const size_t sector = offset / sect_size;
-    const size_t count = ((offset+size)/sect_size + ((offset+size)%sect_size?1:0))
-            - (offset/sect_size + (offset%sect_size?1:0))
-            + ((offset+size)%sect_size?1:0);
-
-    assert(count <= disk_size()/sector_size() + (disk_size()%sector_size()?1:0));
+    return std::move(data);
+}
 
-    auto result = read_cache_sector(sector, count);
-    if (!result) return result;
+kpp::expected<MemBuffer, DiskError> Disk::read(size_t offset, size_t size, Readahead& stream) const
+{
+    MemBuffer data(size);
 
-    auto data = std::move(result.value());
+    auto result = read_into(offset, data, stream);
+    if (!result) return kpp::make_unexpected(result.error());
 
-    assert(data.size() >= size);
+    return std::move(data);
+}
 
-    offset %= sect_size;
+[[nodiscard]]
+kpp::expected<kpp::dummy_t, DiskError> Disk::read_into(size_t offset, gsl::span<uint8_t> dest) const
+{
+    assert(offset + dest.size() <= disk_size());
 
-    assert(data.size() >= offset + size);
+    return read_cache_into(offset, dest);
+}
 
-    //UNLOCK(read_lock);
+[[nodiscard]]
+kpp::expected<kpp::dummy_t, DiskError> Disk::read_into(size_t offset, gsl::span<uint8_t> dest, Readahead& stream) const
+{
+    const auto ahead = stream.access(offset, dest.size(), disk_size());
+    if (ahead.size)
+    {
+        // a failing prefetch is reported by the read itself
+        (void)prefetch(ahead.offset, ahead.size);
+    }
 
-    return MemBuffer{data.begin() + offset, data.begin() + offset + size};
+    return read_into(offset, dest);
 }
 
 kpp::expected<MemBuffer, DiskError> Disk::read() const
@@ -162,6 +170,8 @@ kpp::expected<kpp::dummy_t, DiskError> Disk::write(size_t offset, gsl::span<cons
         if (!result) return result;
         offset -= sect_size;
     }
+
+    return {};
 }
 
 [[nodiscard]]
@@ -169,12 +179,13 @@ kpp::expected<kpp::dummy_t, DiskError> Disk::enable_caching(bool val)
 {
     if (!val && m_caching)
     {
-        auto result = flush_cache();
+        // the cached blocks would be stale once it's enabled again
+        auto result = m_cache.flush();
         if (!result) return result;
+        m_cache.clear();
     }
 
-    // TODO : investigate why enabling caching destroys performance !
-    //m_caching = val;
+    m_caching = val;
 
     return {};
 }
@@ -189,6 +200,21 @@ kpp::expected<kpp::dummy_t, DiskError> Disk::flush_cache()
     return {};
 }
 
+[[nodiscard]]
+kpp::expected<kpp::dummy_t, DiskError> Disk::write_back(uint32_t min_age_ms)
+{
+    return m_cache.flush(min_age_ms);
+}
+
+[[nodiscard]]
+kpp::expected<kpp::dummy_t, DiskError> Disk::prefetch(size_t offset, size_t size) const
+{
+    const size_t sect_size = sector_size();
+    const size_t sector = offset / sect_size;
+
+    return prefetch_cache_sector(sector, (offset + size + sect_size - 1) / sect_size - sector);
+}
+
 kpp::expected<MemBuffer, DiskError> Disk::read_cache_sector(size_t sector, size_t count) const
 {
     if (m_caching) return m_cache.read_sector(sector, count);
@@ -203,6 +229,64 @@ kpp::expected<kpp::dummy_t, DiskError> Disk::write_cache_sector(size_t sector, g
     else return write_sector(sector, data);
 }
 
+[[nodiscard]]
+kpp::expected<kpp::dummy_t, DiskError> Disk::read_cache_into(size_t offset, gsl::span<uint8_t> dest) const
+{
+    if (m_caching) return m_cache.read_into(offset, dest);
+
+    const size_t sect_size = sector_size();
+    size_t sector = offset / sect_size;
+    size_t skip = offset % sect_size;
+    gsl::span<uint8_t> left = dest;
+
+    // partial sectors at both ends go through a bounce buffer, the whole ones in between are read in place
+    while (!left.empty())
+    {
+        if (skip == 0 && (size_t)left.size() >= sect_size)
+        {
+            const size_t whole = left.size() / sect_size * sect_size;
+            auto result = read_sector_into(sector, left.subspan(0, whole));
+            if (!result) return result;
+
+            sector += whole / sect_size;
+            left = left.subspan(whole);
+            continue;
+        }
+
+        auto result = read_sector(sector, 1);
+        if (!result) return kpp::make_unexpected(result.error());
+
+        const size_t len = std::min<size_t>(sect_size - skip, left.size());
+        std::copy(result.value().begin() + skip, result.value().begin() + skip + len, left.begin());
+        copied_bytes += len;
+
+        ++sector;
+        skip = 0;
+        left = left.subspan(len);
+    }
+
+    return {};
+}
+
+[[nodiscard]]
+kpp::expected<kpp::dummy_t, DiskError> Disk::read_sector_into(size_t sector, gsl::span<uint8_t> dest) const
+{
+    auto result = read_sector(sector, dest.size() / sector_size());
+    if (!result) return kpp::make_unexpected(result.error());
+
+    std::copy(result.value().begin(), result.value().end(), dest.begin());
+    copied_bytes += dest.size();
+
+    return {};
+}
+
+[[nodiscard]]
+kpp::expected<kpp::dummy_t, DiskError> Disk::prefetch_cache_sector(size_t sector, size_t count) const
+{
+    if (!m_caching) return {};
+    return m_cache.prefetch(sector, count);
+}
+
 ref_vector<Disk> Disk::disks()
 {
     ref_vector<Disk> vec;
@@ -217,7 +301,6 @@ ref_vector<Disk> Disk::disks()
 MemoryDisk::MemoryDisk(uint8_t* data, size_t size, kpp::string name)
     : DiskImpl<MemoryDisk>(), m_size(size), m_data(data), m_name(std::move(name))
 {
-    (void)enable_caching(false);
 }
 
 MemoryDisk::MemoryDisk(const uint8_t *data, size_t size, const kpp::string& name)
@@ -237,6 +320,16 @@ kpp::expected<MemBuffer, DiskError> MemoryDisk::read_sector(size_t sector, size_
     return std::move(data);
 }
 
+[[nodiscard]]
+kpp::expected<kpp::dummy_t, DiskError> MemoryDisk::read_sector_into(size_t sector, gsl::span<uint8_t> dest) const
+{
+    const size_t offset = sector * sector_size();
+
+    std::copy(m_data + offset, m_data + offset + dest.size(), dest.begin());
+
+    return {};
+}
+
 [[nodiscard]]
 kpp::expected<kpp::dummy_t, DiskError> MemoryDisk::write_sector(size_t sector, gsl::span<const uint8_t> data)
 {
@@ -267,6 +360,17 @@ kpp::expected<MemBuffer, DiskError> DiskSlice::read_sector(size_t sector, size_t
     return m_base_disk.read_sector(sector + m_offset, count);
 }
 
+[[nodiscard]]
+kpp::expected<kpp::dummy_t, DiskError> DiskSlice::read_sector_into(size_t sector, gsl::span<uint8_t> dest) const
+{
+    if (sector + dest.size()/sector_size() > m_size)
+    {
+        return kpp::make_unexpected(DiskError{DiskError::OutOfBounds});
+    }
+
+    return m_base_disk.read_sector_into(sector + m_offset, dest);
+}
+
 [[nodiscard]]
 kpp::expected<kpp::dummy_t, DiskError> DiskSlice::write_sector(size_t sector, gsl::span<const uint8_t> data)
 {
@@ -278,6 +382,46 @@ kpp::expected<kpp::dummy_t, DiskError> DiskSlice::write_sector(size_t sector, gs
     return m_base_disk.write_sector(sector + m_offset, data);
 }
 
+kpp::expected<MemBuffer, DiskError> DiskSlice::read_cache_sector(size_t sector, size_t count) const
+{
+    if (sector + count > m_size)
+    {
+        return kpp::make_unexpected(DiskError{DiskError::OutOfBounds});
+    }
+
+    return m_base_disk.read_cache_sector(sector + m_offset, count);
+}
+
+[[nodiscard]]
+kpp::expected<kpp::dummy_t, DiskError> DiskSlice::write_cache_sector(size_t sector, gsl::span<const uint8_t> data)
+{
+    if (sector + data.size()/sector_size() > m_size)
+    {
+        return kpp::make_unexpected(DiskError{DiskError::OutOfBounds});
+    }
+
+    return m_base_disk.write_cache_sector(sector + m_offset, data);
+}
+
+[[nodiscard]]
+kpp::expected<kpp::dummy_t, DiskError> DiskSlice::read_cache_into(size_t offset, gsl::span<uint8_t> dest) const
+{
+    if (offset + dest.size() > disk_size())
+    {
+        return kpp::make_unexpected(DiskError{DiskError::OutOfBounds});
+    }
+
+    return m_base_disk.read_cache_into(offset + m_offset*sector_size(), dest);
+}
+
+[[nodiscard]]
+kpp::expected<kpp::dummy_t, DiskError> DiskSlice::prefetch_cache_sector(size_t sector, size_t count) const
+{
+    if (sector >= m_size) return {};
+
+    return m_base_disk.prefetch_cache_sector(sector + m_offset, std::min(count, m_size - sector));
+}
+
 void test_writes(Disk &disk)
 {
     log(Notice, "Testing writes on disk %s\n", disk.drive_name().c_str());
@@ -36,6 +36,7 @@ SOFTWARE.
 #include <utils/gsl/gsl_span.hpp>
 
 #include "diskcache.hpp"
+#include "readahead.hpp"
 #include "panic.hpp"
 
 struct DiskFoundEvent
@@ -118,34 +119,63 @@ public:
     void set_read_only(bool val);
 
     kpp::expected<MemBuffer, DiskError> read(size_t offset, size_t size) const;
+    // same, prefetching ahead of stream while it reads sequentially
+    kpp::expected<MemBuffer, DiskError> read(size_t offset, size_t size, Readahead& stream) const;
     kpp::expected<MemBuffer, DiskError> read() const;
 
+    // reads [offset, offset + dest.size()) straight into dest, without allocating.
+    // Sector aligned reads of an uncached disk, and large sector aligned misses of a cached one,
+    // go from the device to dest without any copy
+    [[nodiscard]]
+    kpp::expected<kpp::dummy_t, DiskError> read_into(size_t offset, gsl::span<uint8_t> dest) const;
+    [[nodiscard]]
+    kpp::expected<kpp::dummy_t, DiskError> read_into(size_t offset, gsl::span<uint8_t> dest, Readahead& stream) const;
+
+    // loads [offset, offset + size) into the cache ahead of its use, does nothing when caching is disabled
+    [[nodiscard]]
+    kpp::expected<kpp::dummy_t, DiskError> prefetch(size_t offset, size_t size) const;
+
     [[nodiscard]]
     kpp::expected<kpp::dummy_t, DiskError> write(size_t offset, gsl::span<const uint8_t> data);
 
+    // off by default : the drivers of hardware disks turn it on, memory disks and slices read their storage directly
     [[nodiscard]]
     kpp::expected<kpp::dummy_t, DiskError> enable_caching(bool val);
     bool caching_enabled() const { return m_caching; }
     [[nodiscard]]
     kpp::expected<kpp::dummy_t, DiskError> flush_cache();
+    // writes back the cached blocks dirty for at least min_age_ms, without flushing the hardware cache
+    [[nodiscard]]
+    kpp::expected<kpp::dummy_t, DiskError> write_back(uint32_t min_age_ms);
+    DiskCache::Stats cache_stats() const { return m_cache.stats(); }
 
 private:
     [[nodiscard]]
     kpp::expected<kpp::dummy_t, DiskError> write_offseted_sector(size_t base, size_t byte_off, gsl::span<const uint8_t> data);
 
-    kpp::expected<MemBuffer, DiskError> read_cache_sector(size_t sector, size_t count) const;
+    virtual kpp::expected<MemBuffer, DiskError> read_cache_sector(size_t sector, size_t count) const;
+    [[nodiscard]]
+    virtual kpp::expected<kpp::dummy_t, DiskError> write_cache_sector(size_t sector, gsl::span<const uint8_t> data);
     [[nodiscard]]
-    kpp::expected<kpp::dummy_t, DiskError> write_cache_sector(size_t sector, gsl::span<const uint8_t> data);
+    virtual kpp::expected<kpp::dummy_t, DiskError> prefetch_cache_sector(size_t sector, size_t count) const;
+    [[nodiscard]]
+    virtual kpp::expected<kpp::dummy_t, DiskError> read_cache_into(size_t offset, gsl::span<uint8_t> dest) const;
 
 public:
     [[nodiscard]]
     virtual kpp::expected<MemBuffer, DiskError> read_sector(size_t sector, size_t count) const = 0;
+    // dest holds whole sectors. Drivers which can read in place override it, it copies from read_sector otherwise
+    [[nodiscard]]
+    virtual kpp::expected<kpp::dummy_t, DiskError> read_sector_into(size_t sector, gsl::span<uint8_t> dest) const;
     [[nodiscard]]
     virtual kpp::expected<kpp::dummy_t, DiskError> write_sector(size_t sector, gsl::span<const uint8_t> data) = 0;
 
 public:
     static ref_vector<Disk> disks();
 
+    // payload bytes copied from a buffer to another by the read paths, to measure how far they are from zero-copy
+    static inline uint64_t copied_bytes { 0 };
+
 private:
     mutable DiskCache m_cache;
     bool m_read_only { false };
@@ -189,6 +219,8 @@ public:
 protected:
     virtual kpp::expected<MemBuffer, DiskError> read_sector(size_t sector, size_t count) const override;
     [[nodiscard]]
+    virtual kpp::expected<kpp::dummy_t, DiskError> read_sector_into(size_t sector, gsl::span<uint8_t> dest) const override;
+    [[nodiscard]]
     virtual kpp::expected<kpp::dummy_t, DiskError> write_sector(size_t sector, gsl::span<const uint8_t> data) override;
 
 public:
@@ -210,7 +242,7 @@ public:
     virtual size_t disk_size() const override { return m_size * sector_size(); }
     virtual size_t sector_size() const override { return m_base_disk.sector_size(); }
     virtual kpp::string drive_name() const override { return m_base_disk.drive_name() + " - slice"; }
-    virtual void flush_hardware_cache() override { m_base_disk.flush_hardware_cache(); }
+    virtual void flush_hardware_cache() override { (void)m_base_disk.flush_cache(); }
     virtual Type media_type() const override { return m_base_disk.media_type(); }
     virtual bool is_partition() const override { return true; };
 
@@ -220,8 +252,20 @@ public:
 protected:
     virtual kpp::expected<MemBuffer, DiskError> read_sector(size_t sector, size_t count) const override;
     [[nodiscard]]
+    virtual kpp::expected<kpp::dummy_t, DiskError> read_sector_into(size_t sector, gsl::span<uint8_t> dest) const override;
+    [[nodiscard]]
     virtual kpp::expected<kpp::dummy_t, DiskError> write_sector(size_t sector, gsl::span<const uint8_t> data) override;
 
+private:
+    // a slice goes through the cache of its base disk, so that the disk and its partitions share the same blocks
+    virtual kpp::expected<MemBuffer, DiskError> read_cache_sector(size_t sector, size_t count) const override;
+    [[nodiscard]]
+    virtual kpp::expected<kpp::dummy_t, DiskError> write_cache_sector(size_t sector, gsl::span<const uint8_t> data) override;
+    [[nodiscard]]
+    virtual kpp::expected<kpp::dummy_t, DiskError> prefetch_cache_sector(size_t sector, size_t count) const override;
+    [[nodiscard]]
+    virtual kpp::expected<kpp::dummy_t, DiskError> read_cache_into(size_t offset, gsl::span<uint8_t> dest) const override;
+
 private:
     Disk& m_base_disk;
     size_t m_offset {};
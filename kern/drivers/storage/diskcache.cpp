@@ -25,184 +25,456 @@ SOFTWARE.
 
 #include "diskcache.hpp"
 
-#include "time/time.hpp"
+#include <algorithm.hpp>
 
 #include "disk.hpp"
-#include "mem/meminfo.hpp"
-#include "utils/memutils.hpp"
-#include "utils/stlutils.hpp"
+#include "writeback.hpp"
+#include "time/timer.hpp"
 
 #include "panic.hpp"
 
+namespace
+{
+uint32_t sector_mask(size_t first, size_t count)
+{
+    return (count >= 32 ? ~0u : (1u << count) - 1) << first;
+}
+}
+
 DiskCache::DiskCache(Disk &disk)
     : m_disk(disk)
 {
 
 }
 
-[[nodiscard]]
-kpp::expected<kpp::dummy_t, DiskError> DiskCache::write_sector(size_t sec, gsl::span<const uint8_t> data)
+void DiskCache::init()
 {
-    auto chunks = split(data, m_disk.sector_size());
-    for (size_t i { 0 }; i < chunks.size(); ++i)
-    {
-        add_to_cache(sec + i, chunks[i], true);
-    }
+    // the disk geometry isn't known yet when the cache is constructed
+    m_sector_size = m_disk.sector_size();
+    m_block_sectors = std::clamp<size_t>(block_size / m_sector_size, 1, 32);
+    m_disk_sectors = m_disk.disk_size() / m_sector_size;
+    m_capacity = std::max<size_t>(max_cache_size / (m_block_sectors*m_sector_size), 1);
 
-    return prune_cache();
+    size_t buckets { 1 };
+    while (buckets < m_capacity) buckets *= 2;
+
+    m_blocks.reserve(m_capacity);
+    m_buckets.resize(buckets, npos);
 }
 
 [[nodiscard]]
-kpp::expected<MemBuffer, DiskError> DiskCache::read_sector(size_t sec, size_t count)
+kpp::expected<kpp::dummy_t, DiskError> DiskCache::write_sector(size_t sec, gsl::span<const uint8_t> data)
 {
-    MemBuffer data;
-    data.reserve(count*m_disk.sector_size());
+    tasking::MutexLock lock(m_mutex);
+    if (!m_block_sectors) init();
 
-    auto result = add_span(sec, count);
-    if (!result) return kpp::make_unexpected(result.error());
+    assert(data.size() % m_sector_size == 0);
 
-    for (size_t i { sec }; i < sec + count; ++i)
+    const size_t end = sec + data.size() / m_sector_size;
+    const uint8_t* src = data.data();
+    while (sec < end)
     {
-        merge(data, m_cache.at(i).data);
+        const size_t first = sec % m_block_sectors;
+        const size_t count = std::min(m_block_sectors - first, end - sec);
+
+        auto result = get_block(sec / m_block_sectors);
+        if (!result) return kpp::make_unexpected(result.error());
+        Block& block = m_blocks[result.value()];
+
+        std::copy(src, src + count*m_sector_size, block.data.data() + first*m_sector_size);
+        if (!block.dirty)
+        {
+            block.dirty_since = Timer::now_us();
+            ++m_dirty_blocks;
+        }
+        block.valid |= sector_mask(first, count);
+        block.dirty |= sector_mask(first, count);
 
-        const uint64_t ticks = Time::total_ticks();
+        src += count*m_sector_size;
+        sec += count;
+    }
 
-        m_access_times.erase(m_cache.at(i).access_time);
-        m_access_times.emplace(ticks, i);
-        m_cache.at(i).access_time = ticks;
+    // dirty blocks are costly to evict, write them back before they fill the cache
+    if (m_dirty_blocks > m_capacity / 2)
+    {
+        writeback::kick();
     }
 
-    auto prune_result = prune_cache();
-    if (!prune_result)
-        return kpp::make_unexpected(prune_result.error());
+    return {};
+}
+
+[[nodiscard]]
+kpp::expected<MemBuffer, DiskError> DiskCache::read_sector(size_t sec, size_t count)
+{
+    tasking::MutexLock lock(m_mutex);
+    if (!m_block_sectors) init();
+
+    MemBuffer data(count*m_sector_size);
+
+    auto result = fill(sec, count, data, 0);
+    if (!result) return kpp::make_unexpected(result.error());
 
     return std::move(data);
 }
 
 [[nodiscard]]
-kpp::expected<kpp::dummy_t, DiskError> DiskCache::flush()
+kpp::expected<kpp::dummy_t, DiskError> DiskCache::read_into(size_t offset, gsl::span<uint8_t> dest)
 {
-    log_serial("Cache flush\n");
-    while (!m_cache.empty())
-    {
-        auto result = remove_entry(m_access_times.begin()->second);
-        if (!result)
-            return kpp::make_unexpected(result.error());
-    }
+    tasking::MutexLock lock(m_mutex);
+    if (!m_block_sectors) init();
+
+    const size_t sec = offset / m_sector_size;
+    const size_t end = (offset + dest.size() + m_sector_size - 1) / m_sector_size;
+
+    return fill(sec, end - sec, dest, offset % m_sector_size);
 }
 
 [[nodiscard]]
-kpp::expected<kpp::dummy_t, DiskError> DiskCache::set_ratio(size_t ratio)
+kpp::expected<kpp::dummy_t, DiskError> DiskCache::prefetch(size_t sec, size_t count)
 {
-    m_size_ratio = ratio;
-    return prune_cache();
+    tasking::MutexLock lock(m_mutex);
+    if (!m_block_sectors) init();
+
+    return fill(sec, std::min(count, m_disk_sectors - std::min(sec, m_disk_sectors)), {}, 0);
 }
 
 [[nodiscard]]
-kpp::expected<kpp::dummy_t, DiskError> DiskCache::add_span(size_t sec, size_t count)
+kpp::expected<kpp::dummy_t, DiskError> DiskCache::fill(size_t sec, size_t count, gsl::span<uint8_t> dest, size_t skip)
 {
-#if 1
-    for (size_t i { sec }; i < sec + count;)
+    const size_t start = sec;
+    const size_t end = sec + count;
+    const size_t max_run = std::max<size_t>(m_capacity / 4, 1);
+    while (sec < end)
     {
-        if (m_cache.count(i) == 0)
+        // gather the run of blocks which miss some of the requested sectors, to read them in one go
+        size_t run { 0 };
+        for (size_t run_sec { sec }; run_sec < end && run < max_run; ++run)
         {
-            size_t len { 1 };
-            while (m_cache.count(i + len) == 0 && len < count) { ++len; };
+            const size_t first = run_sec % m_block_sectors;
+            const size_t len = std::min(m_block_sectors - first, end - run_sec);
+            const uint32_t id = find(run_sec / m_block_sectors);
+            if (id != npos && (m_blocks[id].valid & sector_mask(first, len)) == sector_mask(first, len))
+            {
+                break;
+            }
+            run_sec += len;
+        }
 
-#if 1
-            auto result = m_disk.read_sector(i, len);
-            if (!result) return kpp::make_unexpected(result.error());
-            auto data = split(result.value(), m_disk.sector_size());
+        const size_t run_start = sec / m_block_sectors * m_block_sectors;
+        if (run)
+        {
+            const size_t run_end = std::min((sec / m_block_sectors + run) * m_block_sectors, m_disk_sectors);
 
-            for (size_t j { 0 }; j < len; ++j)
+            // a large miss is most likely read once : going through the blocks would cost a copy and evict them.
+            // Only the sectors dest holds whole can be read in place
+            const size_t direct_end = skip == 0 ? std::min<size_t>(run_end, start + dest.size() / m_sector_size) : 0;
+            if (direct_end > sec && (direct_end - sec)*m_sector_size >= direct_read_size)
             {
-                add_to_cache(i+j, data[j]);
+                auto result = read_direct(sec, direct_end, dest.subspan((sec - start)*m_sector_size, (direct_end - sec)*m_sector_size));
+                if (!result) return result;
+
+                sec = direct_end;
+                continue;
             }
-#else
-            auto data = m_disk.read_sector(i, len);
 
-            for (size_t j { 0 }; j < len; ++j)
+            // the scratch buffer is kept, misses don't allocate
+            m_scratch.resize(std::max(m_scratch.size(), (run_end - run_start)*m_sector_size));
+            auto result = m_disk.read_sector_into(run_start, gsl::span<uint8_t>(m_scratch.data(), (run_end - run_start)*m_sector_size));
+            if (!result) return kpp::make_unexpected(result.error());
+        }
+
+        // a hit is handled as a run of one block which needs no reading
+        for (size_t i { 0 }; i < std::max<size_t>(run, 1); ++i)
+        {
+            const size_t index = sec / m_block_sectors;
+            const size_t first = sec % m_block_sectors;
+            const size_t len = std::min(m_block_sectors - first, end - sec);
+
+            auto result = get_block(index);
+            if (!result) return kpp::make_unexpected(result.error());
+            Block& block = m_blocks[result.value()];
+
+            if (run)
             {
-                add_to_cache(sec + j, gsl::span<const uint8_t>(data.data() + j*m_disk.sector_size(),
-                                                               data.data() + (j+1)*m_disk.sector_size()));
+                // sectors already cached may be newer than the disk
+                const uint32_t missing = existing_sectors(index) & ~block.valid;
+                const uint8_t* src = m_scratch.data() + (index*m_block_sectors - run_start)*m_sector_size;
+                for (size_t j { 0 }; j < m_block_sectors; ++j)
+                {
+                    if (missing & (1u << j))
+                    {
+                        std::copy(src + j*m_sector_size, src + (j+1)*m_sector_size, block.data.data() + j*m_sector_size);
+                        Disk::copied_bytes += m_sector_size;
+                    }
+                }
+                block.valid |= missing;
             }
-#endif
 
-            i += len;
+            // only the part of the sectors which was asked for is copied out
+            const size_t pos = (sec - start)*m_sector_size;
+            const size_t lo = std::max(pos, skip);
+            const size_t hi = std::min<size_t>(pos + len*m_sector_size, skip + dest.size());
+            if (lo < hi)
+            {
+                const uint8_t* src = block.data.data() + first*m_sector_size + (lo - pos);
+                std::copy(src, src + (hi - lo), dest.data() + (lo - skip));
+                Disk::copied_bytes += hi - lo;
+            }
+            sec += len;
         }
-        else
+    }
+
+    return {};
+}
+
+[[nodiscard]]
+kpp::expected<kpp::dummy_t, DiskError> DiskCache::read_direct(size_t sec, size_t end, gsl::span<uint8_t> dest)
+{
+    auto result = m_disk.read_sector_into(sec, dest);
+    if (!result) return result;
+
+    // the blocks of the range are at most partially cached, their sectors may be newer than the disk
+    for (size_t index { sec / m_block_sectors }; index*m_block_sectors < end; ++index)
+    {
+        const uint32_t id = find(index);
+        if (id == npos) continue;
+
+        const Block& block = m_blocks[id];
+        for (size_t j { 0 }; j < m_block_sectors; ++j)
         {
-            ++i;
+            const size_t sector = index*m_block_sectors + j;
+            if (sector < sec || sector >= end || !(block.valid & (1u << j))) continue;
+
+            const uint8_t* src = block.data.data() + j*m_sector_size;
+            std::copy(src, src + m_sector_size, dest.data() + (sector - sec)*m_sector_size);
+            Disk::copied_bytes += m_sector_size;
         }
     }
-#else
-    for (size_t i { sec }; i < sec + count; ++i)
+
+    return {};
+}
+
+[[nodiscard]]
+kpp::expected<kpp::dummy_t, DiskError> DiskCache::flush(uint32_t min_age_ms)
+{
+    tasking::MutexLock lock(m_mutex);
+
+    std::vector<uint32_t> dirty;
+    dirty.reserve(m_dirty_blocks);
+    for (uint32_t id { 0 }; id < m_blocks.size(); ++id)
+    {
+        if (m_blocks[id].dirty) dirty.emplace_back(id);
+    }
+    std::sort(dirty.begin(), dirty.end(), [this](uint32_t lhs, uint32_t rhs)
+    { return m_blocks[lhs].index < m_blocks[rhs].index; });
+
+    const uint64_t now = Timer::now_us();
+    const uint64_t min_age = uint64_t(min_age_ms)*1000;
+    for (size_t first { 0 }; first < dirty.size();)
     {
-        add_to_cache(i, m_disk.read_sector(i, 1));
+        // a run of adjacent blocks is written as a whole, so that it goes out in large sequential commands
+        size_t last { first };
+        bool expired = now - m_blocks[dirty[first]].dirty_since >= min_age;
+        while (last + 1 < dirty.size() && m_blocks[dirty[last + 1]].index == m_blocks[dirty[last]].index + 1)
+        {
+            ++last;
+            expired |= now - m_blocks[dirty[last]].dirty_since >= min_age;
+        }
+
+        if (expired)
+        {
+            auto result = write_back(gsl::span<const uint32_t>(dirty.data() + first, last - first + 1));
+            if (!result) return result;
+        }
+
+        first = last + 1;
     }
-#endif
 
     return {};
 }
 
-void DiskCache::add_to_cache(size_t sec, gsl::span<const uint8_t> data, bool write)
+void DiskCache::clear()
+{
+    tasking::MutexLock lock(m_mutex);
+
+    m_blocks.clear();
+    m_scratch = MemBuffer{};
+    std::fill(m_buckets.begin(), m_buckets.end(), npos);
+    m_lru_head = m_lru_tail = npos;
+    m_dirty_blocks = 0;
+}
+
+DiskCache::Stats DiskCache::stats() const
+{
+    tasking::MutexLock lock(m_mutex);
+
+    Stats stats;
+    stats.cached_blocks = m_blocks.size();
+    stats.dirty_blocks = m_dirty_blocks;
+    stats.written_sectors = m_written_sectors;
+    stats.write_commands = m_write_commands;
+    stats.writeback_us = m_writeback_us;
+
+    const uint64_t now = Timer::now_us();
+    for (const auto& block : m_blocks)
+    {
+        if (block.dirty) stats.oldest_dirty_us = std::max(stats.oldest_dirty_us, now - block.dirty_since);
+    }
+
+    return stats;
+}
+
+uint32_t DiskCache::find(size_t index) const
 {
-    auto ticks = Time::total_ticks();
+    if (m_buckets.empty()) return npos;
 
-    if (m_cache.count(sec) == 0)
+    uint32_t id = m_buckets[index & (m_buckets.size() - 1)];
+    while (id != npos && m_blocks[id].index != index)
     {
-        //log_serial("Cache miss\n");
+        id = m_blocks[id].hash_next;
+    }
+
+    return id;
+}
 
-        m_access_times.emplace(ticks, sec);
-        m_cache[sec] = CacheEntry{MemBuffer(data.begin(), data.end()), write, ticks};
+[[nodiscard]]
+kpp::expected<uint32_t, DiskError> DiskCache::get_block(size_t index)
+{
+    uint32_t id = find(index);
+    if (id != npos)
+    {
+        lru_unlink(id);
+        lru_push_front(id);
+        return id;
+    }
+
+    if (m_blocks.size() < m_capacity)
+    {
+        m_blocks.emplace_back();
+        id = m_blocks.size() - 1;
+        m_blocks[id].data.resize(m_block_sectors*m_sector_size);
     }
     else
     {
-        m_cache.at(sec).data = MemBuffer(data.begin(), data.end());
-        m_cache.at(sec).dirty = write;
+        id = m_lru_tail;
+        auto result = write_back(gsl::span<const uint32_t>(&id, 1));
+        if (!result) return kpp::make_unexpected(result.error());
 
-        assert(m_access_times.count(m_cache.at(sec).access_time));
-        m_access_times.erase(m_cache.at(sec).access_time);
-        m_cache.at(sec).access_time = ticks;
-        m_access_times.emplace(ticks, sec);
+        lru_unlink(id);
+        hash_remove(id);
     }
+
+    Block& block = m_blocks[id];
+    block.index = index;
+    block.valid = block.dirty = 0;
+    hash_insert(id);
+    lru_push_front(id);
+
+    return id;
 }
 
 [[nodiscard]]
-kpp::expected<kpp::dummy_t, DiskError> DiskCache::prune_cache()
+kpp::expected<kpp::dummy_t, DiskError> DiskCache::write_back(gsl::span<const uint32_t> ids)
 {
-    if (mem_usage_ratio() > m_size_ratio)
+    const uint64_t start = Timer::now_us();
+
+    MemBuffer run;
+    size_t run_start { 0 };
+    auto write_run = [&]() -> kpp::expected<kpp::dummy_t, DiskError>
     {
-        log_serial("Pruning cache\n");
+        if (run.empty()) return {};
+
+        auto result = m_disk.write_sector(run_start, run);
+        if (!result) return result;
+
+        m_written_sectors += run.size() / m_sector_size;
+        ++m_write_commands;
+        run.clear();
+        return {};
+    };
+
+    for (auto id : ids)
+    {
+        const Block& block = m_blocks[id];
+        for (size_t i { 0 }; i < m_block_sectors;)
+        {
+            if (!(block.dirty & (1u << i)))
+            {
+                ++i;
+                continue;
+            }
+
+            size_t len { 1 };
+            while (i + len < m_block_sectors && (block.dirty & (1u << (i + len)))) ++len;
+
+            // sectors following the current run, possibly from the previous block, join it
+            const size_t sector = block.index*m_block_sectors + i;
+            if (sector != run_start + run.size() / m_sector_size || run.size() >= max_write_size)
+            {
+                auto result = write_run();
+                if (!result) return result;
+            }
+            if (run.empty()) run_start = sector;
+
+            run.insert(run.end(), block.data.begin() + i*m_sector_size, block.data.begin() + (i + len)*m_sector_size);
+
+            i += len;
+        }
     }
 
-    while (!m_cache.empty() && mem_usage_ratio() > m_size_ratio)
+    auto result = write_run();
+    if (!result) return result;
+
+    for (auto id : ids)
     {
-        auto result = remove_entry(m_access_times.begin()->second);
-        if (!result) return kpp::make_unexpected(result.error());
+        if (m_blocks[id].dirty)
+        {
+            m_blocks[id].dirty = 0;
+            --m_dirty_blocks;
+        }
     }
+
+    m_writeback_us += Timer::now_us() - start;
+    return {};
 }
 
-[[nodiscard]]
-kpp::expected<kpp::dummy_t, DiskError> DiskCache::remove_entry(size_t id)
+uint32_t DiskCache::existing_sectors(size_t index) const
 {
-    if (m_cache.at(id).dirty)
+    const size_t first = index*m_block_sectors;
+    return sector_mask(0, std::min(m_block_sectors, m_disk_sectors - std::min(first, m_disk_sectors)));
+}
+
+void DiskCache::hash_insert(uint32_t id)
+{
+    auto& bucket = m_buckets[m_blocks[id].index & (m_buckets.size() - 1)];
+    m_blocks[id].hash_next = bucket;
+    bucket = id;
+}
+
+void DiskCache::hash_remove(uint32_t id)
+{
+    uint32_t* link = &m_buckets[m_blocks[id].index & (m_buckets.size() - 1)];
+    while (*link != id)
     {
-       auto result = m_disk.write_sector(id, m_cache.at(id).data);
-       if (!result) return kpp::make_unexpected(result.error());
+        assert(*link != npos);
+        link = &m_blocks[*link].hash_next;
     }
+    *link = m_blocks[id].hash_next;
+}
 
-    assert(m_access_times.erase(m_cache.at(id).access_time));
-    assert(m_cache.erase(id));
+void DiskCache::lru_unlink(uint32_t id)
+{
+    Block& block = m_blocks[id];
+    (block.lru_prev != npos ? m_blocks[block.lru_prev].lru_next : m_lru_head) = block.lru_next;
+    (block.lru_next != npos ? m_blocks[block.lru_next].lru_prev : m_lru_tail) = block.lru_prev;
+    block.lru_prev = block.lru_next = npos;
 }
 
-size_t DiskCache::mem_usage_ratio() const
+void DiskCache::lru_push_front(uint32_t id)
 {
-#if 0
-    const auto allocated_size = (m_cache.size()*(sizeof(CacheEntry)+sizeof(size_t) +
-                                                 m_access_times.size()*(sizeof(uint64_t)*sizeof(uint64_t))));
-    return allocated_size*100 / MemoryInfo::total();
-#else
-    return MemoryInfo::usage_ratio();
-#endif
+    Block& block = m_blocks[id];
+    block.lru_prev = npos;
+    block.lru_next = m_lru_head;
+    (m_lru_head != npos ? m_blocks[m_lru_head].lru_prev : m_lru_tail) = id;
+    m_lru_head = id;
 }
@@ -25,63 +25,124 @@ SOFTWARE.
 #ifndef DISKCACHE_HPP
 #define DISKCACHE_HPP
 
+#include <stdint.h>
+
 #include <vector.hpp>
-#include <unordered_map.hpp>
-#include <map.hpp>
 
 #include <expected.hpp>
 
 #include <utils/gsl/gsl_span.hpp>
 
 #include "utils/membuffer.hpp"
+#include "tasking/waitqueue.hpp"
 
 class Disk;
 struct DiskError;
 
+// Write-back cache of page-sized blocks of a disk, within a fixed memory budget.
+// Blocks are found through a hash index and evicted in LRU order, every operation is O(1) but flush()
 class DiskCache
 {
 public:
     DiskCache(Disk& disk);
 
+    // memory budget of each disk cache, block buffers are only allocated once used
     static inline size_t max_cache_size = 4096*1000;
+    static constexpr size_t block_size = 4096;
+    // adjacent dirty sectors are merged into writes of up to this size
+    static inline size_t max_write_size = 128*1024;
+    // misses of at least this size are read straight into the caller's buffer and aren't cached
+    static inline size_t direct_read_size = 128*1024;
+
+    struct Stats
+    {
+        size_t cached_blocks { 0 };
+        size_t dirty_blocks { 0 };
+        uint64_t oldest_dirty_us { 0 }; // age of the oldest dirty block
+        uint64_t written_sectors { 0 };
+        uint64_t write_commands { 0 };
+        uint64_t writeback_us { 0 }; // time spent writing back
+    };
 
 public:
+    // data must be made of whole sectors
     [[nodiscard]]
     kpp::expected<kpp::dummy_t, DiskError> write_sector(size_t sec, gsl::span<const uint8_t> data);
     [[nodiscard]]
     kpp::expected<MemBuffer, DiskError> read_sector(size_t sec, size_t count);
+    // reads bytes [offset, offset + dest.size()) of the disk
     [[nodiscard]]
-    kpp::expected<kpp::dummy_t, DiskError> flush();
-
+    kpp::expected<kpp::dummy_t, DiskError> read_into(size_t offset, gsl::span<uint8_t> dest);
+    // loads the sectors into the cache without copying them out, sectors past the disk end are ignored
     [[nodiscard]]
-    kpp::expected<kpp::dummy_t, DiskError> set_ratio(size_t ratio);
-    size_t ratio() const { return m_size_ratio; }
+    kpp::expected<kpp::dummy_t, DiskError> prefetch(size_t sec, size_t count);
+    // writes the dirty blocks back in disk order, they stay cached. With min_age_ms, only the runs of adjacent
+    // dirty blocks holding one dirtied at least min_age_ms ago are written
+    [[nodiscard]]
+    kpp::expected<kpp::dummy_t, DiskError> flush(uint32_t min_age_ms = 0);
+    // drops every block, dirty ones included : flush() first
+    void clear();
+
+    Stats stats() const;
 
 private:
+    static constexpr uint32_t npos = ~uint32_t(0);
+
+    struct Block
+    {
+        size_t index { 0 }; // block number on the disk
+        uint32_t valid { 0 }; // bitmask of the sectors holding disk data
+        uint32_t dirty { 0 }; // bitmask of the sectors to write back
+        uint64_t dirty_since { 0 }; // Timer::now_us() when the block became dirty
+        uint32_t hash_next { npos };
+        uint32_t lru_prev { npos };
+        uint32_t lru_next { npos };
+        MemBuffer data;
+    };
+
+    void init();
+    // reads the sectors through the cache and copies bytes [skip, skip + dest.size()) of them into dest,
+    // which may be empty to only load them
+    [[nodiscard]]
+    kpp::expected<kpp::dummy_t, DiskError> fill(size_t sec, size_t count, gsl::span<uint8_t> dest, size_t skip);
+    // reads the sectors [sec, end) into dest without caching them, cached sectors overriding the disk ones
     [[nodiscard]]
-    kpp::expected<kpp::dummy_t, DiskError> add_span(size_t sec, size_t count);
-    void add_to_cache(size_t sec, gsl::span<const uint8_t> data, bool write = false);
+    kpp::expected<kpp::dummy_t, DiskError> read_direct(size_t sec, size_t end, gsl::span<uint8_t> dest);
+    uint32_t find(size_t index) const;
+    // returns the cached block or a recycled one, evicting the least recently used when the budget is reached
     [[nodiscard]]
-    kpp::expected<kpp::dummy_t, DiskError> prune_cache();
+    kpp::expected<uint32_t, DiskError> get_block(size_t index);
+    // writes the dirty sectors of blocks, sorted by index, merging the adjacent ones
     [[nodiscard]]
-    kpp::expected<kpp::dummy_t, DiskError> remove_entry(size_t id);
+    kpp::expected<kpp::dummy_t, DiskError> write_back(gsl::span<const uint32_t> ids);
+    // mask of the block sectors which exist on the disk
+    uint32_t existing_sectors(size_t index) const;
 
-    size_t mem_usage_ratio() const;
+    void hash_insert(uint32_t id);
+    void hash_remove(uint32_t id);
+    void lru_unlink(uint32_t id);
+    void lru_push_front(uint32_t id);
 
-public:
+private:
     Disk& m_disk;
-
-public:
-    size_t m_size_ratio { 30 };
-
-    struct CacheEntry
-    {
-        MemBuffer data {};
-        bool dirty { false };
-        uint64_t access_time;
-    };
-    std::map<size_t, DiskCache::CacheEntry> m_cache;
-    std::map<uint64_t, size_t, std::greater<>> m_access_times;
+    // drivers give the kernel lock up while waiting for their device
+    mutable tasking::Mutex m_mutex;
+
+    size_t m_sector_size { 0 };
+    size_t m_block_sectors { 0 };
+    size_t m_disk_sectors { 0 };
+    size_t m_capacity { 0 };
+
+    MemBuffer m_scratch; // misses are read there before going to their blocks
+    std::vector<Block> m_blocks;
+    std::vector<uint32_t> m_buckets;
+    uint32_t m_lru_head { npos };
+    uint32_t m_lru_tail { npos };
+
+    size_t m_dirty_blocks { 0 };
+    uint64_t m_written_sectors { 0 };
+    uint64_t m_write_commands { 0 };
+    uint64_t m_writeback_us { 0 };
 };
 
 #endif // DISKCACHE_HPP
@@ -220,6 +220,7 @@ IDEDisk::IDEDisk(uint16_t port, uint8_t type)
 {
     m_port = port;
     m_type = type;
+    (void)enable_caching(true);
 }
 
 size_t IDEDisk::disk_size() const
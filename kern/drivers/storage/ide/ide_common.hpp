@@ -61,13 +61,16 @@ struct [[gnu::packed]] identify_data
     uint16_t unused5[5]; // 58
     uint16_t size_of_rw_mult; // 59
     uint32_t sectors_28; // 61
-    uint16_t unused6[38]; // 99
+    uint16_t unused6[13]; // 74
+    uint16_t queue_depth; // 75
+    uint16_t sata_capabilities; // 76
+    uint16_t unused7[23]; // 99
     uint64_t sectors_48; // 103
-    uint16_t unused7[2]; // 105
+    uint16_t unused8[2]; // 105
     uint16_t phys_log_size; // 106
-    uint16_t unused8[10]; // 116
+    uint16_t unused9[10]; // 116
     uint32_t sector_size; // 118
-    uint16_t unused9[137];
+    uint16_t unused10[137];
 };
 
 static_assert(sizeof(identify_data) == 512);
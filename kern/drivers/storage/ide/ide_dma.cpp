@@ -31,6 +31,7 @@ SOFTWARE.
 #include "utils/memutils.hpp"
 #include "time/timer.hpp"
 #include "i686/interrupts/interrupts.hpp"
+#include "tasking/waitqueue.hpp"
 
 #include "ide_common.hpp"
 
@@ -59,6 +60,10 @@ volatile bool raised_ints[2][2] { {false, false}, {false, false} };
 int drive_status[2][2];
 constexpr int status_ok = -1;
 
+// the PRDT is shared by every drive : one command at a time, the process waiting for its completion lets the others run
+tasking::Mutex command_lock;
+tasking::WaitQueue command_completion;
+
 bool Controller::accept(const pci::PciDevice &dev)
 {
     return dev.classCode == 0x1 && dev.subclass == 0x1;
@@ -100,6 +105,8 @@ bool Controller::common_handler(BusPort port)
 
         bit_clear(status, 0); bit_clear(status, 1); // clear error and interrupt bits
         send_status_byte(port, status);
+
+        command_completion.wake_all();
     }
 
     return true;
@@ -239,6 +246,8 @@ Disk::Disk(Controller& controller, BusPort port, DriveType type)
 [[nodiscard]]
 kpp::expected<MemBuffer, DiskError> Disk::read_sector(size_t sector, size_t count) const
 {
+    tasking::MutexLock lock(command_lock);
+
     volatile auto& int_status = raised_ints[m_port==BusPort::Primary][m_type==DriveType::Slave];
 
     int_status = false;
@@ -248,7 +257,7 @@ kpp::expected<MemBuffer, DiskError> Disk::read_sector(size_t sector, size_t coun
     MemBuffer data(sector_size()*count);
     m_cont.send_command((BusPort)m_port, (DriveType)m_type, ata_read_dma_ex, true, sector, count, data);
 
-    if (!Timer::sleep_until_int([&int_status]{return int_status;}, 2000))
+    if (!command_completion.wait([&int_status]{return int_status;}, 2000))
     {
         return kpp::make_unexpected(DiskError{DiskError::TimeOut});
     }
@@ -271,6 +280,8 @@ kpp::expected<kpp::dummy_t, DiskError> Disk::write_sector(size_t sector, gsl::sp
     assert(data.size() % sector_size() == 0);
     assert(sector <= m_id_data->sectors_48);
 
+    tasking::MutexLock lock(command_lock);
+
     volatile auto& int_status = raised_ints[m_port==BusPort::Primary][m_type==DriveType::Slave];
 
     int_status = false;
@@ -281,7 +292,7 @@ kpp::expected<kpp::dummy_t, DiskError> Disk::write_sector(size_t sector, gsl::sp
 
     m_cont.send_command((BusPort)m_port, (DriveType)m_type, ata_write_dma_ex, false, sector, count, data);
 
-    if (!Timer::sleep_until_int([&int_status]{return int_status;}, 2000))
+    if (!command_completion.wait([&int_status]{return int_status;}, 2000))
     {
         return kpp::make_unexpected(DiskError{DiskError::TimeOut});
     }
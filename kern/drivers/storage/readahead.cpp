@@ -0,0 +1,62 @@
+/*
+readahead.cpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "readahead.hpp"
+
+#include <algorithm.hpp>
+
+Readahead::Range Readahead::access(size_t offset, size_t size, size_t limit)
+{
+    const size_t end = offset + size;
+
+    // reading from the start is the usual beginning of a sequential stream
+    if (offset != m_next && offset != 0)
+    {
+        m_window = 0;
+        m_ahead_end = 0;
+        m_next = end;
+        return {};
+    }
+
+    if (offset == 0 && m_next != 0)
+    {
+        m_window = 0;
+        m_ahead_end = 0;
+    }
+
+    m_window = m_window ? std::min(m_window*2, max_window) : std::clamp(size*2, min_window, max_window);
+    m_next = end;
+
+    // prefetch again once less than half a window is left ahead of the reader
+    if (m_ahead_end >= std::min(end + m_window/2, limit))
+    {
+        return {};
+    }
+
+    const size_t start = std::max(m_ahead_end, offset);
+    m_ahead_end = std::max(std::min(end + m_window, limit), start);
+
+    return {start, m_ahead_end - start};
+}
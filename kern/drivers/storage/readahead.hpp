@@ -0,0 +1,55 @@
+/*
+readahead.hpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef READAHEAD_HPP
+#define READAHEAD_HPP
+
+#include <stddef.h>
+
+// Sequential access detection of a stream of reads, such as an open file.
+// While the stream is sequential the window doubles at each read, up to max_window, and the data is prefetched
+// into the disk cache one window ahead of the reader, in large commands instead of one per read.
+class Readahead
+{
+public:
+    static inline size_t min_window = 16*1024;
+    static inline size_t max_window = 512*1024;
+
+    struct Range
+    {
+        size_t offset { 0 };
+        size_t size { 0 };
+    };
+
+    // to be called before reading [offset, offset + size) of a stream of 'limit' bytes,
+    // returns the range to prefetch, which includes the read itself, or an empty one
+    Range access(size_t offset, size_t size, size_t limit);
+
+private:
+    size_t m_next { 0 }; // where a sequential read starts
+    size_t m_window { 0 }; // 0 while the stream isn't sequential
+    size_t m_ahead_end { 0 }; // end of what was already prefetched
+};
+
+#endif // READAHEAD_HPP
@@ -0,0 +1,89 @@
+/*
+writeback.cpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "writeback.hpp"
+
+#include "disk.hpp"
+
+#include "tasking/process.hpp"
+#include "tasking/waitqueue.hpp"
+#include "mem/meminfo.hpp"
+#include "kstring/kstring.hpp"
+#include "utils/logging.hpp"
+
+namespace writeback
+{
+
+namespace
+{
+tasking::WaitQueue flusher_wait;
+volatile bool kicked { false };
+
+[[noreturn]] void run()
+{
+    while (true)
+    {
+        const bool requested = flusher_wait.wait([]{ return kicked; }, flush_interval_ms);
+        kicked = false;
+
+        const bool everything = requested || MemoryInfo::usage_ratio() >= pressure_ratio;
+        const uint32_t min_age = everything ? 0 : dirty_expire_ms;
+
+        // partitions share the cache of their disk
+        for (Disk& disk : Disk::disks())
+        {
+            if (disk.is_partition() || !disk.caching_enabled()) continue;
+
+            auto result = disk.write_back(min_age);
+            if (!result)
+                err("Could not write back disk %s : %s\n", disk.drive_name().c_str(), result.error().to_string());
+        }
+    }
+}
+}
+
+void init()
+{
+    auto thread = Process::create_kernel_thread("kflushd", []{ run(); });
+    assert(thread);
+}
+
+void kick()
+{
+    kicked = true;
+    flusher_wait.wake_one();
+}
+
+void sync_all()
+{
+    for (Disk& disk : Disk::disks())
+    {
+        auto result = disk.flush_cache();
+        if (!result)
+            err("Could not flush disk %s : %s\n", disk.drive_name().c_str(), result.error().to_string());
+    }
+}
+
+}
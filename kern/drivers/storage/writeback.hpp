@@ -0,0 +1,51 @@
+/*
+writeback.hpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef WRITEBACK_HPP
+#define WRITEBACK_HPP
+
+#include <stdint.h>
+
+// Writes the dirty blocks of the disk caches back in the background, from the kflushd kernel thread
+namespace writeback
+{
+
+// the flusher wakes up every flush_interval_ms and writes back the blocks dirty for dirty_expire_ms
+inline uint32_t flush_interval_ms = 5000;
+inline uint32_t dirty_expire_ms = 30000;
+// past this memory usage, in percent, every dirty block is written back so that the caches can shrink
+inline uint32_t pressure_ratio = 90;
+
+// starts the flusher, needs the scheduler
+void init();
+
+// makes the flusher write every dirty block back now, can be called from anywhere
+void kick();
+
+// writes every dirty block back and flushes the hardware caches, returns once done
+void sync_all();
+
+}
+
+#endif // WRITEBACK_HPP
@@ -29,12 +29,14 @@ SOFTWARE.
 #include "fs/vfs.hpp"
 
 #include <deque.hpp>
+#include <map.hpp>
 
 #include "drivers/driver.hpp"
 #include "drivers/kbd/keyboard.hpp"
 #include "drivers/storage/disk.hpp"
 
 #include "tasking/process.hpp"
+#include "tasking/waitqueue.hpp"
 
 #include "utils/messagebus.hpp"
 #include "utils/nop.hpp"
@@ -82,6 +84,7 @@ public:
             if (Process::enabled())
             {
                 m_input_buffer.push_back(e.c);
+                m_readers.wake_all();
             }
         });
     }
@@ -91,7 +94,10 @@ protected:
     {
         MemBuffer buf;
 
-        while (m_input_buffer.size() < size) { wait_for_interrupts(); };
+        if (!m_readers.wait_killable([this, size]{ return m_input_buffer.size() >= size; }))
+        {
+            return kpp::make_unexpected(vfs::FSError{vfs::FSError::ReadError});
+        }
 
         for (size_t i { 0 }; i < size; ++i)
         {
@@ -107,6 +113,7 @@ protected:
 private:
     MessageBus::RAIIHandle m_handl;
     mutable std::deque<uint8_t> m_input_buffer;
+    mutable tasking::WaitQueue m_readers;
 };
 
 struct devfs_root : public vfs::node
@@ -179,7 +186,7 @@ size_t disk_file::size() const { return m_disk.disk_size(); }
 
 kpp::expected<MemBuffer, vfs::FSError> disk_file::read_impl(size_t offset, size_t size) const
 {
-    auto result = m_disk.read(offset, size);
+    auto result = m_disk.read(offset, size, m_readahead);
     if (!result)
     {
         return kpp::make_unexpected(vfs::FSError{vfs::FSError::ReadError, {result.error().type}});
@@ -187,6 +194,16 @@ kpp::expected<MemBuffer, vfs::FSError> disk_file::read_impl(size_t offset, size_
     return std::move(result.value());
 }
 
+kpp::expected<size_t, vfs::FSError> disk_file::read_into_impl(size_t offset, gsl::span<uint8_t> dest) const
+{
+    auto result = m_disk.read_into(offset, dest, m_readahead);
+    if (!result)
+    {
+        return kpp::make_unexpected(vfs::FSError{vfs::FSError::ReadError, {result.error().type}});
+    }
+    return dest.size();
+}
+
 kpp::expected<kpp::dummy_t, vfs::FSError> disk_file::write_impl(size_t offset, gsl::span<const uint8_t> data)
 {
     auto result = m_disk.write(offset, data);
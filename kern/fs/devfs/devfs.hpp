@@ -27,6 +27,8 @@ SOFTWARE.
 
 #include "fs/vfs.hpp"
 
+#include "drivers/storage/readahead.hpp"
+
 class Disk;
 class Driver;
 
@@ -51,10 +53,12 @@ struct disk_file : public vfs::node
 
 protected:
     [[nodiscard]] virtual kpp::expected<MemBuffer, vfs::FSError> read_impl(size_t offset, size_t size) const override;
+    [[nodiscard]] virtual kpp::expected<size_t, vfs::FSError> read_into_impl(size_t offset, gsl::span<uint8_t> dest) const override;
     [[nodiscard]] virtual kpp::expected<kpp::dummy_t, vfs::FSError> write_impl(size_t offset, gsl::span<const uint8_t> data) override;
 
 public:
     Disk& m_disk;
+    mutable Readahead m_readahead;
 };
 
 void init();
@@ -25,6 +25,8 @@ SOFTWARE.
 
 #include "ext2.hpp"
 
+#include <map.hpp>
+
 #include "utils/memutils.hpp"
 #include "time/time.hpp"
 #include "utils/bitops.hpp"
@@ -339,23 +341,133 @@ MemBuffer Ext2FS::read_indirected(size_t indirected_block, size_t blk_id, size_t
     }
 }
 
-MemBuffer Ext2FS::read_data(const ext2::Inode &inode, size_t offset, size_t size) const
+std::vector<uint32_t> Ext2FS::data_block_numbers(const ext2::Inode &inode, size_t offset, size_t size) const
 {
-    size_t blocks = data_blocks(inode);
+    const size_t entries_per_block = block_size()/sizeof(uint32_t);
+
+    // each indirection block is only read once for the whole range
+    std::map<uint32_t, MemBuffer> tables;
+    auto entry = [&](uint32_t table, size_t idx) -> uint32_t
+    {
+        if (!table) return 0;
 
-    assert(offset + size <= blocks);
+        auto it = tables.find(table);
+        if (it == tables.end()) it = tables.emplace(table, read_block(table)).first;
+        return ((const uint32_t*)it->second.data())[idx];
+    };
 
-    MemBuffer data;
-    data.reserve(blocks);
+    std::vector<uint32_t> blocks(size);
+    for (size_t i { 0 }; i < size; ++i)
+    {
+        size_t blk_id = offset + i;
+
+        if (blk_id < 12)
+        {
+            blocks[i] = inode.block_ptr[blk_id];
+            continue;
+        }
+        blk_id -= 12;
+
+        if (blk_id < entries_per_block)
+        {
+            blocks[i] = entry(inode.block_ptr[12], blk_id);
+            continue;
+        }
+        blk_id -= entries_per_block;
+
+        if (blk_id < entries_per_block*entries_per_block)
+        {
+            blocks[i] = entry(entry(inode.block_ptr[13], blk_id / entries_per_block), blk_id % entries_per_block);
+            continue;
+        }
+        blk_id -= entries_per_block*entries_per_block;
+
+        blocks[i] = entry(entry(entry(inode.block_ptr[14], blk_id / (entries_per_block*entries_per_block)),
+                                (blk_id / entries_per_block) % entries_per_block), blk_id % entries_per_block);
+    }
+
+    return blocks;
+}
+
+namespace
+{
+// calls f(index, count) for each run of blocks contiguous on the disk, holes are skipped
+template <typename Func>
+void for_each_extent(const std::vector<uint32_t>& blocks, Func&& f)
+{
+    for (size_t i { 0 }; i < blocks.size();)
+    {
+        size_t len { 1 };
+        if (blocks[i])
+        {
+            while (i + len < blocks.size() && blocks[i + len] == blocks[i] + len) ++len;
+            f(i, len);
+        }
+        i += len;
+    }
+}
+}
+
+MemBuffer Ext2FS::read_data(const ext2::Inode &inode, size_t offset, size_t size) const
+{
+    assert(offset + size <= data_blocks(inode));
+
+    MemBuffer data(size*block_size());
 
-    for (size_t i { offset }; i < offset + size; ++i)
+    auto result = read_data_into(inode, offset*block_size(), data);
+    if (!result)
     {
-        merge(data, read_data_block(inode, i));
+        error(kpp::string("Error reading data : ") + result.error().to_string() + "\n");
     }
 
     return data;
 }
 
+kpp::expected<kpp::dummy_t, DiskError> Ext2FS::read_data_into(const ext2::Inode &inode, size_t offset, gsl::span<uint8_t> dest) const
+{
+    const size_t first = offset / block_size();
+    const size_t end = (offset + dest.size() + block_size() - 1) / block_size();
+
+    assert(end <= data_blocks(inode));
+
+    const auto numbers = data_block_numbers(inode, first, end - first);
+
+    // holes read as zeroes
+    if (std::find(numbers.begin(), numbers.end(), 0) != numbers.end())
+    {
+        std::fill(dest.begin(), dest.end(), 0);
+    }
+
+    kpp::expected<kpp::dummy_t, DiskError> result;
+    for_each_extent(numbers, [&](size_t idx, size_t count)
+    {
+        if (!result) return;
+
+        // file bytes held by the extent, clipped to the request
+        const size_t extent_start = (first + idx)*block_size();
+        const size_t lo = std::max(extent_start, offset);
+        const size_t hi = std::min<size_t>(extent_start + count*block_size(), offset + dest.size());
+
+        // one disk request per extent instead of one per block, straight into the destination
+        result = m_disk.read_into(numbers[idx]*block_size() + (lo - extent_start), dest.subspan(lo - offset, hi - lo));
+    });
+
+    return result;
+}
+
+void Ext2FS::prefetch_data(const ext2::Inode &inode, size_t offset, size_t size) const
+{
+    const size_t blocks = data_blocks(inode);
+    if (offset >= blocks) return;
+    size = std::min(size, blocks - offset);
+
+    const auto numbers = data_block_numbers(inode, offset, size);
+    for_each_extent(numbers, [&](size_t idx, size_t count)
+    {
+        (void)m_disk.prefetch(numbers[idx] * block_size(), count * block_size());
+    });
+}
+
 std::vector<ext2::DirectoryEntry> Ext2FS::read_directory(gsl::span<const uint8_t> data) const
 {
     std::vector<ext2::DirectoryEntry> entries;
@@ -421,27 +533,43 @@ kpp::string Ext2FS::link_name(const ext2::Inode &inode_struct)
 
 kpp::expected<MemBuffer, vfs::FSError> ext2_node::read_impl(size_t offset, size_t size) const
 {
-    if (this->size() >= 65536)
-    {
-        fs.error("Files more than 64MiB long aren't supported\n");
-    }
+    MemBuffer data(size);
 
+    auto result = read_into_impl(offset, data);
+    if (!result) return kpp::make_unexpected(result.error());
+
+    return std::move(data);
+}
+
+kpp::expected<size_t, vfs::FSError> ext2_node::read_into_impl(size_t offset, gsl::span<uint8_t> dest) const
+{
     if (is_link())
     {
         auto ptr = link_target();
-        if (ptr) return ptr->read(offset, size);
+        if (ptr) return ptr->read_into(offset, dest);
         else return kpp::make_unexpected(vfs::FSError{vfs::FSError::InvalidLink});
     }
 
-    size_t block_off = offset/fs.block_size();
-    size_t block_size = size/fs.block_size() + (size%fs.block_size()?1:0);
+    const size_t block_size = fs.block_size();
 
-    size_t byte_off = offset % fs.block_size();
+    const auto inode_struct = fs.read_inode(inode);
 
-    auto data = fs.read_data(fs.read_inode(inode), block_off, block_size);
+    // the readahead window is in file bytes, it's loaded through the disk extents of the file
+    const auto ahead = m_readahead.access(offset, dest.size(), this->size());
+    if (ahead.size)
+    {
+        const size_t ahead_first = ahead.offset/block_size;
+        const size_t ahead_end = (ahead.offset + ahead.size)/block_size + ((ahead.offset + ahead.size)%block_size?1:0);
+        fs.prefetch_data(inode_struct, ahead_first, ahead_end - ahead_first);
+    }
+
+    auto result = fs.read_data_into(inode_struct, offset, dest);
+    if (!result)
+    {
+        return kpp::make_unexpected(vfs::FSError{vfs::FSError::ReadError, {result.error().type}});
+    }
 
-    if (byte_off == 0) { data.resize(size); return std::move(data); }
-    else { return MemBuffer(data.begin() + byte_off, data.begin() + offset + size); }
+    return dest.size();
 }
 
 std::vector<std::shared_ptr<vfs::node>> ext2_node::readdir_impl()
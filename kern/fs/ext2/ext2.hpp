@@ -26,6 +26,7 @@ SOFTWARE.
 #define EXT2_HPP
 
 #include "fs/fs.hpp"
+#include "drivers/storage/readahead.hpp"
 
 #include <optional.hpp>
 
@@ -69,7 +70,14 @@ public:
     size_t get_data_block_indirected(size_t indirected_block, size_t blk_id, size_t depth) const;
     size_t count_used_blocks(const ext2::Inode& inode) const;
 
+    // physical numbers of the data blocks [offset, offset + size), 0 for holes
+    std::vector<uint32_t> data_block_numbers(const ext2::Inode& inode, size_t offset, size_t size) const;
     MemBuffer read_data(const ext2::Inode& inode, size_t offset, size_t size) const;
+    // reads file bytes [offset, offset + dest.size()) into dest
+    [[nodiscard]]
+    kpp::expected<kpp::dummy_t, DiskError> read_data_into(const ext2::Inode& inode, size_t offset, gsl::span<uint8_t> dest) const;
+    // loads data blocks into the disk cache ahead of their use
+    void prefetch_data(const ext2::Inode& inode, size_t offset, size_t size) const;
     MemBuffer read_data_block(const ext2::Inode& inode, size_t blk_id) const;
     MemBuffer read_indirected(size_t indirected_block, size_t blk_id, size_t depth) const;
 
@@ -135,6 +143,7 @@ public:
     virtual void set_stat(const Stat& stat) override;
 
     [[nodiscard]] virtual kpp::expected<MemBuffer, vfs::FSError> read_impl(size_t offset, size_t size) const override;
+    [[nodiscard]] virtual kpp::expected<size_t, vfs::FSError> read_into_impl(size_t offset, gsl::span<uint8_t> dest) const override;
     [[nodiscard]] virtual kpp::expected<kpp::dummy_t, vfs::FSError> write_impl(size_t offset, gsl::span<const uint8_t> data) override;
     virtual std::vector<std::shared_ptr<node>> readdir_impl() override;
     [[nodiscard]] virtual node::result<std::shared_ptr<node>> create_impl(const kpp::string&, Type type) override;
@@ -158,6 +167,8 @@ private:
     std::shared_ptr<ext2_node> create_child(const kpp::string& name, Type type);
     kpp::string link_name() const;
     std::shared_ptr<vfs::node> link_target() const;
+
+    mutable Readahead m_readahead;
 };
 
 #endif // EXT2_HPP
@@ -27,6 +27,7 @@ SOFTWARE.
 
 #include "tasking/process.hpp"
 #include "tasking/process_data.hpp"
+#include "tasking/scheduler.hpp"
 #include "fs/utils/string_node.hpp"
 
 namespace procfs
@@ -50,6 +51,19 @@ std::vector<std::shared_ptr<vfs::node> > pid_node::readdir_impl()
         }
         return str;
     }));
+    children.emplace_back(std::make_shared<string_node>("nice", [this]{
+        return kpp::to_string(Process::by_pid(m_pid)->data->sched.nice) + "\n";
+    }));
+    // in milliseconds
+    children.emplace_back(std::make_shared<string_node>("timeslice", [this]{
+        return kpp::to_string(tasking::timeslice(Process::by_pid(m_pid)->data->sched.nice)) + "\n";
+    }));
+    // user and system time, in milliseconds
+    children.emplace_back(std::make_shared<string_node>("cputime", [this]{
+        const auto& sched = Process::by_pid(m_pid)->data->sched;
+        return kpp::to_string((unsigned long)tasking::ticks_to_ms(sched.user_ticks)) + " " +
+               kpp::to_string((unsigned long)tasking::ticks_to_ms(sched.system_ticks)) + "\n";
+    }));
 
     return children;
 }
@@ -36,6 +36,7 @@ SOFTWARE.
 #include "pid_node.hpp"
 #include "fs/utils/string_node.hpp"
 #include "time/time.hpp"
+#include "mem/slab.hpp"
 
 #include "info/cmdline.hpp"
 #include "info/version.hpp"
@@ -90,6 +91,7 @@ public:
         children.emplace_back(std::make_shared<string_node>("cmdline", kernel_cmdline));
         children.emplace_back(std::make_shared<string_node>("uptime",  []{ return kpp::to_string(Time::uptime()); }));
         children.emplace_back(std::make_shared<string_node>("version", get_version_str()));
+        children.emplace_back(std::make_shared<string_node>("slabinfo", []{ return SlabCache::info(); }));
         if (Process::enabled()) children.emplace_back(std::make_shared<vfs::symlink>(kpp::to_string(Process::current().pid), "self"));
 
         children.emplace_back(std::make_shared<interface_test>("interface_test"));
@@ -108,6 +108,30 @@ node::result<MemBuffer> node::read(size_t offset, size_t size) const
     return result;
 }
 
+node::result<size_t> node::read_into(size_t offset, gsl::span<uint8_t> dest) const
+{
+    assert(type() != Directory);
+    if (this->size()) assert(offset + dest.size() <= this->size());
+
+    auto result = read_into_impl(offset, dest);
+
+    update_access_time();
+
+    return result;
+}
+
+node::result<size_t> node::read_into_impl(size_t offset, gsl::span<uint8_t> dest) const
+{
+    auto result = read_impl(offset, dest.size());
+    if (!result) return kpp::make_unexpected(result.error());
+
+    const size_t size = std::min<size_t>(result.value().size(), dest.size());
+    std::copy(result.value().begin(), result.value().begin() + size, dest.begin());
+    Disk::copied_bytes += size;
+
+    return size;
+}
+
 node::result<kpp::dummy_t> node::write(size_t offset, gsl::span<const uint8_t> data)
 {
     assert(type() != Directory);
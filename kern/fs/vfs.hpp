@@ -142,6 +142,8 @@ struct node
 
     [[nodiscard]] result<MemBuffer> read(size_t offset, size_t size) const;
     [[nodiscard]] result<MemBuffer> read() const { return read(0, size()); }
+    // reads into a caller provided buffer, returns the amount of bytes read
+    [[nodiscard]] result<size_t> read_into(size_t offset, gsl::span<uint8_t> dest) const;
     [[nodiscard]] result<kpp::dummy_t> write(size_t offset, gsl::span<const uint8_t> data);
     [[nodiscard]] result<std::shared_ptr<node>> create(const kpp::string&, Type);
     result<kpp::dummy_t> resize(size_t);
@@ -163,6 +165,8 @@ struct node
 
 protected:
     [[nodiscard]] virtual result<MemBuffer> read_impl(size_t, size_t) const { return {}; }
+    // copies what read_impl returns, nodes which can read in place override it
+    [[nodiscard]] virtual result<size_t> read_into_impl(size_t offset, gsl::span<uint8_t> dest) const;
     [[nodiscard]] virtual result<kpp::dummy_t> write_impl(size_t, gsl::span<const uint8_t>)
     { return kpp::make_unexpected(FSError{FSError::Unknown}); }
     [[nodiscard]] virtual result<kpp::dummy_t>  resize_impl(size_t)
@@ -234,6 +238,8 @@ private:
 protected:
     [[nodiscard]] virtual kpp::expected<MemBuffer, FSError> read_impl(size_t offset, size_t size) const override
     { return actual_target()->read(offset, size); }
+    [[nodiscard]] virtual node::result<size_t> read_into_impl(size_t offset, gsl::span<uint8_t> dest) const override
+    { return actual_target()->read_into(offset, dest); }
     [[nodiscard]] virtual kpp::expected<kpp::dummy_t, FSError> write_impl(size_t offset, gsl::span<const uint8_t> data) override
     { return actual_target()->write(offset, data); }
     virtual std::vector<std::shared_ptr<node>> readdir_impl() override { return actual_target()->readdir_impl(); }
@@ -36,6 +36,7 @@ SOFTWARE.
 #include "drivers/kbd/led_handler.hpp"
 #include "drivers/mouse/mouse.hpp"
 #include "drivers/sound/beep.hpp"
+#include "drivers/storage/writeback.hpp"
 
 #include "power/powermanagement.hpp"
 
@@ -106,7 +107,6 @@ SOFTWARE.
 // : passer le shell et un max de trucs en userspace
 // : DWARF ?
 // : SVGA-II
-// : faire une boucle de traitement de callbacks d'interruption
 // : implémenter /dev/input
 // : implémenter expanding stack
 
@@ -243,6 +243,7 @@ void global_init()
     init_syscalls();
 
     tasking::scheduler_init();
+    writeback::init();
 
     sh.command("run /initrd/init.sh");
 
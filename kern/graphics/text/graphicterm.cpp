@@ -32,6 +32,7 @@ SOFTWARE.
 #include "utils/mathutils.hpp"
 
 #include "time/timer.hpp"
+#include "tasking/workqueue.hpp"
 #include "graphics/fonts/psf.hpp"
 #include "utils/env.hpp"
 
@@ -45,12 +46,16 @@ GraphicTerm::GraphicTerm(Screen &scr, TerminalData &data, const Font &font)
 
     m_callback = Timer::register_callback(600, [this]
     {
-        if (enabled())
+        // redrawing is too slow for the timer interrupt
+        tasking::defer([this]
         {
-            m_show_cursor = !m_show_cursor;
-            redraw_cursor();
-            draw_impl();
-        }
+            if (enabled())
+            {
+                m_show_cursor = !m_show_cursor;
+                redraw_cursor();
+                draw_impl();
+            }
+        });
     }, false);
 
     Bitmap black(m_scr.width(), m_scr.height(), color_black);
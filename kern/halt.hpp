@@ -39,10 +39,11 @@ inline void halt()
     unreachable();
 }
 
+// the interrupt handlers might change anything : memory is read again afterwards
 inline void wait_for_interrupts()
 {
 #ifdef ARCH_i686
-    __asm__ __volatile__ ("hlt");
+    __asm__ __volatile__ ("hlt" ::: "memory");
 #endif
 }
 
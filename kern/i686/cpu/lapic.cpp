@@ -0,0 +1,235 @@
+/*
+lapic.cpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "lapic.hpp"
+
+#include <assert.h>
+
+#include <algorithm.hpp>
+
+#include "cpuid.hpp"
+#include "msr.hpp"
+
+#include "i686/interrupts/isr.hpp"
+#include "i686/smp/smp.hpp"
+#include "mem/memmap.hpp"
+#include "time/timer.hpp"
+#include "utils/bitops.hpp"
+#include "utils/logging.hpp"
+#include "halt.hpp"
+
+namespace lapic
+{
+
+namespace
+{
+
+constexpr uint32_t apic_base_msr { 0x1B };
+
+enum Register : uint32_t
+{
+    ID               = 0x020,
+    TaskPriority     = 0x080,
+    EOI              = 0x0B0,
+    SpuriousVector   = 0x0F0,
+    ICRLow           = 0x300,
+    ICRHigh          = 0x310,
+    LVTTimer         = 0x320,
+    TimerInitCount   = 0x380,
+    TimerCurrentCount= 0x390,
+    TimerDivide      = 0x3E0
+};
+
+constexpr uint32_t icr_init       { 0x00004500 }; // INIT, level assert
+constexpr uint32_t icr_startup    { 0x00004600 }; // STARTUP, level assert
+constexpr uint32_t icr_pending    { 1 << 12 };
+constexpr uint32_t timer_periodic { 1 << 17 };
+constexpr uint32_t timer_masked   { 1 << 16 };
+constexpr uint32_t timer_divide_16{ 0x3 };
+
+volatile uint32_t* registers { nullptr };
+uint32_t ticks_per_second { 0 }; // of the timer, after the divider
+
+uint32_t read(Register reg)
+{
+    return registers[reg / sizeof(uint32_t)];
+}
+
+void write(Register reg, uint32_t value)
+{
+    registers[reg / sizeof(uint32_t)] = value;
+}
+
+void enable()
+{
+    write(TaskPriority, 0); // accept every interrupt
+    write(SpuriousVector, 0x100 | spurious_vector);
+}
+
+// the high resolution callbacks are all run by the bootstrap processor
+void set_hr_oneshot(uint32_t microseconds)
+{
+    if (smp::cpu_index() == 0)
+    {
+        start_oneshot(microseconds, hrtimer_vector);
+        return;
+    }
+
+    smp::call_on_others(1u << 0, [](void* arg)
+    {
+        start_oneshot(*static_cast<uint32_t*>(arg), hrtimer_vector);
+    }, &microseconds);
+}
+
+void send_command(uint8_t apic_id, uint32_t command)
+{
+    while (read(ICRLow) & icr_pending) {}
+
+    write(ICRHigh, uint32_t(apic_id) << 24);
+    write(ICRLow, command);
+
+    while (read(ICRLow) & icr_pending) {}
+}
+
+}
+
+bool available()
+{
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, eax, ebx, ecx, edx);
+
+    return bit_check(edx, 9) && has_msrs();
+}
+
+void init()
+{
+    if (!available()) return;
+
+    uint64_t base = read_msr(apic_base_msr);
+    write_msr(apic_base_msr, base | (1 << 11)); // global enable
+
+    registers = reinterpret_cast<volatile uint32_t*>(Memory::mmap(base & 0xFFFFF000, Memory::page_size(),
+                                                                  Memory::Read|Memory::Write|Memory::Uncached));
+
+    enable();
+
+    log(Info, "Local APIC enabled, ID : %d\n", id());
+
+    calibrate_timer();
+
+    // the bootstrap processor's timer isn't used for scheduling, it drives the high resolution callbacks
+    isr::register_handler(hrtimer_vector, [](const ::registers* const)
+    {
+        Timer::hr_interrupt();
+        return true;
+    });
+    Timer::m_set_hr_oneshot_callback = &set_hr_oneshot;
+}
+
+void init_ap()
+{
+    write_msr(apic_base_msr, read_msr(apic_base_msr) | (1 << 11));
+
+    enable();
+}
+
+bool enabled()
+{
+    return registers != nullptr;
+}
+
+uint8_t id()
+{
+    return registers ? read(ID) >> 24 : 0;
+}
+
+void send_eoi()
+{
+    write(EOI, 0);
+}
+
+void send_ipi(uint8_t apic_id, uint8_t vector)
+{
+    send_command(apic_id, vector);
+}
+
+void send_init(uint8_t apic_id)
+{
+    send_command(apic_id, icr_init);
+}
+
+void send_startup(uint8_t apic_id, uint8_t page)
+{
+    send_command(apic_id, icr_startup | page);
+}
+
+void calibrate_timer()
+{
+    constexpr uint32_t sample_ticks { 10 };
+
+    write(TimerDivide, timer_divide_16);
+    write(LVTTimer, timer_masked);
+
+    // start on a PIT tick boundary
+    uint32_t start = Timer::ticks();
+    while (Timer::ticks() == start) { wait_for_interrupts(); }
+
+    write(TimerInitCount, 0xFFFFFFFF);
+    start = Timer::ticks();
+    while (Timer::ticks() - start < sample_ticks) { wait_for_interrupts(); }
+    const uint32_t elapsed = 0xFFFFFFFF - read(TimerCurrentCount);
+    write(TimerInitCount, 0);
+
+    ticks_per_second = elapsed / sample_ticks * Timer::freq();
+
+    log(Info, "Local APIC timer : %d Hz\n", ticks_per_second);
+}
+
+void start_timer(uint32_t freq)
+{
+    assert(ticks_per_second && freq);
+
+    write(TimerDivide, timer_divide_16);
+    write(LVTTimer, timer_periodic | timer_vector);
+    write(TimerInitCount, ticks_per_second / freq);
+}
+
+void stop_timer()
+{
+    write(TimerInitCount, 0);
+}
+
+void start_oneshot(uint32_t microseconds, uint8_t vector)
+{
+    assert(ticks_per_second);
+
+    const uint64_t count = uint64_t(ticks_per_second) * microseconds / 1000000;
+
+    write(TimerDivide, timer_divide_16);
+    write(LVTTimer, vector);
+    write(TimerInitCount, std::clamp<uint64_t>(count, 1, 0xFFFFFFFF));
+}
+
+}
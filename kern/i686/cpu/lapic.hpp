@@ -0,0 +1,65 @@
+/*
+lapic.hpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef LAPIC_HPP
+#define LAPIC_HPP
+
+#include <stdint.h>
+
+// local APIC of each CPU : inter-processor interrupts and per-CPU timer
+namespace lapic
+{
+
+constexpr uint8_t timer_vector    { 0xF0 };
+constexpr uint8_t hrtimer_vector  { 0xF5 }; // one-shot timer of the bootstrap processor, see Timer::hr_interrupt
+constexpr uint8_t spurious_vector { 0xFF };
+
+bool available();
+
+// maps the registers, enables the local APIC of the bootstrap processor and calibrates its timer
+void init();
+// enables the local APIC of the calling application processor
+void init_ap();
+
+bool enabled();
+
+uint8_t id();
+
+void send_eoi();
+
+void send_ipi(uint8_t apic_id, uint8_t vector);
+void send_init(uint8_t apic_id);
+void send_startup(uint8_t apic_id, uint8_t page);
+
+// measures the timer frequency against the PIT, interrupts must be enabled
+void calibrate_timer();
+// periodic interrupts on timer_vector
+void start_timer(uint32_t freq);
+void stop_timer();
+// a single interrupt on vector after 'microseconds'
+void start_oneshot(uint32_t microseconds, uint8_t vector);
+
+}
+
+#endif // LAPIC_HPP
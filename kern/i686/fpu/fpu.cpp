@@ -35,6 +35,18 @@ SOFTWARE.
 #include "utils/logging.hpp"
 #include "utils/align.hpp"
 
+#include "i686/interrupts/isr.hpp"
+
+static constexpr uint16_t default_fcw { 0x037F }; // all exceptions masked, 64-bit precision
+static constexpr uint32_t default_mxcsr { 0x1F80 }; // all exceptions masked
+
+FPUState::FPUState()
+{
+    memset(data, 0, sizeof(data));
+    memcpy(data + 0, &default_fcw, sizeof(default_fcw));
+    memcpy(data + 24, &default_mxcsr, sizeof(default_mxcsr));
+}
+
 void FPU::init()
 {
     if (!check_cpuid() && !check_fpu_presence())
@@ -44,28 +56,97 @@ void FPU::init()
     }
 
     setup_fpu();
+
+    isr::register_handler(isr::DeviceNotAvailable, device_not_available_handler);
+}
+
+void FPU::init_ap()
+{
+    if (!check_cpuid() && !check_fpu_presence()) return;
+
+    setup_fpu();
+}
+
+void FPU::switch_to(FPUState *state)
+{
+    m_current = state;
+    set_task_switched(m_owner.get() != m_current.get());
+}
+
+void FPU::save(FPUState &state)
+{
+    if (m_owner != &state) return;
+
+    assert(((uintptr_t)state.data & 0xF) == 0);
+
+    // fxsave traps too when CR0.TS is set
+    const bool task_switched = m_task_switched;
+    set_task_switched(false);
+    asm volatile ("fxsave %0":"=m"(state.data)::"memory");
+    set_task_switched(task_switched);
 }
 
-alignas(16) uint8_t data[512];
+void FPU::unload(FPUState &state)
+{
+    save(state);
+    release(state);
+}
+
+void FPU::release(FPUState &state)
+{
+    if (m_owner == &state) m_owner = nullptr;
+    if (m_current == &state) m_current = nullptr;
+    set_task_switched(m_owner.get() != m_current.get());
+}
 
-FPUState FPU::save()
+bool FPU::device_not_available_handler(registers * const)
 {
-    assert(((uintptr_t)data & 0xF) == 0);
+    assert(m_owner.get() != m_current.get());
 
-    asm volatile ("fxsave %0"::"m"(data):"memory");
+    set_task_switched(false);
 
-    FPUState state;
-    memcpy(state.data, data, 512);
+    FPUState* owner = m_owner;
+    FPUState* current = m_current;
 
-    return state;
+    if (owner)
+    {
+        assert(((uintptr_t)owner->data & 0xF) == 0);
+        asm volatile ("fxsave %0":"=m"(owner->data)::"memory");
+    }
+
+    if (current)
+    {
+        assert(((uintptr_t)current->data & 0xF) == 0);
+        asm volatile ("fxrstor %0"::"m"(current->data):"memory");
+    }
+    else
+    {
+        // the kernel starts from a clean state, it doesn't keep anything in the FPU across context switches
+        asm volatile ("fninit\n"
+                      "ldmxcsr %0"::"m"(default_mxcsr):"memory");
+    }
+
+    m_owner = current;
+
+    return true;
 }
 
-void FPU::load(const FPUState &state)
+void FPU::set_task_switched(bool value)
 {
-    assert(((uintptr_t)data & 0xF) == 0);
-    memcpy(data, state.data, 512);
+    if (value == m_task_switched) return;
+
+    if (value)
+    {
+        asm volatile ("mov %%cr0, %%eax\n"
+                      "or $0x8, %%eax\n"
+                      "mov %%eax, %%cr0":::"eax", "memory");
+    }
+    else
+    {
+        asm volatile ("clts":::"memory");
+    }
 
-    asm volatile ("fxrstor %0"::"m"(data):"memory");
+    m_task_switched = value;
 }
 
 bool FPU::check_cpuid()
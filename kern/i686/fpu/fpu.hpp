@@ -27,24 +27,51 @@ SOFTWARE.
 
 #include <stdint.h>
 
+#include "i686/cpu/registers.hpp"
+#include "i686/smp/percpu.hpp"
+
 extern "C" bool check_fpu_presence();
 extern "C" void setup_fpu();
 
-struct FPUState
+// fxsave area, holds the default state of a fresh context
+struct alignas(16) FPUState
 {
+    FPUState();
+
     uint8_t data[512];
 };
 
+// The FPU is switched lazily : CR0.TS is set whenever the registers don't hold the state of the running context,
+// so the first FPU/SSE instruction traps (#NM) and only then the previous owner's state is saved and the new one loaded.
+// Each CPU has its own registers : a context leaving a CPU is unloaded, so that it can be resumed on another one.
 class FPU
 {
 public:
     static void init();
+    static void init_ap();
 
-    static FPUState save();
-    static void load(const FPUState& state);
+    // state of the context which is about to run, nullptr for the kernel
+    static void switch_to(FPUState* state);
+    static FPUState* current()
+    {
+        return m_current;
+    }
+    // writes the registers back to state if they hold it
+    static void save(FPUState& state);
+    // saves state and lets go of it, as it might run on another CPU next
+    static void unload(FPUState& state);
+    // state is about to be destroyed
+    static void release(FPUState& state);
 
 private:
     static bool check_cpuid();
+    static bool device_not_available_handler(registers* const regs);
+    static void set_task_switched(bool value);
+
+private:
+    static inline smp::PerCPU<FPUState*> m_owner { nullptr }; // context held by the registers, nullptr if none or the kernel
+    static inline smp::PerCPU<FPUState*> m_current { nullptr };
+    static inline smp::PerCPU<bool> m_task_switched { false };
 };
 
 #endif // FPU_HPP
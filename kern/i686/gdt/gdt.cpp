@@ -37,21 +37,37 @@ SOFTWARE.
 namespace gdt
 {
 
-entry entries[9];
+entry entries[tss_selector + tss_count];
 ptr gdt_ptr;
 
 extern "C" int kernel_stack_top;
 
-void load_tss(uint16_t selector)
+void load_tss(size_t cpu)
 {
-    const uint16_t offset = selector * sizeof(entry);
+    const uint16_t offset = (tss_selector + cpu) * sizeof(entry);
     asm volatile("movw %0, %%ax\n"
                  "ltr %%ax"::"a"(offset));
 }
 
+void init_tss(size_t cpu, uintptr_t kernel_stack)
+{
+    auto& cpu_tss = tss[cpu];
+
+    set_gate(tss_selector + cpu, reinterpret_cast<uint32_t>(&cpu_tss), sizeof(cpu_tss), 0x89, 0x40);
+    cpu_tss.trap = 0x00;
+    cpu_tss.iomap = 0x00;
+    cpu_tss.esp0 = kernel_stack;
+    cpu_tss.ss0 = kernel_data_selector * sizeof(entry);
+}
+
+void set_kernel_stack(size_t cpu, uintptr_t kernel_stack)
+{
+    tss[cpu].esp0 = kernel_stack;
+}
+
 void set_gate(size_t num, uint32_t base, uint32_t limit, uint8_t access, uint8_t gran)
 {
-    if (num >= 9)
+    if (num >= std::extent_v<decltype(entries)>)
     {
         panic("Invalid GDT entry : num is larger than entries");
     }
@@ -79,15 +95,11 @@ void init()
     set_gate(kernel_data_selector, 0, 0xFFFFFFFF, 0x92, 0xC0); // Data segment
     set_gate(user_code_selector, 0, 0xFFFFFFFF, 0xFA, 0xC0); // User mode code segment
     set_gate(user_data_selector, 0, 0xFFFFFFFF, 0xF2, 0xC0); // User mode data segment
-    set_gate(tss_selector, reinterpret_cast<uint32_t>(&tss), sizeof(tss), 0x89, 0x40);
-    tss.trap = 0x00;
-    tss.iomap = 0x00;
-    tss.esp0 = (uint32_t)&kernel_stack_top;
-    tss.ss0 = kernel_data_selector * sizeof(entry);
+    init_tss(0, reinterpret_cast<uintptr_t>(&kernel_stack_top));
 
     flush();
 
-    load_tss(tss_selector);
+    load_tss(0);
 }
 
 void flush()
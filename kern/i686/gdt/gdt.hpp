@@ -26,6 +26,7 @@ SOFTWARE.
 #define GDT_HPP
 
 #include <stdint.h>
+#include <stddef.h>
 
 extern "C"
 void gdt_flush(uint32_t addr);
@@ -55,15 +56,32 @@ void init();
 
 void flush();
 
-extern entry entries[9];
-extern ptr gdt_ptr;
+// sets up the TSS of a CPU, kernel_stack is the stack used on interrupts from user mode
+void init_tss(size_t cpu, uintptr_t kernel_stack);
+// each process has its own kernel stack
+void set_kernel_stack(size_t cpu, uintptr_t kernel_stack);
+void load_tss(size_t cpu);
+
+static constexpr size_t tss_count { 16 }; // one per CPU
 
 static constexpr uint16_t null_selector { 0 };
 static constexpr uint16_t kernel_code_selector { 1 };
 static constexpr uint16_t kernel_data_selector { 2 };
 static constexpr uint16_t user_code_selector { 3 };
 static constexpr uint16_t user_data_selector { 4 };
-static constexpr uint16_t tss_selector { 5 };
+static constexpr uint16_t tss_selector { 5 }; // first TSS, the other CPUs' follow
+
+extern entry entries[tss_selector + tss_count];
+extern ptr gdt_ptr;
+
+// index of the TSS loaded by this CPU, 0 until it loads one
+inline size_t current_tss()
+{
+    uint16_t selector;
+    asm ("str %0":"=r"(selector));
+
+    return selector >= tss_selector*sizeof(entry) ? selector/sizeof(entry) - tss_selector : 0;
+}
 
 }
 
@@ -95,6 +95,17 @@ IRQ  12,    44
 IRQ  13,    45
 IRQ  14,    46
 IRQ  15,    47
+; local APIC timer and inter-processor interrupts
+IRQ  16,  0xF0
+IRQ  17,  0xF1
+IRQ  18,  0xF2
+IRQ  19,  0xF3
+IRQ  20,  0xF4
+IRQ  21,  0xF5
+
+global irq_spurious
+irq_spurious: ; spurious local APIC interrupts must not be acknowledged
+    iret
 
 ISR_SYSCALL ludos, 0x70 ; ludos_syscall
 ISR_SYSCALL linux, 0x80 ; linux_syscall
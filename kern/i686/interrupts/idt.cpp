@@ -33,6 +33,8 @@ SOFTWARE.
 #include "interrupts.hpp"
 
 #include "syscalls/syscalls.hpp"
+#include "i686/cpu/lapic.hpp"
+#include "i686/smp/smp.hpp"
 
 namespace idt
 {
@@ -110,6 +112,13 @@ void init()
     set_gate(45, reinterpret_cast<uint32_t>(irq13), 0x08, 0x8E);
     set_gate(46, reinterpret_cast<uint32_t>(irq14), 0x08, 0x8E);
     set_gate(47, reinterpret_cast<uint32_t>(irq15), 0x08, 0x8E);
+    set_gate(lapic::timer_vector, reinterpret_cast<uint32_t>(irq16), 0x08, 0x8E);
+    set_gate(smp::reschedule_vector, reinterpret_cast<uint32_t>(irq17), 0x08, 0x8E);
+    set_gate(smp::preempt_vector, reinterpret_cast<uint32_t>(irq18), 0x08, 0x8E);
+    set_gate(smp::call_vector, reinterpret_cast<uint32_t>(irq19), 0x08, 0x8E);
+    set_gate(smp::irq_vector, reinterpret_cast<uint32_t>(irq20), 0x08, 0x8E);
+    set_gate(lapic::hrtimer_vector, reinterpret_cast<uint32_t>(irq21), 0x08, 0x8E);
+    set_gate(lapic::spurious_vector, reinterpret_cast<uint32_t>(irq_spurious), 0x08, 0x8E);
 
     set_gate(ludos_syscall_int, (uint32_t)(syscall_ludos), 0x08, 0xEE);
     set_gate(linux_syscall_int, (uint32_t)(syscall_linux), 0x08, 0xEE);
@@ -119,4 +128,9 @@ void init()
     sti();
 }
 
+void load()
+{
+    idt_flush(reinterpret_cast<uint32_t>(&idt_ptr));
+}
+
 }
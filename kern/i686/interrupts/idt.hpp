@@ -51,6 +51,8 @@ extern entry idt_entries[256];
 extern ptr idt_ptr;
 
 void init();
+// loads the IDT on an application processor
+void load();
 void set_gate(uint8_t num, uint32_t base, uint16_t sel, uint8_t flags);
 
 }
@@ -105,6 +107,13 @@ extern void irq12();
 extern void irq13();
 extern void irq14();
 extern void irq15();
+extern void irq16();
+extern void irq17();
+extern void irq18();
+extern void irq19();
+extern void irq20();
+extern void irq21();
+extern void irq_spurious();
 
 extern void syscall_ludos();
 extern void syscall_linux();
@@ -46,6 +46,27 @@ inline bool interrupts_enabled()
     return flags & (1 << 9);
 }
 
+// disables interrupts for its lifetime, then restores their previous state
+class InterruptLock
+{
+public:
+    InterruptLock()
+        : m_enabled(interrupts_enabled())
+    {
+        cli();
+    }
+    ~InterruptLock()
+    {
+        if (m_enabled) sti();
+    }
+
+    InterruptLock(const InterruptLock&) = delete;
+    InterruptLock& operator=(const InterruptLock&) = delete;
+
+private:
+    bool m_enabled;
+};
+
 inline void interrupt(uint8_t code)
 {
     __asm__ __volatile__ ("int %0" : :"i"(code));
@@ -25,6 +25,8 @@ SOFTWARE.
 
 #include "i686/cpu/registers.hpp"
 #include "i686/pc/devices/pic.hpp"
+#include "i686/cpu/lapic.hpp"
+#include "i686/smp/smp.hpp"
 #include "i686/tasking/process.hpp"
 #include "halt.hpp"
 #include "panic.hpp"
@@ -34,6 +36,7 @@ SOFTWARE.
 #include "terminal/terminal.hpp"
 #include "utils/logging.hpp"
 #include "tasking/process.hpp"
+#include "tasking/scheduler.hpp"
 
 #include <stdio.h>
 
@@ -80,12 +83,19 @@ constexpr const char *exception_messages[] = {
 extern "C"
 const registers* isr_handler(registers* const regs)
 {
+    // our process was handed over to another CPU while we waited for the kernel lock
+    smp::enter_kernel(regs, false);
+
     // If in user mode
     if (regs->cs & 0x3) Process::current().arch_context->regs = *regs;
 
-    if (auto handl = handlers[regs->int_no]; handl)
+    if (isr::call_handler(regs))
     {
-        if (handl(regs)) return regs;
+        // killed while a page fault handler waited for the disk
+        if ((regs->cs & 0x3) && Process::enabled()) Process::current().check_pending_kill();
+
+        smp::leave_kernel();
+        return regs;
     }
 
     if (regs->int_no < std::extent_v<decltype(exception_messages)>)
@@ -111,26 +121,37 @@ const registers* isr_handler(registers* const regs)
 
     }
 
+    smp::leave_kernel();
     return regs;
 }
 
 extern "C"
 const registers* irq_handler(registers* const regs)
 {
-    // If in user mode
-    if (regs->cs & 0x3) Process::current().arch_context->regs = *regs;
+    if (regs->int_no >= lapic::timer_vector) lapic::send_eoi();
+    else pic::send_eoi(regs->int_no-31);
 
-    pic::send_eoi(regs->int_no-31);
-    if (auto handl = handlers[regs->int_no]; handl)
+    if (smp::is_ipi(regs->int_no))
     {
-        handl(regs);
+        smp::handle_ipi(regs);
+        return regs;
     }
-    else
+
+    // the CPU holding the kernel lock runs it instead
+    if (!smp::enter_irq(regs)) return regs;
+
+    // If in user mode
+    if (regs->cs & 0x3) Process::current().arch_context->regs = *regs;
+
+    if (!isr::call_handler(regs))
     {
         //log_serial("Unhandled irq %d\n", regs->int_no);
     }
 
+    // the handler woke up a higher priority process, like a kernel thread it deferred work to
+    if ((regs->cs & 0x3) && tasking::need_resched()) tasking::schedule();
 
+    smp::leave_kernel();
     return regs;
 }
 #pragma GCC pop_options
@@ -144,3 +165,13 @@ void isr::delete_handler(uint8_t num)
 {
     handlers[num] = nullptr;
 }
+
+bool isr::call_handler(registers * const regs)
+{
+    if (auto handl = handlers[regs->int_no]; handl)
+    {
+        return handl(regs);
+    }
+
+    return false;
+}
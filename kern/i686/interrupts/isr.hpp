@@ -52,6 +52,7 @@ namespace isr
 enum Exception : uint32_t
 {
     Breakpoint = 3,
+    DeviceNotAvailable = 7,
     DoubleFault = 8,
     PageFault = 14
 };
@@ -61,6 +62,9 @@ using isr_t = std::function<bool(registers* const r)>;
 void register_handler(uint8_t num, isr_t handler);
 
 void delete_handler(uint8_t num);
+
+// runs the handler of regs->int_no, returns false if there is none or it didn't handle it
+bool call_handler(registers* const regs);
 }
 
 #endif // ISR_HPP
@@ -32,33 +32,24 @@ SOFTWARE.
 
 void *Memory::mmap(uintptr_t p_addr, size_t len, uint32_t flags)
 {
-    size_t offset = p_addr & 0xFFF;
-
-    len += offset;
-
-    size_t page_num = len/Paging::page_size + (len%Paging::page_size?1:0);
-
     assert(len);
 
-    uintptr_t pages = Paging::alloc_virtual_page(page_num);
-    for (size_t i { 0 }; i < page_num; ++i)
-    {
-        Paging::map_page(p_addr + i*Paging::page_size,
-                         reinterpret_cast<void*>(pages + i*Paging::page_size),
-                         flags);
-    }
-
-    return reinterpret_cast<void*>(pages + offset);
+    return reinterpret_cast<void*>(Paging::map_range(p_addr, len, flags));
 }
 
 void Memory::unmap(void *v_addr, size_t len)
 {
-    size_t page_num = len/Paging::page_size + (len%Paging::page_size?1:0);
+    Paging::unmap_range(v_addr, len);
+}
 
-    for (size_t i { 0 }; i < page_num; ++i)
-    {
-        Paging::unmap_page(reinterpret_cast<uint8_t*>(v_addr) + i*Paging::page_size);
-    }
+void *Memory::direct_map(uintptr_t p_addr, size_t len)
+{
+    return Paging::physmap(p_addr, len);
+}
+
+bool Memory::is_direct_mapped(const void *v_addr)
+{
+    return Paging::in_physmap(v_addr);
 }
 
 void Memory::map_page(uintptr_t p_addr, void *v_addr, uint32_t flags)
@@ -102,6 +93,21 @@ void Memory::release_physical_page(uintptr_t page)
     PhysPageAllocator::release_physical_page(page);
 }
 
+uintptr_t Memory::allocate_physical_pages(size_t order)
+{
+    return PhysPageAllocator::alloc_physical_pages(order);
+}
+
+void Memory::release_physical_pages(uintptr_t page, size_t order)
+{
+    PhysPageAllocator::release_physical_pages(page, order);
+}
+
+size_t Memory::free_physical_pages()
+{
+    return PhysPageAllocator::free_pages();
+}
+
 size_t Memory::allocated_physical_pages()
 {
     return PhysPageAllocator::allocated_pages;
@@ -116,3 +122,8 @@ void Memory::release_virtual_page(uintptr_t page)
 {
     Paging::release_virtual_page(page);
 }
+
+Memory::VirtualSpaceStats Memory::virtual_space_stats(bool user)
+{
+    return Paging::virtual_space_stats(user);
+}
@@ -49,7 +49,10 @@ bool Paging::page_fault_handler(registers *regs)
         panic("Reserved paging structure bit write !\n");
     }
 
-    page_fault_entry(fault);
+    if (page_fault_entry(fault))
+    {
+        return true; // resolved, execute the instruction again
+    }
 
     // if eip seems invalid, try to manually pop the stack and return
     if (!Memory::is_mapped((unsigned char*)regs->eip))
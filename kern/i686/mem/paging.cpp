@@ -26,6 +26,9 @@ SOFTWARE.
 #include "paging.hpp"
 
 #include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm.hpp>
 
 #include "halt.hpp"
 #include "panic.hpp"
@@ -33,27 +36,103 @@ SOFTWARE.
 #include "utils/bitops.hpp"
 
 #include "i686/interrupts/isr.hpp"
+#include "i686/cpu/cpuid.hpp"
 
 #include "physallocator.hpp"
 
+#include "i686/smp/smp.hpp"
+
+#include "utils/pool_allocator.hpp"
+
 extern "C" int kernel_physical_end;
 
-static PagingInformation kernel_info;
+static PagingInformation kernel_paging_info;
+alignas(4096) static PageDirectory kernel_page_directory;
+// page tables of the kernel half, shared by every address space (the last 4MB are left unused)
+alignas(4096) static kpp::array<PageTable, 1023 - (KERNEL_VIRTUAL_BASE >> 22)> kernel_page_tables;
+
+// the kernel heap itself allocates virtual memory, so the kernel range allocator can't use it
+template <typename T>
+using KernelRangePool = PoolAllocator<T, 2048>;
+static RangeAllocator<KernelRangePool> kernel_ranges; // free page ranges of the kernel half
+
+static constexpr size_t pages_per_large_page { Paging::large_page_size / Paging::page_size };
+// above that, flushing the whole TLB is cheaper than invalidating each page
+static constexpr size_t max_invlpg_pages { 32 };
+
+struct TLBShootdown
+{
+    PagingInformation* info; // nullptr for kernel addresses
+    uintptr_t addr;
+    size_t pages; // 0 to flush everything
+    bool unload; // switch to the kernel page directory if info is loaded
+};
+
+// directory entry pointing to the static page table of a kernel pdindex
+static PDEntry kernel_table_pde(size_t pdindex)
+{
+    PDEntry entry {};
+    entry.pt_addr = (reinterpret_cast<uintptr_t>(kernel_page_tables[pdindex - (KERNEL_VIRTUAL_BASE >> 22)].data()) - KERNEL_VIRTUAL_BASE) >> 12;
+    entry.present = true;
+    entry.os_claimed = true;
+    entry.write = true;
+    entry.user = true;
+
+    return entry;
+}
+
+PagingInformation::~PagingInformation()
+{
+    if (!page_directory || this == &Paging::kernel_info()) return;
+
+    // don't pull the rug from under our feet, nor from under the other CPUs' ones
+    Paging::unload_paging_info(*this);
+
+    Paging::unmap_user_space(*this);
+    kfree(page_directory);
+}
 
 void Paging::init()
 {
     cli();
-    create_paging_info(kernel_info);
+    kernel_paging_info.page_directory = &kernel_page_directory;
+    kernel_paging_info.directory_phys = reinterpret_cast<uintptr_t>(kernel_page_directory.data()) - KERNEL_VIRTUAL_BASE;
+    memset(kernel_page_directory.data(), 0, kernel_page_directory.size()*sizeof(PDEntry));
+    for (size_t i { 0 }; i < kernel_page_tables.size(); ++i)
+    {
+        const size_t pdindex = (KERNEL_VIRTUAL_BASE >> 22) + i;
+
+        memset(kernel_page_tables[i].data(), 0, kernel_page_tables[i].size()*sizeof(PTEntry));
+        kernel_paging_info.page_tables[pdindex] = &kernel_page_tables[i];
+        kernel_page_directory[pdindex] = kernel_table_pde(pdindex);
+    }
+
+    kernel_ranges.reset(KERNEL_VIRTUAL_BASE >> 12, ram_maxpage - (KERNEL_VIRTUAL_BASE >> 12));
+    kernel_paging_info.user_ranges.reset(0, KERNEL_VIRTUAL_BASE >> 12);
+
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, eax, ebx, ecx, edx);
+    m_large_pages = bit_check(edx, 3);
+    m_global_pages = bit_check(edx, 13);
+
+    map_kernel(kernel_paging_info);
+
+    m_current_info = &kernel_paging_info;
 
     isr::register_handler(isr::PageFault, page_fault_handler);
 
-    uint32_t pd_addr { reinterpret_cast<uint32_t>(kernel_info.page_directory.data()) - KERNEL_VIRTUAL_BASE };
+    uint32_t pd_addr { kernel_paging_info.directory_phys };
     uint32_t cr4_var = cr4();
-    bit_clear(cr4_var, 4); // disable 4MB pages
+    if (m_large_pages) bit_set(cr4_var, 4); // 4MB pages, already enabled by the boot code
+    if (m_global_pages) bit_set(cr4_var, 7); // global pages : kernel TLB entries survive %cr3 reloads
+    uint32_t cr0_var = cr0();
+    bit_set(cr0_var, 16); // write protect : the kernel must fault too when writing to copy-on-write pages
 
-    asm volatile ("mov %0, %%cr3\n"
-                  "mov %1, %%cr4\n"
-                  "\n"::"r"(pd_addr), "r"(cr4_var));
+    // %cr4 goes first, the new page directory may contain 4MB pages
+    asm volatile ("mov %0, %%cr4\n"
+                  "mov %1, %%cr3\n"
+                  "mov %2, %%cr0\n"
+                  "\n"::"r"(cr4_var), "r"(pd_addr), "r"(cr0_var));
 
     m_initialized = true;
 
@@ -62,23 +141,49 @@ void Paging::init()
 
 void Paging::map_page(uintptr_t p_addr, void *v_addr, uint32_t flags)
 {
-    auto entry = page_entry((uintptr_t)(v_addr));
+    map_page(info_for(reinterpret_cast<uintptr_t>(v_addr)), p_addr, v_addr, flags);
+}
+
+void Paging::unmap_page(void *v_addr)
+{
+    release_virtual_page(reinterpret_cast<uintptr_t>(v_addr));
+}
+
+void Paging::map_page(PagingInformation &info, uintptr_t p_addr, void *v_addr, uint32_t flags)
+{
+    auto entry = page_entry(info, (uintptr_t)(v_addr));
     assert(!entry->present);
 
+    if (!entry->os_claimed)
+    {
+        // fixed address mapping, not obtained through alloc_virtual_page
+        reserve_range(info, (uintptr_t)v_addr, 1);
+    }
+
     entry->phys_addr = p_addr >> 12;
 
     entry->write = !!(flags & Memory::Write);
     entry->cd = !!(flags & Memory::Uncached);
     entry->wt = !!(flags & Memory::WriteThrough);
     entry->user = !!(flags & Memory::User);
+    entry->global = m_global_pages && (uintptr_t)v_addr >= KERNEL_VIRTUAL_BASE;
 
-    entry->present = !(flags & Memory::Sentinel);
+    entry->present = !(flags & (Memory::Sentinel|Memory::OnDemand));
+    entry->data = !!(flags & Memory::OnDemand); // counts as mapped for user pointer checks
     entry->os_claimed = true;
 }
 
-void Paging::unmap_page(void *v_addr)
+void Paging::unmap_page(PagingInformation &info, void *v_addr)
 {
-    release_virtual_page(reinterpret_cast<uintptr_t>(v_addr));
+    auto entry = page_entry(info, (uintptr_t)(v_addr), false);
+    assert(entry && entry->os_claimed);
+
+    entry->present = false;
+    entry->data = 0;
+    entry->os_claimed = false;
+    release_range(info, (uintptr_t)v_addr, 1);
+
+    flush_tlb(info, (uintptr_t)v_addr, 1);
 }
 
 void Paging::identity_map(uintptr_t p_addr, size_t size, uint32_t flags)
@@ -87,36 +192,148 @@ void Paging::identity_map(uintptr_t p_addr, size_t size, uint32_t flags)
 
     for (size_t i { 0 }; i < page_num; ++i)
     {
-        page_entry(p_addr + i * page_size)->os_claimed = true;
         map_page(p_addr + i * page_size, (uint8_t*)p_addr + i * page_size, flags);
     }
 }
 
+uintptr_t Paging::map_range(uintptr_t p_addr, size_t len, uint32_t flags)
+{
+    const size_t offset = p_addr & (page_size - 1);
+    const uintptr_t base = p_addr - offset;
+    const size_t pages = (len + offset + page_size - 1) / page_size;
+
+    assert(pages);
+
+    if (!m_large_pages || pages < pages_per_large_page)
+    {
+        const uintptr_t v_addr = alloc_virtual_page(pages);
+        for (size_t i { 0 }; i < pages; ++i)
+        {
+            map_page(base + i*page_size, reinterpret_cast<void*>(v_addr + i*page_size), flags);
+        }
+
+        return v_addr + offset;
+    }
+
+    // allocate some slack so the virtual address can have the same offset inside a 4MB page as p_addr
+    const size_t allocated = pages + pages_per_large_page - 1;
+    auto first = kernel_ranges.allocate(allocated);
+    if (!first)
+    {
+        panic("no more virtual addresses available");
+    }
+    const size_t start = *first + (((base >> 12) - *first) & (pages_per_large_page - 1));
+    if (start != *first) kernel_ranges.release(*first, start - *first);
+    if (start + pages != *first + allocated) kernel_ranges.release(start + pages, *first + allocated - (start + pages));
+
+    for (size_t i { 0 }; i < pages;)
+    {
+        const uintptr_t v_addr = (start + i) * page_size;
+        if (v_addr % large_page_size == 0 && pages - i >= pages_per_large_page)
+        {
+            map_large_page(base + i*page_size, v_addr, flags);
+            i += pages_per_large_page;
+        }
+        else
+        {
+            page_entry(v_addr)->os_claimed = true;
+            map_page(base + i*page_size, reinterpret_cast<void*>(v_addr), flags);
+            ++i;
+        }
+    }
+
+    return start * page_size + offset;
+}
+
+void Paging::unmap_range(void *v_addr, size_t len)
+{
+    const size_t offset = reinterpret_cast<uintptr_t>(v_addr) & (page_size - 1);
+    const uintptr_t base = reinterpret_cast<uintptr_t>(v_addr) - offset;
+    const size_t pages = (len + offset + page_size - 1) / page_size;
+
+    for (size_t i { 0 }; i < pages;)
+    {
+        const uintptr_t page = base + i*page_size;
+        if (large_page_entry(info_for(page), page))
+        {
+            assert(page % large_page_size == 0 && pages - i >= pages_per_large_page);
+            unmap_large_page(page);
+            i += pages_per_large_page;
+        }
+        else
+        {
+            unmap_page(reinterpret_cast<void*>(page));
+            ++i;
+        }
+    }
+}
+
+void Paging::create_physmap(uint64_t ram_end)
+{
+    assert(m_physmap_size == 0);
+    const size_t size = std::min<uint64_t>(ram_end, physmap_max_size) & ~uint64_t(page_size - 1);
+
+    reserve_range(kernel_paging_info, physmap_base, size / page_size);
+    for (uintptr_t addr { 0 }; addr < size;)
+    {
+        // physmap_base is 4MB aligned ; the end of RAM is mapped with 4KB pages to not cover what lies after it
+        if (m_large_pages && size - addr >= large_page_size)
+        {
+            map_large_page(addr, physmap_base + addr, Memory::Read|Memory::Write);
+            addr += large_page_size;
+        }
+        else
+        {
+            page_entry(physmap_base + addr)->os_claimed = true;
+            map_page(addr, reinterpret_cast<void*>(physmap_base + addr), Memory::Read|Memory::Write);
+            addr += page_size;
+        }
+    }
+
+    m_physmap_size = size;
+    log_serial("Physical memory mapped up to 0x%x at 0x%x\n", size, physmap_base);
+}
+
 uintptr_t Paging::physical_address(const void *v_addr)
 {
     size_t offset = (uintptr_t)v_addr & 0xFFF;
 
-    auto entry = page_entry(reinterpret_cast<uintptr_t>(v_addr));
+    if (auto pde = large_page_entry(info_for((uintptr_t)v_addr), (uintptr_t)v_addr))
+    {
+        return (pde->pt_addr << 12) + ((uintptr_t)v_addr & (large_page_size - 1));
+    }
+
+    auto entry = page_entry(reinterpret_cast<uintptr_t>(v_addr), false);
 
-    if (!entry->present) return (uintptr_t)v_addr;
+    if (!entry || !entry->present) return (uintptr_t)v_addr;
 
     return (entry->phys_addr << 12) + offset;
 }
 
 bool Paging::is_mapped(const void *v_addr)
 {
-    return page_entry(reinterpret_cast<uintptr_t>(v_addr))->present;
+    if (large_page_entry(info_for((uintptr_t)v_addr), (uintptr_t)v_addr)) return true;
+
+    auto entry = page_entry(reinterpret_cast<uintptr_t>(v_addr), false);
+
+    return entry && entry->present;
 }
 
 bool Paging::check_user_ptr(const void *v_addr, size_t size)
 {
     size_t page_num = size/page_size + (size%page_size?1:0);
 
-    auto entry = page_entry((uintptr_t)v_addr);
-
     for (size_t i { 0 }; i < page_num; ++i)
     {
-        if (!entry[i].present || !entry[i].user)
+        const uintptr_t addr = (uintptr_t)v_addr + i*page_size;
+        if (auto pde = large_page_entry(info_for(addr), addr))
+        {
+            if (!pde->user) return false;
+            continue;
+        }
+
+        auto entry = page_entry(addr, false);
+        if (!entry || !(entry->present || entry->data) || !entry->user)
         {
             return false;
         }
@@ -125,160 +342,320 @@ bool Paging::check_user_ptr(const void *v_addr, size_t size)
     return true;
 }
 
-void Paging::unmap_user_space()
+void Paging::unmap_user_space(PagingInformation &info)
 {
-    aligned_memsetl(page_entry(0), 0, (KERNEL_VIRTUAL_BASE >> 12)*sizeof(PTEntry));
-    // Reload the page tables
-    asm volatile ("mov %cr3, %eax\n"
-                  "mov %eax, %cr3\n");
+    for (size_t i { 0 }; i < (KERNEL_VIRTUAL_BASE >> 22); ++i)
+    {
+        if (info.page_tables[i])
+        {
+            kfree(info.page_tables[i]);
+            info.page_tables[i] = nullptr;
+        }
+        (*info.page_directory)[i] = PDEntry{};
+    }
+    info.user_ranges.reset(0, KERNEL_VIRTUAL_BASE >> 12);
+
+    flush_tlb(info, 0, 0);
 }
 
 void Paging::create_paging_info(PagingInformation &info)
 {
-    auto get_addr = [](auto addr)->void*
-    {
-        if (!m_initialized)
-        {
-            return (void*)addr;
-        }
-        else
-        {
-            return (void*)Memory::physical_address((void*)addr);
-        }
-    };
+    assert(m_initialized);
+    assert(!info.page_directory);
+
+    info.page_directory = reinterpret_cast<PageDirectory*>(kmalloc_align(sizeof(PageDirectory), page_size));
+    assert(info.page_directory);
+    info.directory_phys = physical_address(info.page_directory);
+
+    memset(info.page_directory->data(), 0, (KERNEL_VIRTUAL_BASE >> 22)*sizeof(PDEntry));
+    info.user_ranges.reset(0, KERNEL_VIRTUAL_BASE >> 12);
+    sync_kernel_half(info);
+}
 
-    memset(info.page_directory.data(), 0, info.page_directory.size()*sizeof(PDEntry));
-    for (size_t i { 0 }; i < info.page_tables.size(); ++i)
+void Paging::load_paging_info(PagingInformation &info)
+{
+    assert(info.page_directory);
+
+    if (&info == m_current_info) return;
+
+    // kernel 4MB pages were mapped or unmapped since this directory was last loaded
+    if (info.kernel_version != m_kernel_version) sync_kernel_half(info);
+
+    m_current_info = &info;
+    asm volatile ("mov %0, %%cr3\n"::"r"(info.directory_phys) : "memory");
+}
+
+void Paging::unload_paging_info(PagingInformation &info)
+{
+    if (&info == m_current_info) load_paging_info(kernel_paging_info);
+
+    TLBShootdown request { &info, 0, 0, true };
+    smp::call_on_others(cpus_using(info), &shootdown_handler, &request);
+}
+
+PagingInformation &Paging::current_paging_info()
+{
+    return *m_current_info.get();
+}
+
+PagingInformation &Paging::kernel_info()
+{
+    return kernel_paging_info;
+}
+
+void Paging::reserve_range(PagingInformation &info, uintptr_t addr, size_t pages)
+{
+    const bool reserved = (addr >= KERNEL_VIRTUAL_BASE ? kernel_ranges.reserve(addr >> 12, pages)
+                                                       : info.user_ranges.reserve(addr >> 12, pages));
+    assert(reserved);
+}
+
+void Paging::release_range(PagingInformation &info, uintptr_t addr, size_t pages)
+{
+    if (addr >= KERNEL_VIRTUAL_BASE)
     {
-        memset(info.page_tables[i].data(), 0, info.page_tables[i].size()*sizeof(PTEntry));
-        info.page_directory[i].pt_addr = (reinterpret_cast<uintptr_t>(get_addr(info.page_tables[i].data())) - KERNEL_VIRTUAL_BASE) >> 12;
-        info.page_directory[i].present = true;
-        info.page_directory[i].os_claimed = true;
-        info.page_directory[i].write = true;
-        info.page_directory[i].user = true;
+        kernel_ranges.release(addr >> 12, pages);
     }
+    else
+    {
+        info.user_ranges.release(addr >> 12, pages);
+    }
+}
 
-    map_kernel(info);
+Memory::VirtualSpaceStats Paging::virtual_space_stats(bool user)
+{
+    const RangeAllocatorStats stats = user ? current_paging_info().user_ranges.stats() : kernel_ranges.stats();
 
-    // map last dir entry to itself
-    info.page_directory.back().pt_addr = (reinterpret_cast<uintptr_t>(get_addr(info.page_directory.data())) - KERNEL_VIRTUAL_BASE) >> 12;
-    info.page_directory.back().write = true;
-    info.page_directory.back().present = true;
-    info.page_directory.back().os_claimed = true;
-    info.page_directory.back().user = false;
+    return {stats.free_size, stats.free_ranges, stats.largest_free_range};
 }
 
-uintptr_t Paging::alloc_virtual_page(size_t number, bool user)
+PageTable *Paging::create_page_table(PagingInformation &info, size_t pdindex)
 {
-    assert(number != 0);
+    assert(pdindex < (KERNEL_VIRTUAL_BASE >> 22)); // kernel page tables always exist
+    assert(!info.page_tables[pdindex]);
 
-    constexpr size_t margin = 0;
+    auto table = reinterpret_cast<PageTable*>(kmalloc_align(sizeof(PageTable), page_size));
+    assert(table);
+    aligned_memsetl(table->data(), 0, sizeof(PageTable));
 
-    static size_t user_last_pos = 0x0;
-    static size_t kernel_last_pos = KERNEL_VIRTUAL_BASE >> 12;
+    auto& pde = (*info.page_directory)[pdindex];
+    pde.pt_addr = physical_address(table) >> 12;
+    pde.present = true;
+    pde.os_claimed = true;
+    pde.write = true;
+    pde.user = true;
 
-    const size_t base = user ? 0x0 : (KERNEL_VIRTUAL_BASE >> 12);
+    info.page_tables[pdindex] = table;
 
-    size_t& last_pos = user ? user_last_pos : kernel_last_pos;
+    return table;
+}
 
-    PTEntry* entries = page_entry(0);
-    uintptr_t addr { 0 };
-    size_t counter { 0 };
+void Paging::map_large_page(uintptr_t p_addr, uintptr_t v_addr, uint32_t flags)
+{
+    assert(m_large_pages);
+    assert(v_addr >= KERNEL_VIRTUAL_BASE);
+    assert(p_addr % large_page_size == 0 && v_addr % large_page_size == 0);
+
+    PDEntry entry {};
+    entry.pt_addr = p_addr >> 12;
+    entry.write = !!(flags & Memory::Write);
+    entry.cd = !!(flags & Memory::Uncached);
+    entry.wt = !!(flags & Memory::WriteThrough);
+    entry.user = !!(flags & Memory::User);
+    entry.global = m_global_pages;
+    entry.size = true;
+    entry.present = true;
+    entry.os_claimed = true;
+
+    set_kernel_pde(v_addr >> 22, entry);
+}
 
-    number += margin;
+void Paging::unmap_large_page(uintptr_t v_addr)
+{
+    assert(large_page_entry(kernel_paging_info, v_addr));
+
+    // the static page table of this range is unused, and thus still empty
+    set_kernel_pde(v_addr >> 22, kernel_table_pde(v_addr >> 22));
+    release_range(kernel_paging_info, v_addr, pages_per_large_page);
+}
 
-loop:
-    for (size_t i { last_pos }; i < (user ? (KERNEL_VIRTUAL_BASE >> 12) : ram_maxpage); ++i)
+void Paging::set_kernel_pde(size_t pdindex, const PDEntry &entry)
+{
+    assert(pdindex >= (KERNEL_VIRTUAL_BASE >> 22));
+
+    kernel_page_directory[pdindex] = entry;
+    kernel_paging_info.kernel_version = ++m_kernel_version;
+
+    // the other address spaces are updated when they are loaded, or by the shootdown for the ones other CPUs use
+    if (m_current_info && m_current_info != &kernel_paging_info)
     {
-        if (!entries[i].os_claimed)
-        {
-            assert(!entries[i].present);
-            if (counter++ == 0) addr = i;
-        }
-        else
-        {
-            counter = 0;
-        }
+        sync_kernel_half(current_paging_info());
+    }
 
-        if (counter == number)
-        {
-            last_pos = i;
+    if (m_initialized)
+    {
+        flush_tlb(kernel_paging_info, pdindex << 22, 1);
+    }
+}
 
-            // ensure it stays in kernel space
-            if (!user) assert(addr * page_size + (margin/2*page_size) >= KERNEL_VIRTUAL_BASE);
+void Paging::sync_kernel_half(PagingInformation &info)
+{
+    for (size_t i { KERNEL_VIRTUAL_BASE >> 22 }; i < info.page_tables.size(); ++i)
+    {
+        (*info.page_directory)[i] = kernel_page_directory[i];
+        info.page_tables[i] = kernel_paging_info.page_tables[i];
+    }
+    info.kernel_version = m_kernel_version;
+}
 
-            for (size_t j { addr }; j < addr + number + margin; ++j)
-            {
-                entries[j].os_claimed = true; // mark these entries as reclaimed so they cannot be claimed again while still not mapped
-            }
+void Paging::flush_tlb(PagingInformation &info, uintptr_t addr, size_t pages)
+{
+    const bool kernel = addr >= KERNEL_VIRTUAL_BASE;
 
-            return addr * page_size + (margin/2*page_size);
-        }
+    if (kernel || &info == m_current_info)
+    {
+        invalidate_local(addr, pages);
     }
 
-    // Reloop
-    if (last_pos != base)
+    if (!m_initialized) return;
+
+    TLBShootdown request { kernel ? nullptr : &info, addr, pages, false };
+    smp::call_on_others(kernel ? smp::other_cpus() : cpus_using(info), &shootdown_handler, &request);
+}
+
+void Paging::invalidate_local(uintptr_t addr, size_t pages)
+{
+    if (pages && pages <= max_invlpg_pages)
     {
-        log_serial("virtual reloop, size %d\n", number);
-        last_pos = base;
-        goto loop;
+        for (size_t i { 0 }; i < pages; ++i)
+        {
+            asm volatile ("invlpg (%0)"::"r"(addr + i*page_size) : "memory");
+        }
+        return;
     }
 
-    panic("no more virtual addresses available");
-    return 0;
+    const uint32_t cr4_var = cr4();
+    if (m_global_pages)
+    {
+        // toggling CR4.PGE flushes the global entries too
+        asm volatile ("mov %0, %%cr4\n"
+                      "mov %1, %%cr4\n"::"r"(cr4_var & ~(1u << 7)), "r"(cr4_var) : "memory");
+    }
+    else
+    {
+        asm volatile ("mov %%cr3, %%eax\n"
+                      "mov %%eax, %%cr3\n":::"eax", "memory");
+    }
 }
 
-bool Paging::release_virtual_page(uintptr_t v_addr, size_t number, ReleaseFlags flags)
+void Paging::shootdown_handler(void *arg)
 {
-#if 1
-    auto entry = page_entry(v_addr);
-    for (size_t i { 0 }; i < number; ++i)
+    const auto& request = *static_cast<const TLBShootdown*>(arg);
+    auto& current = current_paging_info();
+
+    // a kernel 4MB page was mapped or unmapped
+    if (&current != &kernel_paging_info && current.kernel_version != m_kernel_version)
     {
-        assert(entry[i].present);
-        assert(entry[i].os_claimed);
-        assert(flags == FreePage);
-        entry[i].present = false;
-        entry[i].os_claimed = false;
-        asm volatile ("invlpg (%0)"::"r"(reinterpret_cast<uint8_t*>(v_addr) + i*page_size) : "memory");
+        sync_kernel_half(current);
     }
-#else
-    auto base = page_entry(v_addr);
-    memset(base, 0, number*sizeof(PTEntry));
-    for (size_t i { 0 }; i < number; ++i)
+
+    if (request.unload)
     {
-        asm volatile ("invlpg (%0)"::"r"(reinterpret_cast<uint8_t*>(v_addr) + i*page_size) : "memory");
+        if (request.info == &current) load_paging_info(kernel_paging_info);
+        return;
     }
-#endif
 
-    return true;
+    invalidate_local(request.addr, request.pages);
 }
 
-PageDirectory *Paging::get_page_directory()
+uint32_t Paging::cpus_using(const PagingInformation &info)
 {
-    if (!m_initialized)
+    uint32_t mask { 0 };
+    for (size_t i { 0 }; i < smp::cpu_count(); ++i)
     {
-        return &kernel_info.page_directory;
+        if (i != smp::cpu_index() && m_current_info.on(i) == &info) mask |= 1u << i;
     }
-    else
+
+    return mask;
+}
+
+void Paging::init_ap()
+{
+    // the trampoline already loaded the kernel page directory and %cr4
+    m_current_info = &kernel_paging_info;
+
+    uint32_t cr0_var = cr0();
+    bit_set(cr0_var, 16); // write protect
+    asm volatile ("mov %0, %%cr0\n"::"r"(cr0_var));
+}
+
+uintptr_t Paging::alloc_virtual_page(size_t number, bool user)
+{
+    assert(number != 0);
+
+    // user addresses are allocated in the current address space
+    PagingInformation& info = user ? current_paging_info() : kernel_paging_info;
+
+    auto page = user ? info.user_ranges.allocate(number) : kernel_ranges.allocate(number);
+    if (!page)
+    {
+        panic("no more virtual addresses available");
+    }
+
+    for (size_t i { *page }; i < *page + number; ++i)
+    {
+        auto entry = page_entry(info, i * page_size);
+        assert(!entry->os_claimed);
+        entry->os_claimed = true; // mark these entries as reclaimed so they cannot be claimed again while still not mapped
+    }
+
+    return *page * page_size;
+}
+
+bool Paging::release_virtual_page(uintptr_t v_addr, size_t number, ReleaseFlags flags)
+{
+    for (size_t i { 0 }; i < number; ++i)
     {
-        return reinterpret_cast<PageDirectory*>(0xFFFFF000);
+        auto entry = page_entry(v_addr + i*page_size, false);
+        assert(entry);
+        assert(entry->os_claimed); // pages mapped on demand may not be present yet
+        assert(flags == FreePage);
+        entry->present = false;
+        entry->data = 0;
+        entry->os_claimed = false;
     }
+
+    release_range(info_for(v_addr), v_addr, number);
+    flush_tlb(info_for(v_addr), v_addr, number);
+
+    return true;
 }
 
 void Paging::map_kernel(PagingInformation& info)
 {
-    uint32_t pdindex = KERNEL_VIRTUAL_BASE >> 22;
-    uint32_t ptindex = KERNEL_VIRTUAL_BASE >> 12 & 0x03FF;
+    if (m_large_pages)
+    {
+        const size_t large_pages = (reinterpret_cast<uint32_t>(&kernel_physical_end) + page_size) / large_page_size + 1;
+
+        kernel_ranges.reserve(KERNEL_VIRTUAL_BASE >> 12, large_pages * pages_per_large_page);
+        for (size_t i { 0 }; i < large_pages; ++i)
+        {
+            map_large_page(i * large_page_size, KERNEL_VIRTUAL_BASE + i * large_page_size,
+                           Memory::Read|Memory::Write|Memory::User);
+        }
+        return;
+    }
 
-    PageTable * pt = reinterpret_cast<PageTable*>((info.page_directory[pdindex].pt_addr << 12) + KERNEL_VIRTUAL_BASE);
-    PTEntry* entry = &(*pt)[ptindex];
+    kernel_ranges.reserve(KERNEL_VIRTUAL_BASE >> 12, (reinterpret_cast<uint32_t>(&kernel_physical_end) + page_size) / page_size + 1);
 
-    for (uint32_t addr { 0 }; addr <= reinterpret_cast<uint32_t>(&kernel_physical_end) + page_size; addr+=page_size, ++entry)
+    for (uint32_t addr { 0 }; addr <= reinterpret_cast<uint32_t>(&kernel_physical_end) + page_size; addr+=page_size)
     {
+        PTEntry* entry = page_entry(info, KERNEL_VIRTUAL_BASE + addr, false);
         entry->phys_addr = addr >> 12;
         entry->present = true;
         entry->os_claimed = true;
         entry->write = true;
         entry->user = true;
+        entry->global = m_global_pages;
     }
 }
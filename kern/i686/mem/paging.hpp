@@ -33,6 +33,12 @@ SOFTWARE.
 
 #include <array.hpp>
 
+#include "mem/range_allocator.hpp"
+
+#include "utils/noncopyable.hpp"
+
+#include "i686/smp/percpu.hpp"
+
 struct multiboot_mmap_entry;
 typedef struct multiboot_mmap_entry multiboot_memory_map_t;
 
@@ -45,8 +51,8 @@ struct [[gnu::packed]] PDEntry
     uint8_t  cd      : 1;
     uint8_t  accessed: 1;
     uint8_t  zero    : 1;
-    uint8_t  size    : 1;
-    uint8_t  ignored : 1;
+    uint8_t  size    : 1; // 4MB page
+    uint8_t  global  : 1; // only meaningful for 4MB pages
     uint8_t  os_claimed : 1;
     uint8_t  data    : 2;
     uint32_t pt_addr : 20;
@@ -74,10 +80,19 @@ static_assert(sizeof(PTEntry) == 4);
 
 using PageTable = kpp::array<PTEntry, 1024>;
 
-struct PagingInformation
+// An address space : a page directory and the kernel-virtual addresses of its page tables.
+// The kernel half (PDE 768 and up) points to the same page tables in every address space,
+// so kernel mappings are visible everywhere without having to be copied.
+struct PagingInformation : NonCopyable
 {
-    alignas(4096) PageDirectory                 page_directory;
-    alignas(4096) kpp::array<PageTable, 1024>   page_tables;
+    PagingInformation() = default;
+    ~PagingInformation();
+
+    PageDirectory* page_directory { nullptr };
+    kpp::array<PageTable*, 1024> page_tables {};
+    uintptr_t directory_phys { 0 }; // value loaded into %cr3
+    RangeAllocator<> user_ranges; // free page ranges of the user half
+    uint32_t kernel_version { 0 }; // version of the kernel half copied into page_directory
 };
 
 class Paging
@@ -98,39 +113,116 @@ public:
     static void map_page(uintptr_t p_addr, void* v_addr, uint32_t flags = Memory::Read|Memory::Write);
     static void unmap_page(void* v_addr);
 
+    // map/unmap into an address space which is not necessarily the current one
+    static void map_page(PagingInformation& info, uintptr_t p_addr, void* v_addr, uint32_t flags = Memory::Read|Memory::Write);
+    static void unmap_page(PagingInformation& info, void* v_addr);
+
     static void identity_map(uintptr_t p_addr, size_t size, uint32_t flags = Memory::Read|Memory::Write);
 
+    // maps a physical range in the kernel half, using 4MB pages for the parts of it where that is possible
+    static uintptr_t map_range(uintptr_t p_addr, size_t len, uint32_t flags = Memory::Read|Memory::Write);
+    // unmaps pages mapped by map_page or map_range
+    static void unmap_range(void* v_addr, size_t len);
+
+    // permanently maps physical memory up to ram_end (at most physmap_max_size) at physmap_base
+    static void create_physmap(uint64_t ram_end);
+    static void* physmap(uintptr_t p_addr, size_t len)
+    {
+        if (p_addr >= m_physmap_size || len > m_physmap_size - p_addr) return nullptr;
+
+        return reinterpret_cast<void*>(physmap_base + p_addr);
+    }
+    static bool in_physmap(const void* v_addr)
+    {
+        const uintptr_t addr = reinterpret_cast<uintptr_t>(v_addr);
+
+        return addr >= physmap_base && addr - physmap_base < m_physmap_size;
+    }
+
     static uintptr_t physical_address(const void *v_addr);
 
     static bool is_mapped(const void* v_addr);
 
     static bool check_user_ptr(const void* v_addr, size_t size);
 
-    static void unmap_user_space();
+    static Memory::VirtualSpaceStats virtual_space_stats(bool user);
+
+    static void unmap_user_space(PagingInformation& info);
 
     static void create_paging_info(PagingInformation& info);
+    static void load_paging_info(PagingInformation& info);
+    // makes every CPU which loaded info switch to the kernel page directory, before destroying it
+    static void unload_paging_info(PagingInformation& info);
+    static PagingInformation& current_paging_info();
+    static PagingInformation& kernel_info();
+
+    // sets up paging on an application processor, which runs on the kernel page directory
+    static void init_ap();
 
 public:
     static constexpr uint32_t page_size { 1 << 12 };
+    static constexpr uint32_t large_page_size { 1 << 22 };
     static constexpr uint32_t ram_maxpage { 1024*1023 };
+    static constexpr uintptr_t physmap_base { 0xD0000000 };
+    static constexpr size_t physmap_max_size { 512*1024*1024 };
 
 private:
     static bool page_fault_handler(registers *regs);
 
 private:
-    static PageDirectory *get_page_directory();
     static void map_kernel(PagingInformation& info);
-    static PTEntry *page_entry(uintptr_t addr)
+    static PageTable* create_page_table(PagingInformation& info, size_t pdindex);
+    static void reserve_range(PagingInformation& info, uintptr_t addr, size_t pages);
+    static void release_range(PagingInformation& info, uintptr_t addr, size_t pages);
+    static PagingInformation& info_for(uintptr_t addr)
+    {
+        return addr >= KERNEL_VIRTUAL_BASE ? kernel_info() : *m_current_info.get();
+    }
+    // returns nullptr if the page table doesn't exist and create is false
+    static PTEntry *page_entry(PagingInformation& info, uintptr_t addr, bool create = true)
     {
         uint32_t pdindex = addr >> 22;
         uint32_t ptindex = addr >> 12 & 0x03FF;
 
-        PageTable * pt = reinterpret_cast<PageTable*>(((*get_page_directory())[pdindex].pt_addr << 12) + KERNEL_VIRTUAL_BASE);
+        PageTable* pt = info.page_tables[pdindex];
+        if (!pt)
+        {
+            if (!create) return nullptr;
+            pt = create_page_table(info, pdindex);
+        }
         return &(*pt)[ptindex];
     }
+    static PTEntry *page_entry(uintptr_t addr, bool create = true)
+    {
+        return page_entry(info_for(addr), addr, create);
+    }
+    // returns nullptr if addr isn't mapped by a 4MB page
+    static PDEntry *large_page_entry(PagingInformation& info, uintptr_t addr)
+    {
+        if (!info.page_directory) return nullptr;
+
+        auto& pde = (*info.page_directory)[addr >> 22];
+
+        return pde.present && pde.size ? &pde : nullptr;
+    }
+    static void map_large_page(uintptr_t p_addr, uintptr_t v_addr, uint32_t flags);
+    static void unmap_large_page(uintptr_t v_addr);
+    static void set_kernel_pde(size_t pdindex, const PDEntry& entry);
+    static void sync_kernel_half(PagingInformation& info);
+    // invalidates the TLB entries of pages just unmapped from info, on this CPU and on the others using it
+    static void flush_tlb(PagingInformation& info, uintptr_t addr, size_t pages);
+    static void invalidate_local(uintptr_t addr, size_t pages);
+    static void shootdown_handler(void* request);
+    // mask of the other CPUs which have info loaded
+    static uint32_t cpus_using(const PagingInformation& info);
 
 private:
     inline static bool m_initialized { false };
+    inline static smp::PerCPU<PagingInformation*> m_current_info { nullptr };
+    inline static size_t m_physmap_size { 0 };
+    inline static bool m_large_pages { false };
+    inline static bool m_global_pages { false };
+    inline static uint32_t m_kernel_version { 0 }; // bumped each time a kernel page directory entry changes
 };
 
 #endif // PAGING_HPP
@@ -30,7 +30,107 @@ SOFTWARE.
 #include "mem/memmap.hpp"
 #include "tasking/process.hpp"
 
-static constexpr uint32_t fill_pattern = 0xDEADBEEF;
+namespace
+{
+
+constexpr size_t npos = ~size_t(0);
+
+constexpr size_t words_for(size_t bits)
+{
+    return (bits + 31) / 32;
+}
+
+// Bitmap of the free blocks of one order, with two summary levels (one bit per non-empty word of the
+// level below) so that a free block can be found by scanning a few dozen words at most
+class FreeBlockBitmap
+{
+public:
+    static constexpr size_t storage_size(size_t bits)
+    {
+        return words_for(bits) + words_for(words_for(bits)) + words_for(words_for(words_for(bits)));
+    }
+
+    void init(uint32_t* storage, size_t bits)
+    {
+        m_words[0] = words_for(bits);
+        m_words[1] = words_for(m_words[0]);
+        m_words[2] = words_for(m_words[1]);
+        m_levels[0] = storage;
+        m_levels[1] = m_levels[0] + m_words[0];
+        m_levels[2] = m_levels[1] + m_words[1];
+
+        memset(storage, 0, storage_size(bits)*sizeof(uint32_t));
+    }
+
+    bool test(size_t idx) const
+    {
+        return m_levels[0][idx/32] & (1u << (idx%32));
+    }
+
+    void set(size_t idx)
+    {
+        for (size_t level { 0 }; level < 3; ++level, idx /= 32)
+        {
+            m_levels[level][idx/32] |= 1u << (idx%32);
+        }
+    }
+
+    void clear(size_t idx)
+    {
+        for (size_t level { 0 }; level < 3; ++level, idx /= 32)
+        {
+            m_levels[level][idx/32] &= ~(1u << (idx%32));
+            if (m_levels[level][idx/32]) break; // the upper levels still have bits set below them
+        }
+    }
+
+    size_t find_first() const
+    {
+        for (size_t i { 0 }; i < m_words[2]; ++i)
+        {
+            if (m_levels[2][i])
+            {
+                size_t idx = i*32 + __builtin_ctz(m_levels[2][i]);
+                idx = idx*32 + __builtin_ctz(m_levels[1][idx]);
+                return idx*32 + __builtin_ctz(m_levels[0][idx]);
+            }
+        }
+
+        return npos;
+    }
+
+private:
+    uint32_t* m_levels[3];
+    size_t m_words[3];
+};
+
+constexpr size_t bitmap_storage_size()
+{
+    size_t size = 0;
+    for (size_t order { 0 }; order <= PhysPageAllocator::max_order; ++order)
+    {
+        size += FreeBlockBitmap::storage_size(PhysPageAllocator::max_pages >> order);
+    }
+    return size;
+}
+
+uint32_t bitmap_storage[bitmap_storage_size()];
+FreeBlockBitmap free_blocks[PhysPageAllocator::max_order + 1];
+size_t free_block_count[PhysPageAllocator::max_order + 1];
+
+void insert_block(size_t idx, size_t order)
+{
+    free_blocks[order].set(idx);
+    ++free_block_count[order];
+}
+
+void remove_block(size_t idx, size_t order)
+{
+    free_blocks[order].clear(idx);
+    --free_block_count[order];
+}
+
+}
 
 uintptr_t PhysPageAllocator::allocated_list[50000];
 bool recording { false };
@@ -39,58 +139,126 @@ int PhysPageAllocator::allocated_pages = 0;
 
 void PhysPageAllocator::init()
 {
-    for (size_t i { 0 }; i < mem_bitmap.array_size; ++i)
+    // Everything is marked as used until the memory map tells us otherwise
+    size_t offset { 0 };
+    for (size_t order { 0 }; order <= max_order; ++order)
     {
-        mem_bitmap[i] = true;
+        free_blocks[order].init(bitmap_storage + offset, max_pages >> order);
+        free_block_count[order] = 0;
+        offset += FreeBlockBitmap::storage_size(max_pages >> order);
     }
 }
 
 uintptr_t PhysPageAllocator::alloc_physical_page()
 {
-    auto page = find_free_page();
-    clear_page(page);
+    return alloc_physical_pages(0);
+}
+
+bool PhysPageAllocator::release_physical_page(uintptr_t p_addr)
+{
+    return release_physical_pages(p_addr, 0);
+}
+
+uintptr_t PhysPageAllocator::alloc_physical_pages(size_t order)
+{
+    assert(order <= max_order);
+
+    size_t block_order = order;
+    while (block_order <= max_order && free_block_count[block_order] == 0)
+    {
+        ++block_order;
+    }
 
-    ++allocated_pages;
+    if (block_order > max_order)
+    {
+        log_serial("Out of memory\n");
+        panic("Out of memory !\n");
+    }
+
+    const size_t idx = free_blocks[block_order].find_first();
+    assert(idx != npos);
+    remove_block(idx, block_order);
+
+    // split the block, giving back the upper halves
+    const size_t pfn = idx << block_order;
+    while (block_order > order)
+    {
+        --block_order;
+        insert_block((pfn >> block_order) + 1, block_order);
+    }
 
-    return page;
+    allocated_pages += 1 << order;
+
+    return pfn*Paging::page_size;
 }
 
-bool PhysPageAllocator::release_physical_page(uintptr_t p_addr)
+bool PhysPageAllocator::release_physical_pages(uintptr_t p_addr, size_t order)
 {
-    const size_t base_page = p_addr >> 12;
+    const size_t pfn = p_addr >> 12;
 
-    const bool released = mem_bitmap[base_page];
-    mem_bitmap[base_page] = false;
+    assert(order <= max_order);
+    assert(pfn % (1 << order) == 0);
+    assert(free_block_order(pfn) == npos); // double free
 
-    assert(released);
+    free_block(pfn, order);
 
-    --allocated_pages;
+    allocated_pages -= 1 << order;
 
-    return released;
+    return true;
 }
 
 void PhysPageAllocator::mark_as_used(uintptr_t addr, size_t size)
 {
     const size_t base_page = addr >> 12;
-    const size_t end_addr = addr + size;
-    const size_t end_page = (end_addr >> 12) + (end_addr&0xFFF?1:0);
+    const size_t end_page = std::min<size_t>((uint64_t(addr) + size + 0xFFF) >> 12, max_pages);
 
-    for (size_t i { base_page }; i <= end_page; ++i)
+    for (size_t pfn { base_page }; pfn < end_page; ++pfn)
     {
-        mem_bitmap[i] = true;
+        size_t order = free_block_order(pfn);
+        if (order == npos) continue; // already used
+
+        // take the whole block out and give back everything but the page
+        remove_block(pfn >> order, order);
+        while (order > 0)
+        {
+            --order;
+            insert_block((pfn >> order) ^ 1, order);
+        }
     }
 }
 
 void PhysPageAllocator::mark_as_free(uintptr_t addr, size_t size)
 {
-    const size_t base_page = addr >> 12;
-    const size_t end_addr = addr + size;
-    const size_t end_page = (end_addr >> 12) + (end_addr&0xFFF?1:0);
+    size_t pfn = (uint64_t(addr) + 0xFFF) >> 12;
+    const size_t end_page = std::min<size_t>((uint64_t(addr) + size) >> 12, max_pages);
+
+    // free the zone as the largest aligned blocks possible
+    while (pfn < end_page)
+    {
+        size_t order = 0;
+        while (order < max_order && pfn % (2 << order) == 0 && pfn + (2 << order) <= end_page)
+        {
+            ++order;
+        }
+
+        if (free_block_order(pfn) == npos)
+        {
+            free_block(pfn, order);
+        }
+
+        pfn += 1 << order;
+    }
+}
 
-    for (size_t i { base_page }; i <= end_page; ++i)
+size_t PhysPageAllocator::free_pages()
+{
+    size_t pages { 0 };
+    for (size_t order { 0 }; order <= max_order; ++order)
     {
-        mem_bitmap[i] = false;
+        pages += free_block_count[order] << order;
     }
+
+    return pages;
 }
 
 void PhysPageAllocator::start_recording_allocs()
@@ -104,44 +272,31 @@ void PhysPageAllocator::stop_recording_allocs()
     recording = false;
 }
 
-uintptr_t PhysPageAllocator::find_free_page()
+size_t PhysPageAllocator::free_block_order(size_t pfn)
 {
-loop:
-    for (size_t i { last_pos }; i < mem_bitmap.array_size; ++i)
+    for (size_t order { 0 }; order <= max_order; ++order)
     {
-        if (!mem_bitmap[i])
+        if (free_blocks[order].test(pfn >> order))
         {
-            mem_bitmap[i] = true;
-            last_pos = i+1;
-            return i*Paging::page_size;
+            return order;
         }
     }
 
-    // Reloop from the start if not found
-    if (last_pos != 0)
-    {
-        last_pos = 0;
-        goto loop;
-    }
-
-    // Free essential memory
-    for (size_t i { 0 }; i < Paging::page_size; ++i)
-    {
-        mem_bitmap[i] = false;
-    }
-
-    log_serial("Out of memory\n");
-    panic("Out of memory !\n");
-
-    return 0;
+    return npos;
 }
 
-void PhysPageAllocator::clear_page(uintptr_t p_addr)
+void PhysPageAllocator::free_block(size_t pfn, size_t order)
 {
-    auto ptr = (void*)Paging::alloc_virtual_page();
-    Paging::map_page(p_addr, ptr, Memory::Read|Memory::Write);
+    // merge with the buddy as long as it is free too
+    while (order < max_order)
+    {
+        const size_t buddy = (pfn >> order) ^ 1;
+        if (!free_blocks[order].test(buddy)) break;
 
-    memsetl(ptr, fill_pattern, Paging::page_size);
+        remove_block(buddy, order);
+        pfn &= ~(size_t(1) << order);
+        ++order;
+    }
 
-    Paging::unmap_page(ptr);
+    insert_block(pfn >> order, order);
 }
@@ -27,23 +27,32 @@ SOFTWARE.
 
 #include <stdint.h>
 
-#include "utils/bitarray.hpp"
-
 #include "paging.hpp"
 
+// Buddy allocator : free memory is kept as naturally aligned blocks of 2^order pages
 class PhysPageAllocator
 {
     friend class Meminfo;
 
+public:
+    static constexpr size_t max_order { 10 }; // 4MB blocks
+    static constexpr size_t max_pages { 1024*1024 }; // 4GB of physical address space
+
 public:
     static void init();
 
     static uintptr_t alloc_physical_page();
     static bool release_physical_page(uintptr_t p_addr);
 
+    // allocates 2^order physically contiguous pages aligned on their size
+    static uintptr_t alloc_physical_pages(size_t order);
+    static bool release_physical_pages(uintptr_t p_addr, size_t order);
+
     static void mark_as_used(uintptr_t addr, size_t size);
     static void mark_as_free(uintptr_t addr, size_t size);
 
+    static size_t free_pages();
+
     static void start_recording_allocs();
     static void stop_recording_allocs();
 
@@ -52,12 +61,8 @@ public:
     static uintptr_t allocated_list[50000];
 
 private:
-    static uintptr_t find_free_page();
-    static void clear_page(uintptr_t p_addr);
-
-private:
-    static inline bitarray<1024*1024, uint32_t> mem_bitmap; // 0 = free / 1 = used
-    static inline size_t last_pos { 0 };
+    static size_t free_block_order(size_t pfn);
+    static void free_block(size_t pfn, size_t order);
 };
 
 #endif // PHYSALLOCATOR_HPP
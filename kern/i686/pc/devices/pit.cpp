@@ -31,12 +31,15 @@ SOFTWARE.
 #include "i686/interrupts/isr.hpp"
 #include "time/timer.hpp"
 #include "time/time.hpp"
+#include "tasking/scheduler.hpp"
 
 void PIT::init(uint32_t freq)
 {
     isr::register_handler(IRQ0, &irq_callback);
 
     Timer::m_set_frequency_callback = &set_frequency;
+    Timer::m_set_oneshot_callback = &set_oneshot;
+    Timer::m_max_oneshot = 0xFFFF * uint64_t(1000000) / 1193180; // ~55ms
 
     Timer::set_frequency(freq);
 
@@ -64,6 +67,17 @@ void PIT::set_frequency(uint32_t freq)
     outb(0x40, h);
 }
 
+void PIT::set_oneshot(uint32_t microseconds)
+{
+    const uint32_t count = std::clamp<uint64_t>(uint64_t(microseconds) * 1193180 / 1000000, 1, 0xFFFF);
+
+    // Mode 0 : interrupt on terminal count, only once
+    outb(0x43, 0x30);
+
+    outb(0x40, static_cast<uint8_t>(count & 0xFF));
+    outb(0x40, static_cast<uint8_t>((count>>8) & 0xFF));
+}
+
 void PIT::set_pcspeaker_frequency(uint16_t freq)
 {
     const uint16_t div = 1193180 / freq;
@@ -72,8 +86,12 @@ void PIT::set_pcspeaker_frequency(uint16_t freq)
     outb(0x42, static_cast<uint8_t>(div >> 8));
 }
 
-bool PIT::irq_callback(const registers * const)
+bool PIT::irq_callback(const registers * const regs)
 {
+    // no tick happened, the deadline is further away
+    if (Timer::continue_oneshot()) return true;
+
     Timer::irq_callback();
+    tasking::timer_tick(regs->cs & 0x3); // might not return if the current process is preempted
     return true;
 }
@@ -40,6 +40,9 @@ public:
 
     static void set_frequency(uint32_t freq);
 
+    // longest delay is about 55ms
+    static void set_oneshot(uint32_t microseconds);
+
     static void set_pcspeaker_frequency(uint16_t freq);
 };
 
@@ -31,6 +31,7 @@ SOFTWARE.
 #include "i686/pc/devices/pic.hpp"
 
 #include "utils/messagebus.hpp"
+#include "tasking/workqueue.hpp"
 #include "drivers/kbd/driver_kbd_event.hpp"
 #include "drivers/kbd/led_handler.hpp"
 #include "ps2controller.hpp"
@@ -54,6 +55,12 @@ enum PS2KeyboardCommands : uint8_t
     KeyboardResend = 0xFE
 };
 
+// the listeners, like the terminal, can take a while : they run out of the interrupt handler
+static void post_event(const DriverKbdEvent& event)
+{
+    tasking::defer([event]{ MessageBus::send(event); });
+}
+
 bool PS2Keyboard::accept()
 {
     // FIXME : do
@@ -145,11 +152,11 @@ bool PS2Keyboard::isr(const registers *)
         // TODO : inherit from keyboard driver and automatically set the kbd id
         if (last_is_e0 && e0_key_assocs[code] != 0xFF)
         {
-            MessageBus::send<DriverKbdEvent>({0, {e0_key_assocs[code]}, key_state});
+            post_event({0, {e0_key_assocs[code]}, key_state});
         }
         else if (key_assocs[code] != 0xFF)
         {
-            MessageBus::send<DriverKbdEvent>({0, {key_assocs[code]}, key_state});
+            post_event({0, {key_assocs[code]}, key_state});
         }
 
         last_is_e0 = false;
@@ -35,6 +35,7 @@ SOFTWARE.
 #include "ps2controller.hpp"
 #include "io.hpp"
 #include "utils/messagebus.hpp"
+#include "tasking/workqueue.hpp"
 
 #include "utils/logging.hpp"
 
@@ -123,9 +124,11 @@ bool PS2Mouse::isr(const registers *regs)
             !(packet.z == -8 && (static_cast<int16_t>(packet.y_sign-static_cast<int16_t>(packet.y)) == 90
                                  || static_cast<int16_t>(packet.y_sign-static_cast<int16_t>(packet.y)) == 91))) // it oftens indicate a broken packet, dunno why
     {
-        MessageBus::send<MousePacket>({static_cast<int16_t>(packet.x_sign-static_cast<int16_t>(packet.x)), static_cast<int16_t>(packet.y_sign-static_cast<int16_t>(packet.y)),
-                                       static_cast<int16_t>(packet.z), static_cast<bool>(packet.left_but), static_cast<bool>(packet.mid_but), static_cast<bool>(packet.right_but),
-                                       static_cast<bool>(packet.but_4), static_cast<bool>(packet.but_5)});
+        const MousePacket event {static_cast<int16_t>(packet.x_sign-static_cast<int16_t>(packet.x)), static_cast<int16_t>(packet.y_sign-static_cast<int16_t>(packet.y)),
+                                 static_cast<int16_t>(packet.z), static_cast<bool>(packet.left_but), static_cast<bool>(packet.mid_but), static_cast<bool>(packet.right_but),
+                                 static_cast<bool>(packet.but_4), static_cast<bool>(packet.but_5)};
+        // the listeners run out of the interrupt handler
+        tasking::defer([event]{ MessageBus::send(event); });
     }
 
     return true;
@@ -46,7 +46,7 @@ Speaker::Speaker()
 void Speaker::beep_(uint32_t time, uint16_t freq)
 {
     play_sound(freq);
-    Timer::register_callback(time, [this]{stop();});
+    Timer::register_hr_callback(time * 1000, [this]{stop();});
 }
 
 void Speaker::play_sound(uint16_t freq)
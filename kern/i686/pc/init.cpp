@@ -39,6 +39,7 @@ SOFTWARE.
 #include "i686/interrupts/isr.hpp"
 #include "i686/cpu/cpuinfo.hpp"
 #include "i686/cpu/mtrr.hpp"
+#include "i686/cpu/lapic.hpp"
 #include "i686/simd/simd.hpp"
 #include "i686/cpu/cpuid.hpp"
 #include "i686/pc/terminal/textterminal.hpp"
@@ -46,6 +47,7 @@ SOFTWARE.
 #include "i686/gdt/gdt.hpp"
 #include "i686/video/x86emu_modesetting.hpp"
 #include "i686/mem/paging.hpp"
+#include "i686/smp/smp.hpp"
 #include "smbios/smbios.hpp"
 #include "mem/meminfo.hpp"
 #include "bios/bda.hpp"
@@ -179,6 +181,7 @@ void init(uint32_t magic, const multiboot_info_t* mbd_info)
 
     multiboot::parse_mem();
     MultibootMeminfo::init_alloc_bitmap();
+    Paging::create_physmap(MultibootMeminfo::ram_end());
 
     uint64_t framebuffer_addr = bit_check(mbd_info->flags, 12) ? mbd_info->framebuffer_addr : 0xB8000;
 
@@ -254,6 +257,9 @@ void init(uint32_t magic, const multiboot_info_t* mbd_info)
         mtrr::set_fixed_mtrrs_enabled(false);
     }
 
+    lapic::init();
+    smp::init();
+
     init_emu_mem();
 
 #if USES_ACPICA
@@ -25,6 +25,8 @@ SOFTWARE.
 
 #include "mbmeminfo.hpp"
 
+#include <algorithm.hpp>
+
 #include "i686/pc/multiboot/multiboot.h"
 #include "i686/mem/physallocator.hpp"
 
@@ -109,6 +111,19 @@ size_t MultibootMeminfo::total_memory()
     return total;
 }
 
+uint64_t MultibootMeminfo::ram_end()
+{
+    uint64_t end = 0;
+
+    for (size_t i { 0 }; i < free_frames(); ++i)
+    {
+        auto free_frame = frame(i);
+        if (free_frame) end = std::max<uint64_t>(end, free_frame->addr + free_frame->len);
+    }
+
+    return end;
+}
+
 void MultibootMeminfo::init_alloc_bitmap()
 {
     PhysPageAllocator::init();
@@ -47,6 +47,7 @@ public:
     static multiboot_memory_map_t *frame(size_t idx);
 
     static size_t total_memory();
+    static uint64_t ram_end();
 
     static void init_alloc_bitmap();
 
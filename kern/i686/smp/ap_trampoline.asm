@@ -0,0 +1,72 @@
+global ap_trampoline_start
+global ap_trampoline_end
+global ap_trampoline_data
+
+extern ap_main
+
+; Application processors start in real mode at AP_TRAMPOLINE_BASE, where this code is copied to.
+; They switch to protected mode, enable paging using the kernel page directory (which identity maps
+; the trampoline page during the startup) and jump to ap_main on the stack they were given.
+
+AP_TRAMPOLINE_BASE equ 0x8000 ; keep in sync with smp.cpp
+
+%define TRAMPOLINE_ADDR(x) ((x) - ap_trampoline_start + AP_TRAMPOLINE_BASE)
+
+bits 16
+ap_trampoline_start:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+
+    lgdt [TRAMPOLINE_ADDR(trampoline_gdt_ptr)]
+
+    mov eax, cr0
+    or eax, 1 ; protected mode
+    mov cr0, eax
+
+    jmp dword 0x08:TRAMPOLINE_ADDR(protected_mode_start)
+
+bits 32
+protected_mode_start:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    mov eax, [TRAMPOLINE_ADDR(ap_trampoline_data.cr4)] ; 4MB and global pages, like the bootstrap processor
+    mov cr4, eax
+    mov eax, [TRAMPOLINE_ADDR(ap_trampoline_data.cr3)]
+    mov cr3, eax
+
+    mov eax, cr0
+    or eax, 0x80000000 ; paging
+    mov cr0, eax
+
+    mov esp, [TRAMPOLINE_ADDR(ap_trampoline_data.stack)]
+    mov eax, ap_main ; higher half address
+    call eax ; never returns
+
+.hang:
+    hlt
+    jmp .hang
+
+align 8
+trampoline_gdt:
+    dq 0x0000000000000000
+    dq 0x00CF9A000000FFFF ; flat code
+    dq 0x00CF92000000FFFF ; flat data
+trampoline_gdt_ptr:
+    dw trampoline_gdt_ptr - trampoline_gdt - 1
+    dd TRAMPOLINE_ADDR(trampoline_gdt)
+
+; filled by the bootstrap processor before starting each application processor
+align 4
+ap_trampoline_data:
+.cr3:   dd 0
+.cr4:   dd 0
+.stack: dd 0
+
+ap_trampoline_end:
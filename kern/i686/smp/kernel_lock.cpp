@@ -0,0 +1,112 @@
+/*
+kernel_lock.cpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "kernel_lock.hpp"
+
+#include "smp.hpp"
+
+#include <assert.h>
+
+#include "i686/interrupts/interrupts.hpp"
+
+namespace smp
+{
+
+KernelLock kernel_lock;
+
+void KernelLock::lock()
+{
+    const int cpu = cpu_index();
+    if (m_owner == cpu)
+    {
+        ++m_depth;
+        return;
+    }
+
+    const bool enabled = interrupts_enabled();
+    while (!__sync_bool_compare_and_swap(&m_owner, -1, cpu))
+    {
+        // the owner might be waiting for us to flush our TLB or to give up our process,
+        // or for a device interrupt we have to forward to it
+        handle_requests();
+        sti();
+        asm volatile ("pause");
+        cli();
+    }
+    if (enabled) sti();
+    __sync_synchronize();
+
+    m_depth = 1;
+}
+
+bool KernelLock::try_lock()
+{
+    const int cpu = cpu_index();
+    if (m_owner == cpu)
+    {
+        ++m_depth;
+        return true;
+    }
+
+    if (!__sync_bool_compare_and_swap(&m_owner, -1, cpu)) return false;
+    __sync_synchronize();
+
+    m_depth = 1;
+    return true;
+}
+
+void KernelLock::unlock()
+{
+    assert(held() && m_depth > 0);
+
+    if (--m_depth == 0)
+    {
+        __sync_synchronize();
+        m_owner = -1;
+    }
+}
+
+void KernelLock::unlock_all()
+{
+    if (!held()) return;
+
+    m_depth = 0;
+    __sync_synchronize();
+    m_owner = -1;
+}
+
+void KernelLock::set_depth(size_t depth)
+{
+    assert(held() && depth > 0);
+
+    m_depth = depth;
+}
+
+bool KernelLock::held() const
+{
+    return m_owner == int(cpu_index());
+}
+
+}
@@ -0,0 +1,61 @@
+/*
+kernel_lock.hpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef KERNEL_LOCK_HPP
+#define KERNEL_LOCK_HPP
+
+#include <stddef.h>
+
+namespace smp
+{
+
+// The kernel isn't reentrant : it runs on one CPU at a time, while user code runs on all of them.
+// The lock is recursive, as interrupts taken while in the kernel enter it again.
+class KernelLock
+{
+public:
+    void lock();
+    bool try_lock();
+    void unlock();
+    // releases the lock whatever the nesting depth, when leaving the kernel for good or idling
+    void unlock_all();
+
+    bool held() const;
+    // a process suspended in the kernel gets back the nesting depth it had when it was switched out
+    size_t depth() const { return m_depth; }
+    void set_depth(size_t depth);
+    // CPU holding the lock, -1 if none
+    int owner() const { return m_owner; }
+
+private:
+    // held by the bootstrap processor during the kernel initialization, until the first process starts
+    volatile int m_owner { 0 };
+    size_t m_depth { 1 };
+};
+
+extern KernelLock kernel_lock;
+
+}
+
+#endif // KERNEL_LOCK_HPP
@@ -0,0 +1,194 @@
+/*
+madt.cpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "madt.hpp"
+
+#include <string.h>
+
+#include <algorithm.hpp>
+#include <optional.hpp>
+
+#include "mem/memmap.hpp"
+#include "utils/logging.hpp"
+
+namespace madt
+{
+
+namespace
+{
+
+struct [[gnu::packed]] RSDP
+{
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_address;
+};
+
+struct [[gnu::packed]] SDTHeader
+{
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+};
+
+struct [[gnu::packed]] MADTHeader
+{
+    SDTHeader header;
+    uint32_t lapic_address;
+    uint32_t flags;
+};
+
+struct [[gnu::packed]] MADTEntry
+{
+    uint8_t type;
+    uint8_t length;
+};
+
+struct [[gnu::packed]] MADTLocalAPIC
+{
+    MADTEntry entry;
+    uint8_t acpi_id;
+    uint8_t apic_id;
+    uint32_t flags;
+};
+
+constexpr uint8_t local_apic_entry { 0 };
+constexpr uint32_t processor_enabled { 1 << 0 };
+
+bool valid_checksum(const uint8_t* data, size_t len)
+{
+    uint8_t sum { 0 };
+    for (size_t i { 0 }; i < len; ++i)
+    {
+        sum += data[i];
+    }
+
+    return sum == 0;
+}
+
+// the RSDP lies on a 16-byte boundary in the first KB of the EBDA or in the BIOS area
+kpp::optional<uint32_t> search_rsdp(uintptr_t base, size_t len)
+{
+    auto area = reinterpret_cast<const uint8_t*>(Memory::mmap(base, len, Memory::Read));
+    kpp::optional<uint32_t> rsdt;
+
+    for (size_t offset { 0 }; offset + sizeof(RSDP) <= len; offset += 16)
+    {
+        if (memcmp(area + offset, "RSD PTR ", 8) == 0 && valid_checksum(area + offset, sizeof(RSDP)))
+        {
+            rsdt = reinterpret_cast<const RSDP*>(area + offset)->rsdt_address;
+            break;
+        }
+    }
+
+    Memory::unmap(const_cast<uint8_t*>(area), len);
+
+    return rsdt;
+}
+
+kpp::optional<uint32_t> find_rsdt()
+{
+    uint16_t ebda_segment;
+    Memory::phys_read(0x40E, &ebda_segment, sizeof(ebda_segment));
+
+    if (ebda_segment)
+    {
+        if (auto rsdt = search_rsdp(uintptr_t(ebda_segment) << 4, 0x400)) return rsdt;
+    }
+
+    return search_rsdp(0xE0000, 0x20000);
+}
+
+std::vector<uint8_t> read_table(uintptr_t addr)
+{
+    SDTHeader header;
+    Memory::phys_read(addr, &header, sizeof(header));
+
+    std::vector<uint8_t> table(std::max<size_t>(header.length, sizeof(header)));
+    Memory::phys_read(addr, table.data(), table.size());
+
+    if (!valid_checksum(table.data(), table.size())) return {};
+
+    return table;
+}
+
+}
+
+std::vector<uint8_t> processors()
+{
+    std::vector<uint8_t> ids;
+
+    auto rsdt_addr = find_rsdt();
+    if (!rsdt_addr)
+    {
+        log(Info, "No ACPI tables found\n");
+        return ids;
+    }
+
+    auto rsdt = read_table(*rsdt_addr);
+    if (rsdt.empty()) return ids;
+
+    const size_t entries = (rsdt.size() - sizeof(SDTHeader)) / sizeof(uint32_t);
+    for (size_t i { 0 }; i < entries; ++i)
+    {
+        uint32_t table_addr;
+        memcpy(&table_addr, rsdt.data() + sizeof(SDTHeader) + i*sizeof(uint32_t), sizeof(table_addr));
+
+        SDTHeader header;
+        Memory::phys_read(table_addr, &header, sizeof(header));
+        if (memcmp(header.signature, "APIC", 4) != 0) continue;
+
+        auto madt = read_table(table_addr);
+        if (madt.size() < sizeof(MADTHeader)) return ids;
+
+        for (size_t offset { sizeof(MADTHeader) }; offset + sizeof(MADTEntry) <= madt.size();)
+        {
+            auto entry = reinterpret_cast<const MADTEntry*>(madt.data() + offset);
+            if (entry->length < sizeof(MADTEntry)) break;
+
+            if (entry->type == local_apic_entry && entry->length >= sizeof(MADTLocalAPIC))
+            {
+                auto lapic = reinterpret_cast<const MADTLocalAPIC*>(entry);
+                if (lapic->flags & processor_enabled) ids.emplace_back(lapic->apic_id);
+            }
+
+            offset += entry->length;
+        }
+
+        break;
+    }
+
+    return ids;
+}
+
+}
@@ -0,0 +1,76 @@
+/*
+percpu.hpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef PERCPU_HPP
+#define PERCPU_HPP
+
+#include <stddef.h>
+
+#include <array.hpp>
+
+#include "i686/gdt/gdt.hpp"
+
+namespace smp
+{
+
+constexpr size_t max_cpus { gdt::tss_count };
+
+// every CPU loads its own TSS, so the task register tells which one we are running on
+inline size_t cpu_index()
+{
+    return gdt::current_tss();
+}
+
+// one instance of T for each CPU, accessing it from a CPU gives that CPU's instance
+template <typename T>
+class PerCPU
+{
+public:
+    PerCPU() = default;
+    PerCPU(const T& value)
+    {
+        m_data.fill(value);
+    }
+
+    T& get() { return m_data[cpu_index()]; }
+    const T& get() const { return m_data[cpu_index()]; }
+
+    PerCPU& operator=(const T& value)
+    {
+        get() = value;
+        return *this;
+    }
+    operator T&() { return get(); }
+    operator const T&() const { return get(); }
+
+    T& on(size_t cpu) { return m_data[cpu]; }
+    const T& on(size_t cpu) const { return m_data[cpu]; }
+
+private:
+    kpp::array<T, max_cpus> m_data {};
+};
+
+}
+
+#endif // PERCPU_HPP
@@ -0,0 +1,444 @@
+/*
+smp.cpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "smp.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <vector.hpp>
+
+#include "madt.hpp"
+
+#include "i686/cpu/lapic.hpp"
+#include "i686/fpu/fpu.hpp"
+#include "i686/gdt/gdt.hpp"
+#include "i686/interrupts/idt.hpp"
+#include "i686/interrupts/isr.hpp"
+#include "i686/interrupts/interrupts.hpp"
+#include "i686/mem/paging.hpp"
+#include "i686/pc/devices/pic.hpp"
+#include "i686/simd/simd.hpp"
+#include "i686/syscalls/sysenter.hpp"
+#include "i686/tasking/process.hpp"
+#include "tasking/scheduler.hpp"
+#include "time/timer.hpp"
+#include "mem/memmap.hpp"
+#include "utils/logging.hpp"
+#include "halt.hpp"
+
+extern "C" uint8_t ap_trampoline_start[];
+extern "C" uint8_t ap_trampoline_end[];
+extern "C" uint8_t ap_trampoline_data[];
+
+namespace smp
+{
+
+namespace
+{
+
+constexpr uintptr_t ap_trampoline_base { 0x8000 }; // keep in sync with ap_trampoline.asm
+constexpr size_t ap_stack_size { 0x4000 };
+constexpr size_t legacy_irqs { 16 };
+constexpr uint32_t hrtimer_retry_us { 50 };
+
+struct [[gnu::packed]] TrampolineData
+{
+    uint32_t cr3;
+    uint32_t cr4;
+    uint32_t stack;
+};
+
+kpp::array<CPU, max_cpus> cpus;
+size_t online_count { 1 };
+
+struct
+{
+    void (*func)(void*) { nullptr };
+    void* arg { nullptr };
+} pending_call;
+
+// device interrupts received while another CPU held the kernel lock, run by that CPU
+kpp::array<volatile uint32_t, legacy_irqs> pending_irqs {};
+kpp::array<registers, legacy_irqs> pending_irq_regs {};
+volatile uint32_t masked_irqs { 0 };
+
+void wait_ms(uint32_t ms)
+{
+    const uint32_t start = Timer::ticks();
+    while ((Timer::ticks() - start) * 1000 < ms * Timer::freq()) { wait_for_interrupts(); }
+}
+
+bool start_ap(size_t index)
+{
+    auto& cpu = cpus[index];
+
+    cpu.kernel_stack = reinterpret_cast<uintptr_t>(kmalloc_align(ap_stack_size, 16)) + ap_stack_size;
+    gdt::init_tss(index, cpu.kernel_stack);
+
+    TrampolineData data;
+    data.cr3 = Paging::kernel_info().directory_phys;
+    data.cr4 = cr4();
+    data.stack = cpu.kernel_stack;
+    Memory::phys_write(ap_trampoline_base + (ap_trampoline_data - ap_trampoline_start), &data, sizeof(data));
+
+    // INIT, then STARTUP twice if needed, as in the MultiProcessor specification
+    lapic::send_init(cpu.apic_id);
+    wait_ms(10);
+    for (size_t attempt { 0 }; attempt < 2 && !cpu.online; ++attempt)
+    {
+        lapic::send_startup(cpu.apic_id, ap_trampoline_base >> 12);
+
+        const uint32_t start = Timer::ticks();
+        while (!cpu.online && (Timer::ticks() - start) * 1000 < 100 * Timer::freq()) { wait_for_interrupts(); }
+    }
+
+    return cpu.online;
+}
+
+void run_pending_irqs()
+{
+    for (size_t line { 0 }; line < legacy_irqs; ++line)
+    {
+        while (pending_irqs[line])
+        {
+            __sync_fetch_and_sub(&pending_irqs[line], 1);
+
+            // the handler runs in the middle of our kernel code, whatever the other CPU was running
+            registers regs = pending_irq_regs[line];
+            regs.cs = gdt::kernel_code_selector * sizeof(gdt::entry);
+            isr::call_handler(&regs);
+        }
+
+        if (masked_irqs & (1u << line))
+        {
+            __sync_fetch_and_and(&masked_irqs, ~(1u << line));
+            pic::clear_mask(line);
+        }
+    }
+}
+
+void forward_irq(const registers* regs, int owner)
+{
+    const size_t line = regs->int_no - IRQ0;
+    assert(line < legacy_irqs);
+
+    pending_irq_regs[line] = *regs;
+    __sync_fetch_and_add(&pending_irqs[line], 1);
+
+    // level-triggered lines would fire again until the handler runs
+    if (!(__sync_fetch_and_or(&masked_irqs, 1u << line) & (1u << line))) pic::set_mask(line);
+
+    lapic::send_ipi(cpus[owner].apic_id, irq_vector);
+}
+
+// runs on the CPU stack once the process was given up, its kernel stack is free to be used by the CPU resuming it
+[[noreturn]] void schedule_after_preempt()
+{
+    __sync_synchronize();
+    current_cpu().preempt_request = false;
+
+    kernel_lock.lock();
+    tasking::schedule();
+    panic("schedule() returned after a preemption\n");
+}
+
+}
+
+void init()
+{
+    cpus[0].apic_id = lapic::id();
+    cpus[0].online = true;
+    // processes have their own kernel stack, this one is used to schedule
+    cpus[0].kernel_stack = reinterpret_cast<uintptr_t>(kmalloc_align(ap_stack_size, 16)) + ap_stack_size;
+
+    if (!lapic::enabled()) return;
+
+    auto apic_ids = madt::processors();
+    if (apic_ids.size() <= 1)
+    {
+        log(Info, "Single processor system\n");
+        return;
+    }
+
+    isr::register_handler(lapic::timer_vector, [](const registers* const regs)
+    {
+        tasking::timer_tick(regs->cs & 0x3); // might not return if the current process is preempted
+        return true;
+    });
+
+    // the trampoline must be below 1MB, save what was there as the bootloader might have left something
+    std::vector<uint8_t> saved_page(Memory::page_size());
+    Memory::phys_read(ap_trampoline_base, saved_page.data(), saved_page.size());
+    Memory::phys_write(ap_trampoline_base, ap_trampoline_start, ap_trampoline_end - ap_trampoline_start);
+    // identity mapped in the kernel page directory, as paging gets enabled while running it
+    Paging::map_page(Paging::kernel_info(), ap_trampoline_base, reinterpret_cast<void*>(ap_trampoline_base));
+
+    for (auto id : apic_ids)
+    {
+        if (id == cpus[0].apic_id) continue;
+        if (online_count == max_cpus)
+        {
+            warn("Only %d CPUs are supported\n", max_cpus);
+            break;
+        }
+
+        cpus[online_count].apic_id = id;
+        if (start_ap(online_count))
+        {
+            log(Info, "CPU %d (APIC ID %d) started\n", online_count, id);
+            ++online_count;
+        }
+        else
+        {
+            warn("CPU with APIC ID %d didn't start\n", id);
+            cpus[online_count] = CPU{};
+        }
+    }
+
+    Paging::unmap_page(Paging::kernel_info(), reinterpret_cast<void*>(ap_trampoline_base));
+    Memory::phys_write(ap_trampoline_base, saved_page.data(), saved_page.size());
+
+    log(Info, "%d CPUs online\n", online_count);
+}
+
+size_t cpu_count()
+{
+    return online_count;
+}
+
+CPU &cpu(size_t index)
+{
+    assert(index < max_cpus);
+    return cpus[index];
+}
+
+uint32_t other_cpus()
+{
+    const size_t self = cpu_index();
+    uint32_t mask { 0 };
+    for (size_t i { 0 }; i < online_count; ++i)
+    {
+        if (i != self && cpus[i].online) mask |= 1u << i;
+    }
+
+    return mask;
+}
+
+void call_on_others(uint32_t cpu_mask, void (*func)(void *), void *arg)
+{
+    cpu_mask &= other_cpus();
+    if (!cpu_mask) return;
+
+    assert(kernel_lock.held());
+
+    pending_call.func = func;
+    pending_call.arg = arg;
+    __sync_synchronize();
+
+    for (size_t i { 0 }; i < online_count; ++i)
+    {
+        if (!(cpu_mask & (1u << i))) continue;
+
+        cpus[i].call_pending = true;
+        lapic::send_ipi(cpus[i].apic_id, call_vector);
+    }
+
+    for (size_t i { 0 }; i < online_count; ++i)
+    {
+        while (cpus[i].call_pending) { asm volatile ("pause"); }
+    }
+}
+
+void send_reschedule(size_t index)
+{
+    if (index != cpu_index() && cpus[index].online)
+    {
+        lapic::send_ipi(cpus[index].apic_id, reschedule_vector);
+    }
+}
+
+void stop_local_tick()
+{
+    if (cpu_index() != 0) lapic::stop_timer();
+}
+
+void start_local_tick()
+{
+    if (cpu_index() != 0) lapic::start_timer(Timer::freq());
+}
+
+void preempt(size_t index)
+{
+    assert(kernel_lock.held() && index != cpu_index());
+
+    cpus[index].preempt_request = true;
+    __sync_synchronize();
+    lapic::send_ipi(cpus[index].apic_id, preempt_vector);
+
+    while (cpus[index].preempt_request) { asm volatile ("pause"); }
+}
+
+void handle_requests()
+{
+    InterruptLock lock;
+
+    auto& cpu = current_cpu();
+
+    if (cpu.call_pending)
+    {
+        pending_call.func(pending_call.arg);
+        __sync_synchronize();
+        cpu.call_pending = false;
+    }
+
+    if (cpu.preempt_request)
+    {
+        if (Process::enabled())
+        {
+            // we aren't at a point where the process can be given up yet, the kernel entry will do it
+            if (!cpu.entry_regs) return;
+
+            auto& proc = Process::current();
+            proc.arch_context->regs = *cpu.entry_regs;
+            // run the syscall instruction again when the process is resumed
+            if (cpu.entry_syscall) proc.arch_context->regs.eip -= syscall_restart_size(*cpu.entry_regs);
+            proc.unswitch();
+
+            cpu.entry_regs = nullptr;
+            Process::run_on_cpu_stack(&schedule_after_preempt);
+        }
+
+        __sync_synchronize();
+        cpu.preempt_request = false;
+    }
+}
+
+bool is_ipi(uint8_t vector)
+{
+    return vector == reschedule_vector || vector == preempt_vector ||
+           vector == call_vector || vector == irq_vector;
+}
+
+void handle_ipi(const registers *regs)
+{
+    auto& cpu = current_cpu();
+    const bool user = regs->cs & 0x3;
+
+    if (regs->int_no == irq_vector)
+    {
+        enter_kernel(regs, false);
+        if (user) Process::current().arch_context->regs = *regs;
+        run_pending_irqs();
+        leave_kernel();
+        return;
+    }
+
+    // reschedule_vector only had to wake us up
+    if (user)
+    {
+        cpu.entry_regs = regs;
+        cpu.entry_syscall = false;
+    }
+    handle_requests();
+    if (user) cpu.entry_regs = nullptr;
+
+    if (user && tasking::need_resched())
+    {
+        enter_kernel(regs, false);
+        Process::current().arch_context->regs = *regs;
+        tasking::schedule();
+    }
+}
+
+void enter_kernel(const registers *regs, bool syscall)
+{
+    auto& cpu = current_cpu();
+    const bool user = regs->cs & 0x3;
+
+    if (user)
+    {
+        cpu.entry_regs = regs;
+        cpu.entry_syscall = syscall;
+    }
+
+    kernel_lock.lock();
+
+    if (user) cpu.entry_regs = nullptr;
+}
+
+bool enter_irq(const registers *regs)
+{
+    while (!kernel_lock.try_lock())
+    {
+        const int owner = kernel_lock.owner();
+        if (owner == -1) continue; // just released
+
+        if (regs->int_no >= IRQ0 && regs->int_no < IRQ0 + legacy_irqs) forward_irq(regs, owner);
+        // the one-shot timer won't fire again by itself
+        else if (regs->int_no == lapic::hrtimer_vector) lapic::start_oneshot(hrtimer_retry_us, lapic::hrtimer_vector);
+        // the local APIC timer only matters to this CPU, it can skip a tick
+        return false;
+    }
+
+    return true;
+}
+
+void leave_kernel()
+{
+    kernel_lock.unlock();
+}
+
+}
+
+#pragma GCC push_options
+#pragma GCC target ("no-sse")
+extern "C" [[noreturn]] void ap_main()
+{
+    // SSE has to be enabled before running any compiler generated code
+    if (simd_features() & SSE) enable_sse();
+
+    // the bootstrap processor waits for us before starting the next one
+    size_t index { 1 };
+    while (smp::cpu(index).online || smp::cpu(index).apic_id != lapic::id()) ++index;
+
+    gdt::flush();
+    gdt::load_tss(index);
+    idt::load();
+
+    FPU::init_ap();
+    Paging::init_ap();
+    lapic::init_ap();
+    sysenter::init();
+
+    smp::cpu(index).online = true;
+
+    // the bootstrap processor holds the lock until the first process starts
+    smp::kernel_lock.lock();
+    smp::start_local_tick();
+    tasking::schedule();
+}
+#pragma GCC pop_options
@@ -0,0 +1,99 @@
+/*
+smp.hpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef SMP_HPP
+#define SMP_HPP
+
+#include <stdint.h>
+
+#include "percpu.hpp"
+#include "kernel_lock.hpp"
+
+#include "i686/cpu/registers.hpp"
+
+namespace smp
+{
+
+constexpr uint8_t reschedule_vector { 0xF1 }; // wakes up an idle CPU which got something to run
+constexpr uint8_t preempt_vector    { 0xF2 }; // makes a CPU give up the process it runs
+constexpr uint8_t call_vector       { 0xF3 }; // runs a function on a CPU, see call_on_others
+constexpr uint8_t irq_vector        { 0xF4 }; // runs the device interrupts another CPU received while we held the kernel lock
+
+struct CPU
+{
+    uint8_t apic_id { 0 };
+    volatile bool online { false };
+    uintptr_t kernel_stack { 0 }; // top of the stack used to schedule, processes have their own kernel stack
+
+    // user registers of the kernel entry waiting for the kernel lock, nullptr if there is none
+    const registers* entry_regs { nullptr };
+    bool entry_syscall { false };
+
+    volatile bool preempt_request { false };
+    volatile bool call_pending { false };
+};
+
+// detects the processors and starts the application processors, which wait for the first process to start
+void init();
+
+size_t cpu_count();
+CPU& cpu(size_t index);
+inline CPU& current_cpu()
+{
+    return cpu(cpu_index());
+}
+
+// bitmask of the online CPUs but this one
+uint32_t other_cpus();
+
+// runs func(arg) on each CPU of cpu_mask and returns once they all did, the caller must hold the kernel lock
+// func runs with interrupts disabled and without the kernel lock, so it must only touch per-CPU state
+void call_on_others(uint32_t cpu_mask, void (*func)(void*), void* arg);
+
+// wakes up an idle CPU
+void send_reschedule(size_t index);
+
+// the local APIC timer of an application processor only preempts its processes, it's stopped while the CPU idles
+void stop_local_tick();
+void start_local_tick();
+
+// makes another CPU stop running its process and returns once it did, the caller must hold the kernel lock
+void preempt(size_t index);
+
+// serves the requests of the CPU holding the kernel lock, called while waiting for it
+void handle_requests();
+bool is_ipi(uint8_t vector);
+void handle_ipi(const registers* regs);
+
+// called on every exception and syscall. If the process of this CPU is given to another one while waiting
+// for the kernel lock, the kernel entry is dropped and this CPU schedules : it doesn't return then
+void enter_kernel(const registers* regs, bool syscall);
+// called on hardware interrupts, which mustn't wait for the kernel lock : its owner might be waiting for them.
+// Returns false if the lock is held by another CPU, device interrupts are then run by that CPU.
+bool enter_irq(const registers* regs);
+void leave_kernel();
+
+}
+
+#endif // SMP_HPP
@@ -0,0 +1,73 @@
+/*
+clone.cpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "i686/syscalls/syscall.hpp"
+#include "i686/syscalls/sysenter.hpp"
+
+#include "tasking/process.hpp"
+#include "tasking/process_data.hpp"
+#include "i686/tasking/process.hpp"
+#include "tasking/scheduler.hpp"
+
+#include <sys/thread.h>
+
+#include "errno.h"
+
+pid_t sys_clone(unsigned long flags, uintptr_t newsp, user_ptr<pid_t> ptid, uintptr_t tls, user_ptr<pid_t> ctid)
+{
+    constexpr unsigned long supported = CLONE_THREAD_FLAGS|CLONE_PARENT_SETTID|CLONE_CHILD_CLEARTID;
+
+    // the low byte is the signal sent to the parent on exit, which isn't supported yet, and there is no TLS either
+    if ((flags & ~0xFFul) & ~supported) return -EINVAL;
+
+    // same rules as Linux : a thread shares the signal handlers of its process, which only make sense in the same memory
+    if ((flags & CLONE_THREAD) && !(flags & CLONE_SIGHAND)) return -EINVAL;
+    if ((flags & CLONE_SIGHAND) && !(flags & CLONE_VM)) return -EINVAL;
+    // both would run on the same stack
+    if ((flags & CLONE_VM) && !newsp) return -EINVAL;
+
+    auto& current = Process::current();
+    current.save_user_context();
+
+    // the sysenter gate returns through the user stack it was called with, which the child doesn't have
+    if (newsp && current.arch_context->regs.err_code == sysenter::frame_marker) return -EINVAL;
+
+    if ((flags & CLONE_PARENT_SETTID) && !ptid.check()) return -EFAULT;
+    if ((flags & CLONE_CHILD_CLEARTID) && !ctid.check()) return -EFAULT;
+
+    auto child = Process::clone(current, flags);
+    if (!child) return -ENOMEM;
+
+    child->arch_context->regs.eax = 0; // return zero in the child
+    if (newsp) child->arch_context->regs.esp = newsp;
+    child->set_instruction_pointer(current.arch_context->regs.eip);
+
+    if (flags & CLONE_CHILD_CLEARTID) child->data->clear_child_tid = ctid.as_raw();
+    if (flags & CLONE_PARENT_SETTID) *ptid.get() = child->pid;
+
+    tasking::make_ready(*child);
+
+    return child->pid;
+}
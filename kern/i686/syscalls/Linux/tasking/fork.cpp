@@ -27,6 +27,7 @@ SOFTWARE.
 
 #include "tasking/process.hpp"
 #include "i686/tasking/process.hpp"
+#include "tasking/scheduler.hpp"
 
 #include "errno.h"
 
@@ -36,7 +37,8 @@ pid_t sys_fork()
     if (!child) return -ENOMEM;
 
     child->arch_context->regs.eax = 0; // return zero in the child
-    child->set_instruction_pointer(Process::current().arch_context->regs.eip);
+    child->set_instruction_pointer(Process::current().arch_context->regs.eip); // saved by clone()
+    tasking::make_ready(*child);
 
     return child->pid;
 }
@@ -31,6 +31,7 @@ SOFTWARE.
 
 void sys_panic(user_ptr<const char> string)
 {
+    Process::current().save_user_context();
     panic_regs = &Process::current().arch_context->regs;
     if (string.check())
         panic("%s", string.get());
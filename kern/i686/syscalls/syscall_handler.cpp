@@ -29,14 +29,22 @@ SOFTWARE.
 #include "errno.h"
 
 #include "i686/tasking/process.hpp"
+#include "i686/interrupts/interrupts.hpp"
+#include "i686/smp/smp.hpp"
+#include "tasking/scheduler.hpp"
 #include "utils/align.hpp"
 
 extern "C" const registers* __attribute__((force_align_arg_pointer)) syscall_handler(registers* const regs)
 {
+    // our process was handed over to another CPU while we waited for the kernel lock, the syscall is restarted there
+    smp::enter_kernel(regs, true);
+
     auto& process = Process::current();
 
-    process.arch_context->regs = *regs;
-    process.arch_context->fpu_state = FPU::save();
+    // only a pointer : most syscalls never need the saved context, see Process::save_user_context
+    process.arch_context->syscall_frame = regs;
+    // the process' FPU state stays in the registers unless the kernel uses them
+    FPU::switch_to(nullptr);
 
     uint32_t ret = ENOSYS;
 
@@ -51,8 +59,18 @@ extern "C" const registers* __attribute__((force_align_arg_pointer)) syscall_han
     ret = table[regs->eax].ptr(regs);
 
 exit:
-    FPU::load(process.arch_context->fpu_state);
+    FPU::switch_to(&process.arch_context->fpu_state);
     regs->eax = ret;
 
+    // killed while it was blocked in the syscall
+    if (Process::enabled()) Process::current().check_pending_kill();
+
+    // schedule() saves the frame holding the return value
+    if (tasking::need_resched()) tasking::schedule();
+
+    process.arch_context->syscall_frame = nullptr;
+
+    cli();
+    smp::leave_kernel();
     return regs;
 }
@@ -24,8 +24,10 @@ SOFTWARE.
 */
 
 #include "syscall_table_init.hpp"
+#include "sysenter.hpp"
 
 void init_syscalls()
 {
     init_syscall_table();
+    sysenter::init();
 }
@@ -0,0 +1,71 @@
+global sysenter_entry
+
+extern sysenter_handler
+
+; The CPU only loaded cs, eip, ss and esp : build the frame of an interrupt gate, so that the syscall
+; can be handled like 'int 0x80'. sysenter_handler fills eip and the interrupt number from the user stack,
+; ebp points to it, see the sysenter gates of the libc.
+; Only eax and the argument registers are saved. The user data segments are flat like the kernel's, so they
+; stay loaded : their slots only get the user selector, for when the frame is copied to the saved context.
+sysenter_entry:
+    push dword 0x23             ; user ss
+    push ebp                    ; user esp
+    pushfd
+    or dword [esp], 0x200       ; interrupts are enabled in user mode
+    push dword 0x1B             ; user cs
+    push dword 0                ; eip
+    push dword 1                ; error code, tells a sysenter frame apart
+    push dword 0                ; interrupt number
+
+    push edi
+    push esi
+    push ebp
+    push ebx
+    push edx
+    push ecx
+    push eax
+
+    push dword 0x23             ; ds, es, fs and gs
+    push dword 0x23
+    push dword 0x23
+    push dword 0x23
+
+    push esp
+
+    sti
+
+    call sysenter_handler
+
+    mov esp, eax
+
+    ; the kernel code we were suspended in may have been resumed with the kernel selectors loaded,
+    ; which are all set together
+    mov ax, ds
+    cmp ax, 0x23
+    je .user_segments
+    mov ax, 0x23
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+.user_segments:
+    add esp, 16
+
+    pop eax
+    pop ecx
+    pop edx
+    pop ebx
+    pop ebp
+    pop esi
+    pop edi
+
+    add esp, 8                  ; interrupt number and error code
+
+    ; sysexit takes eip from edx and esp from ecx, the libc gate restores them
+    mov edx, [esp]
+    mov ecx, [esp+12]
+    and dword [esp+8], ~0x200
+    push dword [esp+8]
+    popfd
+    sti                         ; only effective after sysexit
+    sysexit
@@ -0,0 +1,110 @@
+/*
+sysenter.cpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "sysenter.hpp"
+
+#include <sys/wait.h>
+#include <signal.h>
+
+#include "syscall.hpp"
+
+#include "i686/cpu/cpuid.hpp"
+#include "i686/cpu/msr.hpp"
+#include "i686/gdt/gdt.hpp"
+#include "i686/smp/smp.hpp"
+#include "mem/memmap.hpp"
+#include "tasking/process.hpp"
+#include "tasking/scheduler.hpp"
+#include "utils/logging.hpp"
+
+extern "C" void sysenter_entry();
+
+namespace sysenter
+{
+
+namespace
+{
+
+constexpr uint32_t msr_cs  { 0x174 };
+constexpr uint32_t msr_esp { 0x175 };
+constexpr uint32_t msr_eip { 0x176 };
+
+// return address, interrupt vector and sixth argument, pushed by the libc gate
+constexpr size_t user_frame_size { 3 * sizeof(uint32_t) };
+
+bool enabled { false };
+
+}
+
+bool available()
+{
+    uint32_t eax, edx, unused;
+    cpuid(1, eax, unused, unused, edx);
+
+    const uint32_t family = (eax >> 8) & 0xF;
+    const uint32_t model = (eax >> 4) & 0xF;
+    const uint32_t stepping = eax & 0xF;
+
+    // the first Pentium Pro report SEP without supporting it
+    if (family == 6 && model < 3 && stepping < 3) return false;
+
+    return edx & (1 << 11);
+}
+
+void init()
+{
+    enabled = available();
+    if (!enabled) return;
+
+    write_msr(msr_cs, gdt::kernel_code_selector * sizeof(gdt::entry));
+    write_msr(msr_eip, reinterpret_cast<uintptr_t>(&sysenter_entry));
+    write_msr(msr_esp, 0);
+}
+
+void set_kernel_stack(uintptr_t kernel_stack)
+{
+    if (enabled) write_msr(msr_esp, kernel_stack);
+}
+
+}
+
+extern "C" const registers* __attribute__((force_align_arg_pointer)) sysenter_handler(registers* const regs)
+{
+    const auto user_frame = reinterpret_cast<const uint32_t*>(regs->ebp);
+    if (!Memory::check_user_ptr(user_frame, sysenter::user_frame_size))
+    {
+        // there is nowhere to return to
+        smp::enter_kernel(regs, false);
+        log_serial("PID %d entered sysenter with an invalid stack (%p)\n", Process::current().pid, user_frame);
+        Process::kill(Process::current().pid, __W_STOPCODE(SIGSEGV));
+        tasking::schedule();
+    }
+
+    regs->eip = user_frame[0];
+    regs->int_no = user_frame[1];
+    regs->ebp = user_frame[2];
+
+    return syscall_handler(regs);
+}
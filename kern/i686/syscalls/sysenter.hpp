@@ -0,0 +1,56 @@
+/*
+sysenter.hpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef SYSENTER_HPP
+#define SYSENTER_HPP
+
+#include <stdint.h>
+
+#include "i686/cpu/registers.hpp"
+
+// Fast system call entry : sysenter skips the IDT and TSS lookups of 'int 0x80', and sysexit returns without an iret.
+// The libc uses it when CPUID reports SEP, the syscalls are then handled exactly as through the interrupt gates.
+namespace sysenter
+{
+
+// error code of the syscall frames built by the sysenter entry
+constexpr uint32_t frame_marker { 1 };
+
+bool available();
+
+// sets up the MSRs of the calling CPU
+void init();
+
+// sysenter loads esp from a MSR instead of the TSS, updated with it when switching processes
+void set_kernel_stack(uintptr_t kernel_stack);
+
+}
+
+// instructions run again when a syscall is restarted : 'int 0x80', or 'mov ebp, esp; sysenter' in the libc gate
+inline uint32_t syscall_restart_size(const registers& regs)
+{
+    return regs.err_code == sysenter::frame_marker ? 4 : 2;
+}
+
+#endif // SYSENTER_HPP
@@ -0,0 +1,39 @@
+global suspend_kernel_context
+global resume_kernel_context
+
+; void suspend_kernel_context(uintptr_t* saved_esp, uintptr_t stack, void (*func)(void*), void* arg)
+; saves the callee-saved registers of the running kernel code unless saved_esp is null, and calls func(arg) on another stack,
+; resume_kernel_context(*saved_esp) then returns from this function
+suspend_kernel_context:
+    mov eax, [esp+0x4] ; saved_esp
+    mov ecx, [esp+0x8] ; stack
+    mov edx, [esp+0xC] ; func
+
+    push ebp
+    push ebx
+    push esi
+    push edi
+
+    test eax, eax
+    jz .switch_stack
+    mov [eax], esp
+
+.switch_stack:
+    mov eax, [esp+0x20] ; arg
+    mov esp, ecx
+    sub esp, 0xC ; aligned on 16 bytes at the call
+    push eax
+    call edx
+
+    ud2 ; func never returns
+
+; void resume_kernel_context(uintptr_t esp)
+resume_kernel_context:
+    mov esp, [esp+0x4]
+
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+
+    ret
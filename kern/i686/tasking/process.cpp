@@ -26,15 +26,20 @@ SOFTWARE.
 #include "tasking/process.hpp"
 #include "tasking/process_data.hpp"
 #include "i686/tasking/process.hpp"
+#include "tasking/scheduler.hpp"
 
 #include <vector.hpp>
 
 #include <sys/wait.h>
+#include <sys/thread.h>
 
 #include "i686/gdt/gdt.hpp"
+#include "i686/syscalls/sysenter.hpp"
 #include "i686/interrupts/interrupts.hpp"
 #include "i686/mem/physallocator.hpp"
+#include "i686/smp/smp.hpp"
 #include "utils/aligned_vector.hpp"
+#include "mem/slab.hpp"
 
 #include "fs/fsutils.hpp"
 #include "fs/vfs.hpp"
@@ -52,18 +57,70 @@ struct SignalTrampolineInfo
 static_assert(sizeof(SignalTrampolineInfo) == 16);
 
 extern "C" [[noreturn]] void enter_ring3(const registers* regs);
+extern "C" [[noreturn]] void resume_kernel_context(uintptr_t esp);
+extern "C" void suspend_kernel_context(uintptr_t* saved_esp, uintptr_t stack, void (*func)(void*), void* arg);
 
-void Process::push_onto_stack(gsl::span<const uint8_t> data)
+// first function run by a kernel thread, returned to by resume_kernel_context
+extern "C" [[noreturn]] void __attribute__((force_align_arg_pointer)) kernel_thread_start(Process* thread)
+{
+    sti();
+    thread->data->thread_entry();
+
+    panic("Kernel thread %d ('%s') returned\n", thread->pid, thread->data->name.c_str());
+}
+
+namespace
+{
+
+SlabCache arch_context_cache { "arch_context", sizeof(ProcessArchContext) };
+
+// the kernel stacks of destroyed processes, which might still be in use until we switch to the CPU's own stack
+std::vector<void*> dead_kernel_stacks;
+
+}
+
+void* ProcessArchContext::operator new(size_t size)
+{
+    return slab_alloc(arch_context_cache, size);
+}
+
+namespace
+{
+
+void allocate_kernel_stack(ProcessArchContext& context)
 {
-    auto current_sp = this->data->stack.size() - (user_stack_top - arch_context->regs.esp);
-    assert(current_sp - data.size() >= 0);
+    context.kernel_stack = kmalloc_align(kernel_stack_size, 16);
+    assert(context.kernel_stack);
+    context.kernel_esp = 0;
+    context.kernel_fpu = false;
+}
+
+uintptr_t kernel_stack_top(const ProcessArchContext& context)
+{
+    return reinterpret_cast<uintptr_t>(context.kernel_stack) + kernel_stack_size;
+}
 
-    for (int i { 0 }; i < data.size(); ++i)
+void on_cpu_stack(void* next)
+{
+    if (smp::kernel_lock.held())
     {
-        this->data->stack[current_sp - i - 1] = data[data.size() - i - 1];
+        for (auto stack : dead_kernel_stacks) kfree(stack);
+        dead_kernel_stacks.clear();
     }
 
+    reinterpret_cast<void(*)()>(next)();
+
+    panic("Returned to a dropped kernel stack\n");
+}
+
+}
+
+void Process::push_onto_stack(gsl::span<const uint8_t> data)
+{
+    assert(user_stack_top - (arch_context->regs.esp - data.size()) <= user_stack_size);
+
     arch_context->regs.esp -= data.size();
+    write_memory(arch_context->regs.esp, data);
 }
 
 void Process::pop_stack(size_t size)
@@ -83,9 +140,15 @@ void Process::wake_up(pid_t child, int err_code)
 void Process::execute_sighandler(int signal, pid_t returning_pid, const siginfo_t &siginfo)
 {
     assert(arch_context);
+    // the registers of a process running on another CPU are only saved once it's stopped
+    stop_on_other_cpus();
+    save_user_context();
     data->sig_context.push(ProcessData::SigContext{arch_context, returning_pid});
+    FPU::save(arch_context->fpu_state);
     arch_context = new ProcessArchContext(*arch_context);
-    // keep the same stack for signal handling
+    // keep the same stack for signal handling, but the process might be suspended in the kernel :
+    // the handler gets its own kernel stack, the kernel code is resumed once it returns
+    allocate_kernel_stack(*arch_context);
 
     auto sig = data->sig_handlers->at(signal);
 
@@ -119,6 +182,7 @@ void Process::execute_sighandler(int signal, pid_t returning_pid, const siginfo_
 void Process::do_user_callback(const std::function<int (const std::vector<uintptr_t> &)> &callback, const std::vector<size_t>& arg_sizes)
 {
     // TODO : copy_from_user
+    save_user_context();
     auto& regs = arch_context->regs;
     uintptr_t return_address = *(uintptr_t*)(regs.esp);
     regs.esp += sizeof(uintptr_t);
@@ -170,6 +234,9 @@ void Process::exit_signal()
 
     data->sig_context.pop();
 
+    // the process was taken out of the run queue to handle the signal
+    if (returning_pid != pid) tasking::make_ready(*this);
+
     unswitch();
     Process::by_pid(returning_pid)->switch_to();
 }
@@ -178,13 +245,9 @@ void Process::arch_init(gsl::span<const uint8_t> code_to_copy, size_t allocated_
 {
     assert(!arch_context);
     arch_context = new ProcessArchContext;
-
-    data->stack.resize(2*Paging::page_size);
-
-    data->code = std::make_shared<aligned_vector<uint8_t, Memory::page_size()>>();
-    data->code->resize(std::max<int>(code_to_copy.size(), allocated_size));
-    std::copy(code_to_copy.begin(), code_to_copy.end(), data->code->begin());
-    std::fill(data->code->begin() + code_to_copy.size(), data->code->end(), 0); // clear the allocated part
+    arch_context->paging_info = std::make_shared<PagingInformation>();
+    Paging::create_paging_info(*arch_context->paging_info);
+    allocate_kernel_stack(*arch_context);
 
     registers regs;
     memset(&regs, 0, sizeof(registers));
@@ -197,11 +260,60 @@ void Process::arch_init(gsl::span<const uint8_t> code_to_copy, size_t allocated_
 
     arch_context->regs = regs;
 
+    map_code(code_to_copy, allocated_size);
+    map_stack();
     create_mappings();
+    map_address_space();
 
     set_args(data->args);
 }
 
+void Process::arch_init_kernel_thread()
+{
+    assert(!arch_context);
+    arch_context = new ProcessArchContext;
+    memset(&arch_context->regs, 0, sizeof(registers));
+
+    // the kernel half is the same in every address space, and the kernel page directory is never released
+    arch_context->paging_info = std::shared_ptr<PagingInformation>(&Paging::kernel_info(), [](PagingInformation*){});
+
+    allocate_kernel_stack(*arch_context);
+
+    // popped by resume_kernel_context : edi, esi, ebx, ebp, then the return address and kernel_thread_start's argument
+    auto frame = reinterpret_cast<uintptr_t*>(kernel_stack_top(*arch_context)) - 7;
+    frame[0] = frame[1] = frame[2] = frame[3] = 0;
+    frame[4] = reinterpret_cast<uintptr_t>(&kernel_thread_start);
+    frame[5] = 0;
+    frame[6] = reinterpret_cast<uintptr_t>(this);
+
+    arch_context->kernel_esp = reinterpret_cast<uintptr_t>(frame);
+    arch_context->lock_depth = 1;
+}
+
+void Process::drop_signal_contexts()
+{
+    while (!arch_context->kernel_esp && !data->sig_context.empty())
+    {
+        free_arch_context();
+        arch_context = data->sig_context.top().cpu_context;
+        data->sig_context.pop();
+    }
+}
+
+bool Process::suspended_in_kernel() const
+{
+    if (arch_context->kernel_esp) return true;
+
+    // the kernel code a signal interrupted is resumed once the handler returns
+    auto contexts = data->sig_context;
+    for (; !contexts.empty(); contexts.pop())
+    {
+        if (contexts.top().cpu_context->kernel_esp) return true;
+    }
+
+    return false;
+}
+
 void Process::set_instruction_pointer(unsigned int value)
 {
     arch_context->regs.eip = value;
@@ -212,19 +324,86 @@ void Process::switch_to()
     {
         assert(!is_waiting());
 
-        map_address_space();
-        map_shm();
+        if (data->pending_kill) drop_signal_contexts();
+
+        // a signal raised by a process running on another CPU makes it switch to the target
+        stop_on_other_cpus();
+
+        Paging::load_paging_info(*arch_context->paging_info);
 
         m_current_process = this;
+        tasking::set_running(*this);
+        FPU::switch_to(arch_context->kernel_fpu ? nullptr : &arch_context->fpu_state);
+        if (!is_kernel_thread())
+        {
+            gdt::set_kernel_stack(smp::cpu_index(), kernel_stack_top(*arch_context));
+            sysenter::set_kernel_stack(kernel_stack_top(*arch_context));
+        }
+    }
+
+    cli();
+    if (const uintptr_t esp = arch_context->kernel_esp)
+    {
+        // resumed in the kernel code it was suspended in, which runs with the kernel lock
+        arch_context->kernel_esp = 0;
+        arch_context->kernel_fpu = false;
+        smp::kernel_lock.set_depth(arch_context->lock_depth);
+        resume_kernel_context(esp);
     }
+    assert(!is_kernel_thread());
+
+    check_pending_kill();
+
+    // user code runs without the kernel lock, the other CPUs can enter the kernel once we're back to ring 3
+    smp::kernel_lock.unlock_all();
     enter_ring3(&arch_context->regs);
 
     __builtin_unreachable();
 }
 
+void Process::save_user_context()
+{
+    if (!arch_context->syscall_frame) return;
+
+    arch_context->regs = *arch_context->syscall_frame;
+    arch_context->syscall_frame = nullptr;
+}
+
+void Process::suspend(void (*next)())
+{
+    assert(m_current_process == this && !interrupts_enabled());
+
+    save_user_context();
+
+    arch_context->lock_depth = smp::kernel_lock.depth();
+    arch_context->kernel_fpu = FPU::current() == nullptr;
+    suspend_kernel_context(&arch_context->kernel_esp, smp::current_cpu().kernel_stack, &on_cpu_stack, reinterpret_cast<void*>(next));
+}
+
+void Process::run_on_cpu_stack(void (*next)())
+{
+    suspend_kernel_context(nullptr, smp::current_cpu().kernel_stack, &on_cpu_stack, reinterpret_cast<void*>(next));
+
+    __builtin_unreachable();
+}
+
 void Process::unswitch()
 {
-    unmap_address_space();
+    // nothing to unmap, the next process will simply load its own page directory,
+    // but the FPU state is written back as the process might be resumed on another CPU
+    FPU::unload(arch_context->fpu_state);
+    // it doesn't return through its syscall frame when left this way, as for a signal sent to another process
+    save_user_context();
+
+    if (m_current_process == this) m_current_process = nullptr;
+}
+
+void Process::stop_on_other_cpus()
+{
+    for (size_t i { 0 }; i < smp::cpu_count(); ++i)
+    {
+        if (i != smp::cpu_index() && m_current_process.on(i) == this) smp::preempt(i);
+    }
 }
 
 #include "utils/messagebus.hpp"
@@ -234,62 +413,148 @@ Process *Process::clone(Process &proc, uint32_t flags)
     auto new_proc = Process::create(proc.data->args);
     if (!new_proc) return nullptr;
 
-    new_proc->data->code = std::make_shared<aligned_vector<uint8_t, Memory::page_size()>>(*proc.data->code); // noleak ? :(
-    new_proc->data->stack = proc.data->stack; // noleak
-    new_proc->data->name = proc.data->name + "_child"; // noleak
+    const bool thread = flags & CLONE_THREAD;
+
+    new_proc->data->name = thread ? proc.data->name : proc.data->name + "_child"; // noleak
     new_proc->data->uid = proc.data->uid;
     new_proc->data->gid = proc.data->gid;
-    new_proc->parent = proc.pid;
+    if (thread)
+    {
+        // nobody waits for a thread, its process is the one which gets waited for
+        new_proc->tgid = proc.tgid;
+        new_proc->parent = proc.parent;
+    }
+    else
+    {
+        new_proc->parent = proc.pid;
+    }
 
-    new_proc->data->pwd  = vfs::find(proc.data->pwd->path()).value(); assert(new_proc->data->pwd);
-    new_proc->data->root = vfs::find(proc.data->root->path()).value(); assert(new_proc->data->root);
+    if (flags & CLONE_FS)
+    {
+        new_proc->data->pwd  = proc.data->pwd;
+        new_proc->data->root = proc.data->root;
+    }
+    else
+    {
+        new_proc->data->pwd  = vfs::find(proc.data->pwd->path()).value(); assert(new_proc->data->pwd);
+        new_proc->data->root = vfs::find(proc.data->root->path()).value(); assert(new_proc->data->root);
+    }
 
-    new_proc->data->fd_table = std::make_shared<std::vector<tasking::FDInfo>>(*proc.data->fd_table); // noleak
-        proc.copy_allocated_pages(*new_proc); // noleak
+    if (flags & CLONE_FILES)
+    {
+        new_proc->data->fd_table = proc.data->fd_table;
+    }
+    else
+    {
+        new_proc->data->fd_table = std::make_shared<std::vector<tasking::FDInfo>>(*proc.data->fd_table); // noleak
+    }
 
-    // TODO : refactor this
-    new_proc->data->user_callbacks = std::make_shared<tasking::UserCallbacks>(*proc.data->user_callbacks);
+    if (flags & CLONE_VM)
+    {
+        new_proc->data->mappings = proc.data->mappings;
+        new_proc->data->shm_list = proc.data->shm_list;
+        new_proc->data->user_callbacks = proc.data->user_callbacks;
+    }
+    else
+    {
+        // code, stack and allocated pages are shared copy-on-write
+        proc.share_allocated_pages(*new_proc);
+        for (const auto& pair : *proc.data->mappings)
+        {
+            if (pair.second.cow) proc.update_mapping(pair.first);
+        }
+
+        // TODO : refactor this
+        new_proc->data->user_callbacks = std::make_shared<tasking::UserCallbacks>(*proc.data->user_callbacks);
+        *new_proc->data->shm_list = *proc.data->shm_list;
+    }
 
     new_proc->data->args = proc.data->args; // noleak
-    new_proc->data->shm_list = proc.data->shm_list;
-    new_proc->data->sig_handlers = std::make_shared<kpp::array<struct sigaction, SIGRTMAX>>(*proc.data->sig_handlers);
+    if (flags & CLONE_SIGHAND)
+    {
+        new_proc->data->sig_handlers = proc.data->sig_handlers;
+    }
+    else
+    {
+        new_proc->data->sig_handlers = std::make_shared<kpp::array<struct sigaction, SIGRTMAX>>(*proc.data->sig_handlers);
+    }
+
+    FPU::save(proc.arch_context->fpu_state);
+    proc.save_user_context();
     new_proc->arch_context = new ProcessArchContext;
     *new_proc->arch_context = *proc.arch_context;
+    if (!(flags & CLONE_VM))
+    {
+        new_proc->arch_context->paging_info = std::make_shared<PagingInformation>();
+        Paging::create_paging_info(*new_proc->arch_context->paging_info);
+    }
+    allocate_kernel_stack(*new_proc->arch_context);
 
-    proc.data->children.emplace_back(new_proc->pid);
+    if (!thread) proc.data->children.emplace_back(new_proc->pid);
 
-    new_proc->create_mappings();
+    if (!(flags & CLONE_VM))
+    {
+        new_proc->create_mappings();
+        new_proc->map_address_space();
+    }
 
     assert(new_proc);
     return new_proc;
 }
 
-void Process::unmap_address_space()
+void Process::map_address_space()
 {
-#if 0
-    Paging::unmap_user_space(); // reloading all the page tables is really costly, not the right solution
-#else
-    for (const auto& pair : data->mappings)
+    auto& info = *arch_context->paging_info;
+
+    for (const auto& pair : *data->mappings)
     {
-        Memory::unmap_page((void*)pair.first);
+        Paging::map_page(info, pair.second.paddr, (void*)pair.first, pair.second.page_flags());
     }
-    for (const auto& shm : data->shm_list)
+    for (const auto& shm : *data->shm_list)
     {
-        Memory::unmap(shm.second.v_addr, shm.second.shm->size());
+        if (!shm.second.v_addr) continue;
+
+        const auto& pages = shm.second.shm->physical_pages();
+        for (size_t i { 0 }; i < pages.size(); ++i)
+        {
+            Paging::map_page(info, pages[i], (uint8_t*)shm.second.v_addr + i*Memory::page_size(),
+                             Memory::Read|Memory::Write|Memory::User);
+        }
     }
-#endif
+}
+
+void Process::update_mapping(uintptr_t v_addr)
+{
+    auto& info = *arch_context->paging_info;
+    const auto& mapping = data->mappings->at(v_addr);
+
+    Paging::unmap_page(info, (void*)v_addr);
+    Paging::map_page(info, mapping.paddr, (void*)v_addr, mapping.page_flags());
+}
+
+void Process::unmap_address_space()
+{
+    Paging::unmap_user_space(*arch_context->paging_info);
 }
 
 // TODO : remove when using std::unique_ptr
 void Process::free_arch_context()
 {
+    FPU::release(arch_context->fpu_state);
+    // we might be running on it
+    if (arch_context->kernel_stack) dead_kernel_stacks.emplace_back(arch_context->kernel_stack);
     delete arch_context;
     arch_context = nullptr;
 }
 
 void Process::cleanup()
 {
-    release_mappings();
+    // the other threads keep using the address space
+    if (data->mappings.use_count() == 1)
+    {
+        release_mappings();
+        unmap_address_space();
+    }
 
     free_arch_context();
 }
@@ -25,15 +25,32 @@ SOFTWARE.
 #ifndef i686_PROCESS_HPP
 #define i686_PROCESS_HPP
 
+#include <memory.hpp>
+
 #include "tasking/process.hpp"
 
 #include "i686/fpu/fpu.hpp"
 #include "i686/cpu/registers.hpp"
+#include "i686/mem/paging.hpp"
 
 struct ProcessArchContext
 {
+    // from the "arch_context" slab cache, a copy is made for each signal handler run
+    static void* operator new(size_t size);
+
     registers regs;
+    // frame of the syscall being handled, on the kernel stack : regs is out of date while it isn't null
+    registers* syscall_frame { nullptr };
     FPUState fpu_state;
+    std::shared_ptr<PagingInformation> paging_info; // shared with the contexts saved during signal handling
+
+    // stack used by the kernel on behalf of the process, and the kernel code it was suspended in if kernel_esp isn't 0
+    void* kernel_stack { nullptr };
+    uintptr_t kernel_esp { 0 };
+    size_t lock_depth { 1 };
+    bool kernel_fpu { false }; // the kernel's FPU state was used when suspended
 };
 
+constexpr size_t kernel_stack_size { 0x8000 };
+
 #endif // i686_PROCESS_HPP
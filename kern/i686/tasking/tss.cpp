@@ -25,5 +25,5 @@ SOFTWARE.
 
 #include "tss.hpp"
 
-volatile tss_struct tss;
+volatile tss_struct tss[gdt::tss_count];
 
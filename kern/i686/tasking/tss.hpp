@@ -25,6 +25,8 @@ SOFTWARE.
 #ifndef TSS_HP
 #define TSS_HP
 
+#include "i686/gdt/gdt.hpp"
+
 struct [[gnu::packed]] tss_struct
 {
     unsigned short   link;
@@ -83,6 +85,6 @@ struct [[gnu::packed]] tss_struct
 
 };
 
-extern volatile tss_struct tss;
+extern volatile tss_struct tss[gdt::tss_count];
 
 #endif // TSS_HP
@@ -45,12 +45,17 @@ uint64_t total_ticks()
     return ret;
 }
 
+uint64_t boot_ticks()
+{
+    static uint64_t initial_ticks = total_ticks();
+    return initial_ticks;
+}
+
 double uptime()
 {
     if (!timer_ready) return 0;
 
-    static double initial_ticks = total_ticks();
-    double ticks = total_ticks() - initial_ticks;
+    double ticks = total_ticks() - boot_ticks();
 
     return ticks / (double(clock_speed()) * 1'000'000.0); // MHz -> Hz
 }
@@ -0,0 +1,45 @@
+/*
+thread.h
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef LUDOS_THREAD_H
+#define LUDOS_THREAD_H
+
+/* clone() flags, same values as Linux */
+#define CLONE_VM             0x00000100 /* share the address space */
+#define CLONE_FS             0x00000200 /* share the working and root directories */
+#define CLONE_FILES          0x00000400 /* share the file descriptor table */
+#define CLONE_SIGHAND        0x00000800 /* share the signal handlers, needs CLONE_VM */
+#define CLONE_THREAD         0x00010000 /* same thread group, needs CLONE_SIGHAND */
+#define CLONE_PARENT_SETTID  0x00100000 /* store the new thread id at ptid */
+#define CLONE_CHILD_CLEARTID 0x00200000 /* clear ctid and wake a futex on it when the thread exits */
+
+/* the flags needed for a thread */
+#define CLONE_THREAD_FLAGS (CLONE_VM|CLONE_FS|CLONE_FILES|CLONE_SIGHAND|CLONE_THREAD)
+
+/* futex() operations */
+#define FUTEX_WAIT 0
+#define FUTEX_WAKE 1
+#define FUTEX_PRIVATE_FLAG 128 /* accepted and ignored, futexes are always keyed on the physical address */
+
+#endif // LUDOS_THREAD_H
@@ -0,0 +1,42 @@
+/*
+vdso.h
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef LUDOS_VDSO_H
+#define LUDOS_VDSO_H
+
+#include <stdint.h>
+
+/* Read-only page the kernel maps in every process, right under the signal trampoline.
+   It lets the libc answer uptime(), time(), clock_gettime() and getpid() without a syscall */
+#define VDSO_DATA_ADDR 0xBFFFD000
+
+struct vdso_data
+{
+    uint64_t tsc_base;      /* TSC value at uptime 0 */
+    uint64_t tsc_mhz;       /* TSC ticks per microsecond, 0 if the page isn't filled */
+    uint64_t boot_epoch_us; /* UNIX time at uptime 0, in microseconds */
+    int32_t  pid;           /* value returned by getpid() */
+};
+
+#endif // LUDOS_VDSO_H
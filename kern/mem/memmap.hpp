@@ -40,9 +40,18 @@ public:
         Uncached     = 1<<3,
         WriteThrough = 1<<4,
         Executable   = 1<<5,
-        Sentinel     = 1<<6  // Used for custom page fault handlers, to signal an access to a page
+        Sentinel     = 1<<6, // Used for custom page fault handlers, to signal an access to a page
+        OnDemand     = 1<<7  // Reserved but not backed by memory yet, user accesses are valid and fault it in
     };
 
+    struct VirtualSpaceStats
+    {
+        size_t free_pages;
+        size_t free_ranges;
+        size_t largest_free_range; // in pages
+    };
+
+public:
     static void* mmap(uintptr_t p_addr, size_t len, uint32_t flags = Read|Write);
     static void unmap(void* v_addr, size_t len);
 
@@ -58,10 +67,16 @@ public:
 
     static uintptr_t allocate_physical_page();
     static void release_physical_page(uintptr_t page);
+    // 2^order physically contiguous pages, aligned on their size
+    static uintptr_t allocate_physical_pages(size_t order);
+    static void release_physical_pages(uintptr_t page, size_t order);
+    static size_t free_physical_pages();
     static size_t allocated_physical_pages();
 
     static uintptr_t allocate_virtual_page(size_t number, bool user);
     static void release_virtual_page(uintptr_t page);
+    // kernel half, or user half of the current address space
+    static VirtualSpaceStats virtual_space_stats(bool user);
 
     static constexpr size_t page_size()
     {
@@ -80,8 +95,19 @@ public:
         return addr & (page_size()-1);
     }
 
+    // Pointer to physical memory through the permanent kernel mapping of RAM,
+    // nullptr if [p_addr, p_addr + len) isn't covered by it
+    static void* direct_map(uintptr_t p_addr, size_t len = 1);
+    static bool is_direct_mapped(const void* v_addr);
+
     static void phys_read(uintptr_t addr, void* buf, size_t size)
     {
+        if (auto ptr = Memory::direct_map(addr, size))
+        {
+            memcpy(buf, ptr, size);
+            return;
+        }
+
         auto ptr = Memory::mmap(addr, size, Memory::Read);
         memcpy(buf, ptr, size);
         Memory::unmap(ptr, size);
@@ -89,10 +115,43 @@ public:
 
     static void phys_write(uintptr_t addr, const void* buf, size_t size)
     {
+        if (auto ptr = Memory::direct_map(addr, size))
+        {
+            memcpy(ptr, buf, size);
+            return;
+        }
+
         auto ptr = Memory::mmap(addr, size, Memory::Write);
         memcpy(ptr, buf, size);
         Memory::unmap(ptr, size);
     }
+
+    static void phys_memset(uintptr_t addr, uint8_t value, size_t size)
+    {
+        if (auto ptr = Memory::direct_map(addr, size))
+        {
+            memset(ptr, value, size);
+            return;
+        }
+
+        auto ptr = Memory::mmap(addr, size, Memory::Write);
+        memset(ptr, value, size);
+        Memory::unmap(ptr, size);
+    }
+
+    static void phys_copy(uintptr_t dest, uintptr_t src, size_t size)
+    {
+        auto src_ptr = Memory::direct_map(src, size);
+        if (src_ptr)
+        {
+            phys_write(dest, src_ptr, size);
+            return;
+        }
+
+        src_ptr = Memory::mmap(src, size, Memory::Read);
+        phys_write(dest, src_ptr, size);
+        Memory::unmap(src_ptr, size);
+    }
 };
 
 #endif // MEMMAP_HPP
@@ -38,7 +38,8 @@ struct PageFault
     enum { Read, Write, Execute   } type ;
 };
 
-void page_fault_entry(const PageFault& fault);
+// returns true if the fault was resolved and the faulting instruction can be executed again
+bool page_fault_entry(const PageFault& fault);
 
 /*
  * Handles page fault, returns true if handled by the callback or false if not
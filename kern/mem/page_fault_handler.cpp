@@ -110,13 +110,20 @@ void kernel_page_fault(const PageFault& fault)
     }
 }
 
-void page_fault_entry(const PageFault& fault)
+bool page_fault_entry(const PageFault& fault)
 {
+    // page mapped on demand or shared by fork() : back it with memory and retry
+    if (fault.address < KERNEL_VIRTUAL_BASE && Process::enabled() &&
+            Process::current().resolve_page_fault(fault.address, fault.type == PageFault::Write))
+    {
+        return true;
+    }
+
     if (auto handler = handlers.find(Memory::page(fault.address)); handler != handlers.end())
     {
         if (handler->second(fault))
         {
-            return; // the fault was succesfully handled by the handler
+            return false; // the fault was succesfully handled by the handler
         }
     }
 
@@ -128,4 +135,6 @@ void page_fault_entry(const PageFault& fault)
     {
         user_space_fault(fault);
     }
+
+    return false;
 }
@@ -0,0 +1,76 @@
+/*
+range_allocator.hpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef RANGE_ALLOCATOR_HPP
+#define RANGE_ALLOCATOR_HPP
+
+#include <stdint.h>
+
+#include <map.hpp>
+#include <set.hpp>
+#include <memory.hpp>
+#include <optional.hpp>
+
+struct RangeAllocatorStats
+{
+    size_t free_size;
+    size_t free_ranges;
+    size_t largest_free_range;
+};
+
+// Allocates ranges of an address space (in arbitrary units, pages for instance).
+// Free ranges are indexed both by address, to coalesce them when released, and by size, for O(log n) best-fit allocation.
+template <template <typename> class Alloc = std::allocator>
+class RangeAllocator
+{
+public:
+    using Stats = RangeAllocatorStats;
+
+public:
+    void reset(uintptr_t base, size_t size);
+
+    // best fit, returns the lowest address among the smallest free ranges large enough
+    kpp::optional<uintptr_t> allocate(size_t len);
+    // marks [addr, addr+len) as used, returns false if part of it isn't free
+    bool reserve(uintptr_t addr, size_t len);
+    void release(uintptr_t addr, size_t len);
+
+    bool is_free(uintptr_t addr) const;
+
+    Stats stats() const;
+
+private:
+    void add_range(uintptr_t addr, size_t len);
+    void remove_range(uintptr_t addr, size_t len);
+
+private:
+    using SizeKey = std::pair<size_t, uintptr_t>;
+
+    std::map<uintptr_t, size_t, std::less<uintptr_t>, Alloc<std::pair<const uintptr_t, size_t>>> m_by_addr;
+    std::set<SizeKey, std::less<SizeKey>, Alloc<SizeKey>> m_by_size;
+};
+
+#include "range_allocator.tpp"
+
+#endif // RANGE_ALLOCATOR_HPP
@@ -0,0 +1,164 @@
+/*
+range_allocator.tpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "range_allocator.hpp"
+
+#include <assert.h>
+
+template <template <typename> class Alloc>
+void RangeAllocator<Alloc>::reset(uintptr_t base, size_t size)
+{
+    m_by_addr.clear();
+    m_by_size.clear();
+
+    if (size) add_range(base, size);
+}
+
+template <template <typename> class Alloc>
+kpp::optional<uintptr_t> RangeAllocator<Alloc>::allocate(size_t len)
+{
+    assert(len != 0);
+
+    auto it = m_by_size.lower_bound(SizeKey{len, 0});
+    if (it == m_by_size.end())
+    {
+        return {};
+    }
+
+    const auto [range_len, addr] = *it;
+
+    remove_range(addr, range_len);
+    if (range_len > len)
+    {
+        add_range(addr + len, range_len - len);
+    }
+
+    return addr;
+}
+
+template <template <typename> class Alloc>
+bool RangeAllocator<Alloc>::reserve(uintptr_t addr, size_t len)
+{
+    assert(len != 0);
+
+    auto it = m_by_addr.upper_bound(addr);
+    if (it == m_by_addr.begin())
+    {
+        return false;
+    }
+    --it;
+
+    const auto [range_addr, range_len] = *it;
+    if (addr + len > range_addr + range_len)
+    {
+        return false;
+    }
+
+    remove_range(range_addr, range_len);
+    if (addr > range_addr)
+    {
+        add_range(range_addr, addr - range_addr);
+    }
+    if (addr + len < range_addr + range_len)
+    {
+        add_range(addr + len, range_addr + range_len - (addr + len));
+    }
+
+    return true;
+}
+
+template <template <typename> class Alloc>
+void RangeAllocator<Alloc>::release(uintptr_t addr, size_t len)
+{
+    assert(len != 0);
+
+    auto next = m_by_addr.lower_bound(addr);
+    assert(next == m_by_addr.end() || addr + len <= next->first); // double free
+
+    // coalesce with the neighbouring free ranges
+    if (next != m_by_addr.end() && next->first == addr + len)
+    {
+        len += next->second;
+        remove_range(next->first, next->second);
+        next = m_by_addr.lower_bound(addr);
+    }
+    if (next != m_by_addr.begin())
+    {
+        auto prev = std::prev(next);
+        assert(prev->first + prev->second <= addr); // double free
+        if (prev->first + prev->second == addr)
+        {
+            addr = prev->first;
+            len += prev->second;
+            remove_range(prev->first, prev->second);
+        }
+    }
+
+    add_range(addr, len);
+}
+
+template <template <typename> class Alloc>
+bool RangeAllocator<Alloc>::is_free(uintptr_t addr) const
+{
+    auto it = m_by_addr.upper_bound(addr);
+    if (it == m_by_addr.begin())
+    {
+        return false;
+    }
+    --it;
+
+    return addr < it->first + it->second;
+}
+
+template <template <typename> class Alloc>
+typename RangeAllocator<Alloc>::Stats RangeAllocator<Alloc>::stats() const
+{
+    Stats stats {0, m_by_addr.size(), 0};
+
+    for (const auto& range : m_by_addr)
+    {
+        stats.free_size += range.second;
+    }
+    if (!m_by_size.empty())
+    {
+        stats.largest_free_range = m_by_size.rbegin()->first;
+    }
+
+    return stats;
+}
+
+template <template <typename> class Alloc>
+void RangeAllocator<Alloc>::add_range(uintptr_t addr, size_t len)
+{
+    m_by_addr.emplace(addr, len);
+    m_by_size.emplace(len, addr);
+}
+
+template <template <typename> class Alloc>
+void RangeAllocator<Alloc>::remove_range(uintptr_t addr, size_t len)
+{
+    m_by_addr.erase(addr);
+    m_by_size.erase(SizeKey{len, addr});
+}
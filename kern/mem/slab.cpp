@@ -0,0 +1,268 @@
+/*
+slab.cpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "slab.hpp"
+
+#include <assert.h>
+
+#include "i686/interrupts/interrupts.hpp"
+
+#include "utils/logging.hpp"
+
+static constexpr uint32_t slab_magic { 0x51AB51AB };
+
+// lives at the start of the slab, slabs being aligned on their size
+struct SlabCache::Slab
+{
+    uint32_t magic;
+    SlabCache* cache;
+    Slab* prev;
+    Slab* next;
+    void* free_list;
+    size_t in_use;
+};
+
+// general purpose caches, constant-initialized
+static SlabCache size_caches[] =
+{
+    {"size-8", 8}, {"size-16", 16}, {"size-32", 32}, {"size-64", 64}, {"size-96", 96}, {"size-128", 128},
+    {"size-192", 192}, {"size-256", 256}, {"size-512", 512}, {"size-1024", 1024}, {"size-2048", 2048}
+};
+
+void *SlabCache::allocate()
+{
+    // allocations can happen in interrupt handlers
+    InterruptLock lock;
+
+    Slab* slab = m_partial;
+    if (!slab && m_empty)
+    {
+        slab = m_empty;
+        list_remove(m_empty, slab);
+        list_push(m_partial, slab);
+        --m_empty_slabs;
+    }
+    if (!slab)
+    {
+        slab = create_slab();
+        if (!slab) return nullptr;
+        list_push(m_partial, slab);
+    }
+
+    void* object = slab->free_list;
+    slab->free_list = link(object);
+    ++slab->in_use;
+    ++m_active_objects;
+    ++m_allocations;
+
+    if (!slab->free_list)
+    {
+        list_remove(m_partial, slab);
+        list_push(m_full, slab);
+    }
+
+    return object;
+}
+
+void SlabCache::release(void *ptr)
+{
+    InterruptLock lock;
+
+    auto slab = reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(ptr) & ~(slab_size - 1));
+    assert(slab->magic == slab_magic && slab->cache == this);
+    assert(slab->in_use);
+
+    const bool was_full = !slab->free_list;
+
+    link(ptr) = slab->free_list;
+    slab->free_list = ptr;
+    --slab->in_use;
+    --m_active_objects;
+
+    if (was_full)
+    {
+        list_remove(m_full, slab);
+        list_push(m_partial, slab);
+    }
+
+    if (slab->in_use == 0)
+    {
+        list_remove(m_partial, slab);
+
+        // keep one empty slab to absorb allocation/release cycles
+        if (m_empty_slabs)
+        {
+            destroy_slab(slab);
+        }
+        else
+        {
+            list_push(m_empty, slab);
+            ++m_empty_slabs;
+        }
+    }
+}
+
+SlabCacheStats SlabCache::stats() const
+{
+    return {m_object_size, m_active_objects, m_slabs*objects_per_slab(), m_slabs, m_allocations};
+}
+
+SlabCache *SlabCache::cache_of(const void *ptr)
+{
+    if (!Memory::is_direct_mapped(ptr)) return nullptr;
+
+    auto slab = reinterpret_cast<const Slab*>(reinterpret_cast<uintptr_t>(ptr) & ~(slab_size - 1));
+    if (slab->magic != slab_magic) return nullptr;
+
+    return slab->cache;
+}
+
+kpp::string SlabCache::info()
+{
+    kpp::string result;
+
+    for (auto cache = m_caches; cache; cache = cache->m_next_cache)
+    {
+        const auto stats = cache->stats();
+        char buf[128];
+        ksnprintf(buf, sizeof(buf), "%s : %d/%d objects of %d bytes in %d slabs, %d allocations\n", cache->name(),
+                  stats.active_objects, stats.total_objects, stats.object_size, stats.slabs, stats.allocations);
+        result += buf;
+    }
+
+    return result;
+}
+
+void SlabCache::dump()
+{
+    kprintf("Slab caches :\n%s", info().c_str());
+}
+
+size_t SlabCache::header_size()
+{
+    return (sizeof(Slab) + 15) & ~size_t(15);
+}
+
+void SlabCache::list_push(Slab *&list, Slab *slab)
+{
+    slab->prev = nullptr;
+    slab->next = list;
+    if (list) list->prev = slab;
+    list = slab;
+}
+
+void SlabCache::list_remove(Slab *&list, Slab *slab)
+{
+    if (slab->prev) slab->prev->next = slab->next;
+    else list = slab->next;
+    if (slab->next) slab->next->prev = slab->prev;
+    slab->prev = slab->next = nullptr;
+}
+
+size_t SlabCache::objects_per_slab() const
+{
+    return (slab_size - header_size()) / m_stride;
+}
+
+SlabCache::Slab *SlabCache::create_slab()
+{
+    // too early, the direct map isn't set up yet
+    if (!Memory::direct_map(0)) return nullptr;
+
+    assert(objects_per_slab() != 0);
+
+    const uintptr_t phys = Memory::allocate_physical_pages(slab_order);
+    auto slab = reinterpret_cast<Slab*>(Memory::direct_map(phys, slab_size));
+    if (!slab)
+    {
+        Memory::release_physical_pages(phys, slab_order);
+        return nullptr;
+    }
+
+    slab->magic = slab_magic;
+    slab->cache = this;
+    slab->prev = slab->next = nullptr;
+    slab->free_list = nullptr;
+    slab->in_use = 0;
+
+    // chain the objects so that they are handed out in address order
+    uint8_t* objects = reinterpret_cast<uint8_t*>(slab) + header_size();
+    for (size_t i { objects_per_slab() }; i-- > 0;)
+    {
+        void* object = objects + i*m_stride;
+        link(object) = slab->free_list;
+        slab->free_list = object;
+    }
+
+    ++m_slabs;
+    if (!m_registered)
+    {
+        m_next_cache = m_caches;
+        m_caches = this;
+        m_registered = true;
+    }
+
+    return slab;
+}
+
+void SlabCache::destroy_slab(Slab *slab)
+{
+    assert(slab->in_use == 0);
+
+    slab->magic = 0;
+    Memory::release_physical_pages(Memory::physical_address(slab), slab_order);
+    --m_slabs;
+}
+
+void *slab_alloc(size_t size)
+{
+    for (auto& cache : size_caches)
+    {
+        if (size <= cache.object_size()) return cache.allocate();
+    }
+
+    return nullptr;
+}
+
+void *slab_alloc(SlabCache &cache, size_t size)
+{
+    if (size == cache.object_size())
+    {
+        if (auto ptr = cache.allocate()) return ptr;
+    }
+
+    return ::operator new(size);
+}
+
+bool slab_free(void *ptr)
+{
+    if (auto cache = SlabCache::cache_of(ptr))
+    {
+        cache->release(ptr);
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,130 @@
+/*
+slab.hpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef SLAB_HPP
+#define SLAB_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <kstring/kstring.hpp>
+
+#include "mem/memmap.hpp"
+
+struct SlabCacheStats
+{
+    size_t object_size;
+    size_t active_objects;
+    size_t total_objects;
+    size_t slabs;
+    size_t allocations; // since the creation of the cache
+};
+
+// Cache of objects of the same size, carved out of blocks of physically contiguous pages ("slabs")
+// accessed through the direct map.
+// Caches hand out raw storage for operator new, objects are constructed by the new-expression.
+class SlabCache
+{
+public:
+    static constexpr size_t slab_order { 2 };
+    static constexpr size_t slab_size { Memory::page_size() << slab_order };
+
+public:
+    // constexpr so that caches with static storage duration are usable before global constructors run
+    constexpr SlabCache(const char* name, size_t object_size)
+        : m_name(name), m_object_size(object_size), m_stride(align_stride(object_size))
+    {}
+
+    SlabCache(const SlabCache&) = delete;
+    SlabCache& operator=(const SlabCache&) = delete;
+
+    // nullptr if out of memory
+    void* allocate();
+    void release(void* ptr);
+
+    const char* name() const
+    { return m_name; }
+    size_t object_size() const
+    { return m_object_size; }
+    SlabCacheStats stats() const;
+
+    // nullptr if ptr wasn't allocated from a slab cache
+    static SlabCache* cache_of(const void* ptr);
+
+    // one line per cache which has allocated at least one slab, as shown by /proc/slabinfo
+    static kpp::string info();
+    static void dump();
+
+private:
+    struct Slab;
+
+    static constexpr size_t align_stride(size_t size)
+    {
+        const size_t align = size <= 8 ? 8 : 16;
+        return (size + align - 1) & ~(align - 1);
+    }
+
+    static size_t header_size();
+    static void list_push(Slab*& list, Slab* slab);
+    static void list_remove(Slab*& list, Slab* slab);
+
+    size_t objects_per_slab() const;
+    Slab* create_slab();
+    void destroy_slab(Slab* slab);
+    // free objects hold the free list link
+    static void*& link(void* object)
+    { return *reinterpret_cast<void**>(object); }
+
+private:
+    const char* m_name;
+    size_t m_object_size;
+    size_t m_stride;
+
+    Slab* m_partial { nullptr };
+    Slab* m_full { nullptr };
+    Slab* m_empty { nullptr };
+
+    size_t m_active_objects { 0 };
+    size_t m_slabs { 0 };
+    size_t m_empty_slabs { 0 };
+    size_t m_allocations { 0 };
+
+    SlabCache* m_next_cache { nullptr };
+    bool m_registered { false };
+
+    static inline SlabCache* m_caches { nullptr }; // caches which have allocated at least one slab
+};
+
+// general purpose size-class caches, used by operator new ;
+// both return nullptr/false when the request must be handled by kmalloc/kfree instead
+void* slab_alloc(size_t size);
+bool slab_free(void* ptr);
+
+// for the class-specific operator new of hot objects which get their own cache. Objects of another size,
+// i.e. of a derived class, and allocations the cache can't serve go through the global operator new.
+// The global operator delete releases them all
+void* slab_alloc(SlabCache& cache, size_t size);
+
+#endif // SLAB_HPP
@@ -29,7 +29,9 @@ SOFTWARE.
 
 #include "shell/shell.hpp"
 #include "drivers/storage/disk.hpp"
+#include "drivers/storage/writeback.hpp"
 #include "utils/memutils.hpp"
+#include "mem/memmap.hpp"
 #include "utils/crc32.hpp"
 #include "fs/fsutils.hpp"
 #include "fs/vfs.hpp"
@@ -37,6 +39,7 @@ SOFTWARE.
 #include "fs/pathutils.hpp"
 #include "fs/devfs/devfs.hpp"
 #include "time/time.hpp"
+#include "tasking/workqueue.hpp"
 #include "terminal/escape_code_macros.hpp"
 
 void install_fs_commands(Shell &sh)
@@ -367,10 +370,298 @@ void install_fs_commands(Shell &sh)
      "Usage : sync",
      [](const std::vector<kpp::string>&)
      {
-         MessageBus::send(SyncDisksCache{});
+         uint64_t sectors { 0 }, commands { 0 };
+         for (Disk& disk : Disk::disks())
+         {
+             sectors -= disk.cache_stats().written_sectors;
+             commands -= disk.cache_stats().write_commands;
+         }
+
+         writeback::sync_all();
+
+         for (Disk& disk : Disk::disks())
+         {
+             sectors += disk.cache_stats().written_sectors;
+             commands += disk.cache_stats().write_commands;
+         }
+         kprintf("Wrote %llu sectors back in %llu commands\n", sectors, commands);
+
+         return 0;
+     }});
+
+    sh.register_command(
+    {"cachestat", "print disk cache statistics",
+     "Usage : cachestat",
+     [](const std::vector<kpp::string>&)
+     {
+         for (Disk& disk : Disk::disks())
+         {
+             if (disk.is_partition() || !disk.caching_enabled()) continue;
+
+             const auto stats = disk.cache_stats();
+             kprintf("%s : %d blocks cached, %d dirty (oldest %llu ms)\n", disk.drive_name().c_str(),
+                     stats.cached_blocks, stats.dirty_blocks, stats.oldest_dirty_us/1000);
+             kprintf("  written back : %llu sectors in %llu commands, %f MB/s\n",
+                     stats.written_sectors, stats.write_commands,
+                     stats.writeback_us ? stats.written_sectors*disk.sector_size()/(stats.writeback_us/1e6)/(1024*1024) : 0.);
+         }
+
          return 0;
      }});
 
+    sh.register_command(
+    {"cachebench", "benchmark file reads with and without the disk cache",
+     "Usage : cachebench <file> (chunk size)",
+     [&sh](const std::vector<kpp::string>& args)
+     {
+         if (args.empty())
+         {
+             sh.error("Usage : cachebench <file> (chunk size)\n");
+             return -1;
+         }
+
+         auto node = vfs::find(sh.get_path(args[0])).value_or(nullptr);
+         if (!node)
+         {
+             sh.error("file not found : '%s'\n", args[0].c_str());
+             return -2;
+         }
+
+         const size_t chunk = args.size() >= 2 ? kpp::stoul(args[1]) : 4096;
+         const size_t size = node->size();
+         if (!size || !chunk)
+         {
+             sh.error("nothing to read\n");
+             return -3;
+         }
+
+         // caching is set on the physical disks, partitions go through their cache
+         std::vector<bool> states;
+         for (Disk& disk : Disk::disks())
+         {
+             states.emplace_back(disk.caching_enabled());
+         }
+         auto set_caching = [](bool val)
+         {
+             for (Disk& disk : Disk::disks())
+             {
+                 if (!disk.is_partition()) (void)disk.enable_caching(val);
+             }
+         };
+
+         auto bench = [&](const char* label)
+         {
+             auto start = Time::uptime();
+             for (size_t offset { 0 }; offset < size; offset += chunk)
+             {
+                 if (!node->read(offset, std::min(chunk, size - offset)))
+                 {
+                     return false;
+                 }
+             }
+             const double time = Time::uptime() - start;
+
+             kprintf("%s : %s in %f ms (%f MB/s)\n", label, human_readable_size(size).c_str(),
+                     time*1000, size/(time*1024*1024));
+             return true;
+         };
+
+         // disabling the cache empties it, the first cached pass reads everything from the disks
+         set_caching(false);
+         bool ok = bench("uncached");
+         set_caching(true);
+         ok = ok && bench("cached, cold") && bench("cached, warm");
+
+         size_t i { 0 };
+         for (Disk& disk : Disk::disks())
+         {
+             (void)disk.enable_caching(states[i++]);
+         }
+
+         if (!ok)
+         {
+             sh.error("Error reading file %s\n", args[0].c_str());
+             return -4;
+         }
+
+         return 0;
+     }});
+    sh.register_command(
+    {"readbench", "count the bytes copied per byte read, through read and read_into",
+     "Usage : readbench <file> (chunk size)",
+     [&sh](const std::vector<kpp::string>& args)
+     {
+         if (args.empty())
+         {
+             sh.error("Usage : readbench <file> (chunk size)\n");
+             return -1;
+         }
+
+         auto node = vfs::find(sh.get_path(args[0])).value_or(nullptr);
+         if (!node)
+         {
+             sh.error("file not found : '%s'\n", args[0].c_str());
+             return -2;
+         }
+
+         const size_t chunk = args.size() >= 2 ? kpp::stoul(args[1]) : 4096;
+         const size_t size = node->size();
+         if (!size || !chunk)
+         {
+             sh.error("nothing to read\n");
+             return -3;
+         }
+
+         // page aligned like the user buffers sys_read gets, so the drivers may DMA straight into it
+         std::vector<uint8_t> buffer(chunk + Memory::page_size());
+         const gsl::span<uint8_t> dest { (uint8_t*)Memory::page((uintptr_t)buffer.data() + Memory::page_size() - 1), (long)chunk };
+
+         auto bench = [&](const char* label, bool into)
+         {
+             Disk::copied_bytes = 0;
+             auto start = Time::uptime();
+             for (size_t offset { 0 }; offset < size; offset += chunk)
+             {
+                 const size_t len = std::min(chunk, size - offset);
+                 if (into)
+                 {
+                     if (!node->read_into(offset, dest.subspan(0, len))) return false;
+                 }
+                 else
+                 {
+                     // what sys_read used to do : read into a temporary and copy it out
+                     auto data = node->read(offset, len);
+                     if (!data) return false;
+                     std::copy(data->begin(), data->end(), dest.begin());
+                     Disk::copied_bytes += data->size();
+                 }
+             }
+             const double time = Time::uptime() - start;
+
+             kprintf("%s : %f bytes copied per byte read, %f MB/s\n", label,
+                     (double)Disk::copied_bytes/size, size/(time*1024*1024));
+             return true;
+         };
+
+         // the cached blocks are written back and dropped, so that every read misses
+         auto drop_caches = []
+         {
+             for (Disk& disk : Disk::disks())
+             {
+                 if (disk.caching_enabled() && (!disk.enable_caching(false) || !disk.enable_caching(true))) return false;
+             }
+             return true;
+         };
+
+         // the first pass warms the cache so both are measured the same way.
+         // Misses of at least DiskCache::direct_read_size bypass the cache : use such a chunk size to see them copy nothing
+         if (!bench("read", false) || !bench("read", false) || !bench("read_into", true) ||
+             !drop_caches() || !bench("read_into (misses)", true))
+         {
+             sh.error("Error reading file %s\n", args[0].c_str());
+             return -4;
+         }
+
+         return 0;
+     }});
+    sh.register_command(
+    {"iobench", "measure the random read IOPS of a disk with concurrent readers",
+     "Usage : iobench <disk number> (max readers) (reads per reader)",
+     [&sh](const std::vector<kpp::string>& args)
+     {
+         if (args.empty())
+         {
+             sh.error("Usage : iobench <disk number> (max readers) (reads per reader)\n");
+             return -1;
+         }
+
+         // numbered in lsblk order
+         const size_t index = kpp::stoul(args[0]);
+         if (index >= Disk::disks().size())
+         {
+             sh.error("no disk %d\n", index);
+             return -2;
+         }
+         Disk& disk = Disk::disks()[index];
+
+         const size_t max_readers = args.size() >= 2 ? kpp::stoul(args[1]) : 32;
+         const size_t reads = args.size() >= 3 ? kpp::stoul(args[2]) : 256;
+         constexpr size_t read_size = 4096;
+         if (!max_readers || !reads || disk.disk_size() < read_size)
+         {
+             sh.error("nothing to read\n");
+             return -3;
+         }
+
+         // the readers are threads which never exit, they're kept for the next runs
+         static std::vector<std::unique_ptr<tasking::WorkQueue>> readers;
+         while (readers.size() < max_readers)
+         {
+             readers.emplace_back(std::make_unique<tasking::WorkQueue>("iobench" + kpp::to_string(readers.size())));
+         }
+
+         // each read must reach the disk
+         std::vector<bool> states;
+         for (Disk& d : Disk::disks())
+         {
+             states.emplace_back(d.caching_enabled());
+             if (!d.is_partition()) (void)d.enable_caching(false);
+         }
+
+         const size_t blocks = disk.disk_size() / read_size;
+         tasking::WaitQueue finished_wait;
+         bool ok { true };
+
+         for (size_t count { 1 }; count <= max_readers && ok; count *= 2)
+         {
+             size_t running { count };
+             size_t errors { 0 };
+
+             auto start = Time::uptime();
+             for (size_t i { 0 }; i < count; ++i)
+             {
+                 readers[i]->queue([&, i]
+                 {
+                     // page aligned, like the buffers the readers of a file system get
+                     std::vector<uint8_t> buffer(read_size + Memory::page_size());
+                     const gsl::span<uint8_t> dest { (uint8_t*)Memory::page((uintptr_t)buffer.data() + Memory::page_size() - 1), (long)read_size };
+
+                     uint32_t seed = 2463534242u + i*7919;
+                     for (size_t n { 0 }; n < reads; ++n)
+                     {
+                         // xorshift32
+                         seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+                         if (!disk.read_into((seed % blocks) * read_size, dest)) ++errors;
+                     }
+
+                     --running;
+                     finished_wait.wake_one();
+                 });
+             }
+             finished_wait.wait([&running]{ return running == 0; });
+             const double time = Time::uptime() - start;
+
+             kprintf("%d readers : %f IOPS\n", count, count*reads/time);
+             ok = errors == 0;
+         }
+
+         size_t i { 0 };
+         for (Disk& d : Disk::disks())
+         {
+             (void)d.enable_caching(states[i++]);
+         }
+
+         if (!ok)
+         {
+             sh.error("Error reading disk %s\n", disk.drive_name().c_str());
+             return -4;
+         }
+
+         return 0;
+     }});
+
+
+
     // TODO : do this to others (le sh.get_path)
     sh.register_command(
     {"mkdir", "creates a directory",
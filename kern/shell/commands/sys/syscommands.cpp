@@ -29,6 +29,8 @@ SOFTWARE.
 
 #include "shell/shell.hpp"
 #include "mem/meminfo.hpp"
+#include "mem/memmap.hpp"
+#include "mem/slab.hpp"
 #include "power/powermanagement.hpp"
 #include "time/time.hpp"
 #include "drivers/pci/pci.hpp"
@@ -48,6 +50,17 @@ void install_sys_commands(Shell &sh)
          kprintf("Allocated memory : %s\n", human_readable_size(MemoryInfo::allocated()).c_str());
          kprintf("Used memory : %s\n", human_readable_size(MemoryInfo::used()).c_str());
          kprintf("Maximal Used memory : %s\n", human_readable_size(MemoryInfo::max_usage()).c_str());
+
+         for (bool user : {false, true})
+         {
+             const auto stats = Memory::virtual_space_stats(user);
+             // share of the free space which isn't part of the largest free range
+             const size_t fragmentation = stats.free_pages ? 100 - stats.largest_free_range*100/stats.free_pages : 0;
+
+             kprintf("%s virtual space : %s free in %d ranges, largest %s, fragmentation %d%%\n", user ? "User" : "Kernel",
+                     human_readable_size(stats.free_pages*Memory::page_size()).c_str(), stats.free_ranges,
+                     human_readable_size(stats.largest_free_range*Memory::page_size()).c_str(), fragmentation);
+         }
          return 0;
      }});
 
@@ -57,6 +70,68 @@ void install_sys_commands(Shell &sh)
      [](const std::vector<kpp::string>&)
      {
          liballoc_dump();
+         SlabCache::dump();
+         return 0;
+     }});
+
+    sh.register_command(
+    {"physbench", "Benchmark the physical page allocator",
+     "Usage : 'physbench [iterations]'",
+     [](const std::vector<kpp::string>& args)
+     {
+         const size_t iterations = args.size() >= 1 ? kpp::stoul(args[0]) : 10000;
+         constexpr size_t fragment_pages = 4096;
+
+         // fragment memory : allocate a bunch of pages and free every other one
+         std::vector<uintptr_t> pages;
+         pages.reserve(fragment_pages);
+         for (size_t i { 0 }; i < fragment_pages; ++i)
+         {
+             pages.emplace_back(Memory::allocate_physical_page());
+         }
+         for (size_t i { 0 }; i < pages.size(); i += 2)
+         {
+             Memory::release_physical_page(pages[i]);
+         }
+
+         // alloc and free in batches, to keep the memory footprint reasonable
+         constexpr size_t batch_size = 64;
+         kpp::array<uintptr_t, batch_size> blocks;
+         for (size_t order : {0, 1, 4})
+         {
+             double alloc_time { 0 };
+             double free_time { 0 };
+             for (size_t batch { 0 }; batch < iterations / batch_size; ++batch)
+             {
+                 auto start = Time::uptime();
+                 for (auto& block : blocks)
+                 {
+                     block = Memory::allocate_physical_pages(order);
+                 }
+                 auto mid = Time::uptime();
+                 for (auto block : blocks)
+                 {
+                     Memory::release_physical_pages(block, order);
+                 }
+                 auto end = Time::uptime();
+
+                 alloc_time += mid - start;
+                 free_time  += end - mid;
+             }
+
+             const size_t count = iterations / batch_size * batch_size;
+             kprintf("order %d : %d allocs in %f ms (%f ns/op), %d frees in %f ms (%f ns/op)\n", order,
+                     count, alloc_time*1000, alloc_time*1e9/count,
+                     count, free_time*1000, free_time*1e9/count);
+         }
+
+         for (size_t i { 1 }; i < pages.size(); i += 2)
+         {
+             Memory::release_physical_page(pages[i]);
+         }
+
+         kprintf("Free physical memory : %s\n", human_readable_size(Memory::free_physical_pages()*Memory::page_size()).c_str());
+
          return 0;
      }});
 
@@ -40,6 +40,7 @@ SOFTWARE.
 #include "utils/demangle.hpp"
 
 #include "halt.hpp"
+#include "tasking/workqueue.hpp"
 
 Shell::Shell()
 {
@@ -177,7 +178,7 @@ kpp::string Shell::read_input()
     term().set_accept_input(true);
     while (m_waiting_input)
     {
-        wait_for_interrupts();
+        tasking::wait_for_work();
     }
     term().set_accept_input(false);
     return m_input;
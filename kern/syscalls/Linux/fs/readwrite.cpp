@@ -26,6 +26,7 @@ SOFTWARE.
 #include "syscalls/Linux/syscalls.hpp"
 
 #include "tasking/process.hpp"
+#include "tasking/process_data.hpp"
 #include "sys/fnctl.h"
 #include "errno.h"
 #include "drivers/storage/disk.hpp"
@@ -35,7 +36,7 @@ SOFTWARE.
 
 size_t sys_read(unsigned int fd, user_ptr<void> buf, size_t count)
 {
-    if (!buf.check())
+    if (!buf.check(count))
     {
         return -EFAULT;
     }
@@ -57,24 +58,31 @@ size_t sys_read(unsigned int fd, user_ptr<void> buf, size_t count)
         return -EIO;
     }
 
-    MemBuffer data;
+    // fault the destination pages in for writing beforehand : drivers may DMA straight into them
+    auto& process = Process::current();
+    uint8_t* dest = (uint8_t*)buf.get();
+    for (uintptr_t page = Memory::page((uintptr_t)dest); page < (uintptr_t)dest + count; page += Memory::page_size())
+    {
+        auto it = process.data->mappings->find(page);
+        if (it == process.data->mappings->end() || !(it->second.flags & Memory::Write))
+        {
+            return -EFAULT;
+        }
+        process.resolve_page_fault(page, true);
+    }
 
-    auto result = node->read(fd_entry->cursor, count);
+    auto result = node->read_into(fd_entry->cursor, {dest, (gsl::span<uint8_t>::index_type)(count)});
     if (!result)
     {
         return -result.error().to_errno();
     }
 
-    data = std::move(result.value());
-
-    if (data.empty() && count != 0)
+    if (result.value() == 0 && count != 0)
     {
         return -EIO;
     }
 
-    std::copy(data.begin(), data.end(), (uint8_t*)buf.get());
-
-    return data.size(); // again, to allow errno numbers
+    return result.value(); // again, to allow errno numbers
 }
 
 size_t sys_write(unsigned int fd, user_ptr<const void> buf, size_t count)
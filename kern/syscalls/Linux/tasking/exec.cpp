@@ -24,18 +24,11 @@ SOFTWARE.
 */
 
 #include "syscalls/syscalls.hpp"
+#include "syscalls/exec_utils.hpp"
 
 #include "tasking/process.hpp"
 #include "tasking/process_data.hpp"
-#include "tasking/loaders/process_loader.hpp"
-#include "mem/meminfo.hpp"
-#include "fs/fsutils.hpp"
 #include "fs/pathutils.hpp"
-#include "fs/vfs.hpp"
-#include "drivers/storage/disk.hpp"
-#include "mem/meminfo.hpp"
-#include "utils/memutils.hpp"
-#include "utils/align.hpp"
 
 #include <errno.h>
 
@@ -44,7 +37,6 @@ extern "C" void enter_ring3(uint32_t esp, uint32_t eip, uint32_t argc, uint32_t
 std::vector<kpp::string> args;
 Process* process { nullptr };
 
-// TODO : ETXTBSY
 // TODO : envp
 int sys_execve(user_ptr<const char> path, user_ptr<user_ptr<const char>> argv, user_ptr<user_ptr<const char>> envp)
 {
@@ -54,54 +46,27 @@ int sys_execve(user_ptr<const char> path, user_ptr<user_ptr<const char>> argv, u
     }
 
     {
-        auto res = vfs::user_find(path.get());
-        if (res.target_node == nullptr)
+        if (int err = copy_user_args(argv, args))
         {
-            return -ENOENT;
-        }
-        if (res.target_node->type() != vfs::node::File)
-        {
-            return -ENOENT;
+            return err;
         }
 
-        if (!Process::current().check_perms(res.target_node->stat().perms, res.target_node->stat().uid,
-                                            res.target_node->stat().gid, Process::AccessRequestPerm::ExecRequest))
+        Executable exe;
+        if (int err = open_executable(path.get(), exe))
         {
-            return -EACCES;
+            return err;
         }
 
-        args.clear();
-        user_ptr<const char>* str = argv.get();
-        if (!str->check()) return -EFAULT;
-        while (str->get())
+        // the new program starts with a single thread, which has to keep the pid of the process
+        if (Process::current().is_thread())
         {
-            args.emplace_back(str->get());
-            str++;
-            if (!str->check()) return -EFAULT;
+            return -EINVAL;
         }
-
-        if (!Process::check_args_size(args))
-        {
-            return -E2BIG;
-        }
-
-        auto result = res.target_node->read();
-        if (!result)
-        {
-            return -result.error().to_errno();
-        }
-
-        MemBuffer data = std::move(result.value());
-
-        if (data.empty())
-        {
-            return -EIO;
-        }
-
-        auto loader = ProcessLoader::get(data);
-        if (!loader)
+        Process::current().kill_other_threads();
+        // the ones blocked in the kernel end their syscall first, they still use the address space
+        if (!Process::current().wait_for_other_threads())
         {
-            return -ENOEXEC;
+            return -EINTR;
         }
 
         kpp::string proc_name = path.get();
@@ -109,7 +74,7 @@ int sys_execve(user_ptr<const char> path, user_ptr<user_ptr<const char>> argv, u
         process = &Process::current();
 
         process->unswitch();
-        loader->load(*process);
+        exe.loader->load(*process);
 
         process->set_args(args);
         process->data->name = filename(proc_name);
@@ -31,6 +31,7 @@ SOFTWARE.
 
 #include <sys/wait.h>
 
+// ends the calling thread, or the whole process if it's its first thread
 void sys_exit(uint8_t errcode)
 {
     Process::kill(Process::current().pid, __W_EXITCODE(errcode, 0));
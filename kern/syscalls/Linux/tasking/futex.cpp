@@ -0,0 +1,78 @@
+/*
+futex.cpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "syscalls/syscalls.hpp"
+
+#include "tasking/process.hpp"
+#include "tasking/futex.hpp"
+
+#include "mem/memmap.hpp"
+
+#include <sys/thread.h>
+#include <sys/time.h>
+
+#include <errno.h>
+#include <algorithm.hpp>
+
+int sys_futex(user_ptr<int> uaddr, int op, int val, user_ptr<const struct timespec> timeout)
+{
+    if (!uaddr.check()) return -EFAULT;
+    if (uaddr.as_raw() % sizeof(int)) return -EINVAL;
+
+    // the futex is keyed on the physical address, make sure the word has its own page :
+    // not the zero page nor a copy-on-write one shared with another process
+    Process::current().resolve_page_fault(uaddr.as_raw(), true);
+    const uintptr_t key = Memory::physical_address(uaddr.get());
+
+    switch (op & ~FUTEX_PRIVATE_FLAG)
+    {
+        case FUTEX_WAIT:
+        {
+            uint32_t timeout_ms { 0 };
+            if (timeout.as_raw())
+            {
+                if (!timeout.check()) return -EFAULT;
+
+                const auto& ts = *timeout.get();
+                if (ts.tv_sec < 0 || ts.tv_nsec < 0 || ts.tv_nsec >= 1'000'000'000) return -EINVAL;
+
+                // rounded up, and saturated : that's about 49 days
+                const uint64_t ms = uint64_t(ts.tv_sec)*1000 + (ts.tv_nsec + 999'999)/1'000'000;
+                timeout_ms = std::min<uint64_t>(ms, uint32_t(-1));
+            }
+
+            if (*uaddr.get() != val) return -EAGAIN;
+            if (timeout.as_raw() && timeout_ms == 0) return -ETIMEDOUT;
+
+            return tasking::futex_wait(key, timeout_ms) ? EOK : -ETIMEDOUT;
+        }
+
+        case FUTEX_WAKE:
+            return tasking::futex_wake(key, val < 0 ? 0 : val);
+
+        default:
+            return -ENOSYS;
+    }
+}
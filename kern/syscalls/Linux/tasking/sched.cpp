@@ -27,8 +27,25 @@ SOFTWARE.
 #include "tasking/process.hpp"
 
 #include "tasking/scheduler.hpp"
+#include "tasking/process_data.hpp"
+
+#include <errno.h>
 
 void sys_sched_yield()
 {
     tasking::schedule();
 }
+
+// returns 0 like Linux does, a negative nice value couldn't be told apart from an error
+int sys_nice(int inc)
+{
+    auto& process = Process::current();
+    if (inc < 0 && process.data->uid != Process::root_uid)
+    {
+        return -EPERM;
+    }
+
+    tasking::set_nice(process, process.data->sched.nice + inc);
+
+    return 0;
+}
@@ -39,6 +39,10 @@ int sys_kill(pid_t pid, int sig)
     {
         return -ESRCH;
     }
+    if (proc->is_kernel_thread())
+    {
+        return -EPERM;
+    }
     if (sig >= SIGRTMAX)
     {
         return -EINVAL;
@@ -27,32 +27,39 @@ SOFTWARE.
 #include "tasking/process.hpp"
 
 #include "tasking/scheduler.hpp"
+#include "tasking/process_data.hpp"
 
 #include <errno.h>
 
 pid_t sys_waitpid(pid_t pid, user_ptr<int> wstatus, int options)
 {
     if (!wstatus.check()) return -EFAULT;
+    if (pid != -1 && pid <= 0) return -EINVAL;
 
-    // pid doesn't exist or isn't a child
-    if (Process::by_pid(pid) == nullptr || Process::by_pid(pid)->parent != Process::current().pid)
+    // the child might have already exited
+    if (auto status = Process::current().take_exit_status(pid))
     {
-        return -ECHILD;
+        *wstatus.get() = status->second;
+        return status->first;
     }
 
     if (pid == -1)
     {
-        Process::current().wait_for(pid, wstatus.get());
-    }
-    else if (pid > 0)
-    {
-        Process::current().wait_for(pid, wstatus.get());
+        // any child, as long as there is one left
+        if (Process::current().data->children.empty()) return -ECHILD;
     }
     else
     {
-        return -EINVAL;
+        // pid doesn't exist or isn't a child, threads can't be waited for
+        auto proc = Process::by_pid(pid);
+        if (proc == nullptr || proc->parent != Process::current().pid || proc->is_thread())
+        {
+            return -ECHILD;
+        }
     }
 
+    Process::current().wait_for(pid, wstatus.get());
+
     tasking::schedule();
 
     // It doesn't actually return here
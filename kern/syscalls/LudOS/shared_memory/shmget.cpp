@@ -56,9 +56,9 @@ int sys_shmget(key_t key, size_t size, int shmflags)
         auto shm = create_shared_mem(key, size);
         if (!shm) return -ENOMEM;
 
-        assert(!Process::current().data->shm_list.count(key));
-        Process::current().data->shm_list[key].shm = shm;
-        Process::current().data->shm_list[key].v_addr = nullptr; // not yet mapped
+        assert(!Process::current().data->shm_list->count(key));
+        (*Process::current().data->shm_list)[key].shm = shm;
+        (*Process::current().data->shm_list)[key].v_addr = nullptr; // not yet mapped
 
         return key;
     }
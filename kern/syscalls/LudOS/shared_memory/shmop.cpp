@@ -61,8 +61,8 @@ long sys_shmat(int shmid, user_ptr<const void> shmaddr, int shmflg)
         assert(!Memory::is_mapped((void*)v_addr));
     }
 
-    Process::current().data->shm_list.at(shmid).v_addr = (void*)v_addr;
-    Process::current().data->shm_list.at(shmid).shm->map((void*)v_addr);
+    Process::current().data->shm_list->at(shmid).v_addr = (void*)v_addr;
+    Process::current().data->shm_list->at(shmid).shm->map((void*)v_addr);
 
     return v_addr;
 }
@@ -75,9 +75,12 @@ long sys_shmdt(user_ptr<const void> shmaddr)
     }
     uintptr_t v_addr = (uintptr_t)shmaddr.get();
 
-    erase_if(Process::current().data->shm_list, [v_addr](const std::pair<unsigned int, tasking::ShmEntry>& pair)
+    erase_if(*Process::current().data->shm_list, [v_addr](const std::pair<unsigned int, tasking::ShmEntry>& pair)
     {
-        return (uintptr_t)pair.second.v_addr == v_addr;
+        if ((uintptr_t)pair.second.v_addr != v_addr) return false;
+
+        pair.second.shm->unmap(pair.second.v_addr);
+        return true;
     });
 
     return 0;
@@ -0,0 +1,109 @@
+/*
+spawn.cpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "syscalls/syscalls.hpp"
+#include "syscalls/exec_utils.hpp"
+
+#include "tasking/process.hpp"
+#include "tasking/process_data.hpp"
+#include "tasking/scheduler.hpp"
+#include "fs/pathutils.hpp"
+
+#include <errno.h>
+
+// creates a process running 'path' directly, instead of copying the caller with fork only to discard it in execve.
+// The child gets the fd table of the caller, or if fd_map is given, fd_map[i] as its fd i (closed if it's -1)
+pid_t sys_spawn(user_ptr<const char> path, user_ptr<user_ptr<const char>> argv, user_ptr<const int> fd_map, size_t fd_count)
+{
+    if (!path.check() || !argv.check())
+    {
+        return -EFAULT;
+    }
+    if (fd_map.as_raw() && !fd_map.check(fd_count * sizeof(int)))
+    {
+        return -EFAULT;
+    }
+
+    auto& parent = Process::current();
+
+    std::vector<kpp::string> args;
+    if (int err = copy_user_args(argv, args))
+    {
+        return err;
+    }
+
+    auto fd_table = std::make_shared<std::vector<tasking::FDInfo>>();
+    if (fd_map.as_raw())
+    {
+        for (size_t i { 0 }; i < fd_count; ++i)
+        {
+            const int fd = fd_map.get()[i];
+            if (fd < 0)
+            {
+                fd_table->emplace_back();
+                continue;
+            }
+
+            auto info = parent.get_fd(fd);
+            if (!info) return -EBADF;
+
+            fd_table->emplace_back(*info);
+        }
+    }
+    else
+    {
+        *fd_table = *parent.data->fd_table;
+    }
+
+    Executable exe;
+    if (int err = open_executable(path.get(), exe))
+    {
+        return err;
+    }
+
+    auto child = Process::create(args);
+    if (!child) return -ENOMEM;
+
+    child->data->name = filename(path.get());
+    child->data->uid = parent.data->uid;
+    child->data->gid = parent.data->gid;
+    child->data->pwd = parent.data->pwd;
+    child->data->root = parent.data->root;
+    child->data->fd_table = fd_table;
+    child->parent = parent.pid;
+
+    // it never existed as far as the parent is concerned : no exit status is left for waitpid
+    if (!exe.loader->load(*child))
+    {
+        Process::destroy(child->pid, 0);
+        return -ENOEXEC;
+    }
+
+    parent.data->children.emplace_back(child->pid);
+
+    tasking::make_ready(*child);
+
+    return child->pid;
+}
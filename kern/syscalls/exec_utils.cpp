@@ -0,0 +1,93 @@
+/*
+exec_utils.cpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "exec_utils.hpp"
+
+#include "tasking/process.hpp"
+#include "fs/fsutils.hpp"
+#include "fs/vfs.hpp"
+
+#include <errno.h>
+
+// TODO : ETXTBSY
+int open_executable(const kpp::string &path, Executable &exe)
+{
+    auto res = vfs::user_find(path);
+    if (res.target_node == nullptr)
+    {
+        return -ENOENT;
+    }
+    if (res.target_node->type() != vfs::node::File)
+    {
+        return -ENOENT;
+    }
+
+    if (!Process::current().check_perms(res.target_node->stat().perms, res.target_node->stat().uid,
+                                        res.target_node->stat().gid, Process::AccessRequestPerm::ExecRequest))
+    {
+        return -EACCES;
+    }
+
+    auto result = res.target_node->read();
+    if (!result)
+    {
+        return -result.error().to_errno();
+    }
+
+    exe.data = std::move(result.value());
+
+    if (exe.data.empty())
+    {
+        return -EIO;
+    }
+
+    exe.loader = ProcessLoader::get(exe.data);
+    if (!exe.loader)
+    {
+        return -ENOEXEC;
+    }
+
+    return 0;
+}
+
+int copy_user_args(user_ptr<user_ptr<const char>> argv, std::vector<kpp::string> &args)
+{
+    args.clear();
+    user_ptr<const char>* str = argv.get();
+    if (!str->check()) return -EFAULT;
+    while (str->get())
+    {
+        args.emplace_back(str->get());
+        str++;
+        if (!str->check()) return -EFAULT;
+    }
+
+    if (!Process::check_args_size(args))
+    {
+        return -E2BIG;
+    }
+
+    return 0;
+}
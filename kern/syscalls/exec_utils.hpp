@@ -0,0 +1,51 @@
+/*
+exec_utils.hpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef EXEC_UTILS_HPP
+#define EXEC_UTILS_HPP
+
+#include <vector.hpp>
+#include <memory.hpp>
+
+#include <kstring/kstring.hpp>
+
+#include "tasking/loaders/process_loader.hpp"
+#include "utils/membuffer.hpp"
+#include "utils/user_ptr.hpp"
+
+// shared by execve and spawn
+
+struct Executable
+{
+    MemBuffer data;
+    std::unique_ptr<ProcessLoader> loader; // refers to data
+};
+
+// reads the program at 'path' if the current process can execute it, returns 0 or -errno
+int open_executable(const kpp::string& path, Executable& exe);
+
+// copies a null terminated argv array from user space, returns 0 or -errno
+int copy_user_args(user_ptr<user_ptr<const char>> argv, std::vector<kpp::string>& args);
+
+#endif // EXEC_UTILS_HPP
@@ -0,0 +1,94 @@
+/*
+futex.cpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "futex.hpp"
+
+#include <memory.hpp>
+#include <unordered_map.hpp>
+
+#include "waitqueue.hpp"
+
+#include "time/timer.hpp"
+
+namespace tasking
+{
+
+namespace
+{
+// a queue is only kept while someone waits on it
+std::unordered_map<uintptr_t, std::unique_ptr<WaitQueue>> futexes;
+
+void release_if_unused(uintptr_t key)
+{
+    auto it = futexes.find(key);
+    if (it != futexes.end() && it->second->empty())
+    {
+        futexes.erase(it);
+    }
+}
+}
+
+bool futex_wait(uintptr_t key, uint32_t timeout)
+{
+    auto& queue = futexes[key];
+    if (!queue) queue = std::make_unique<WaitQueue>();
+
+    const uint64_t deadline = Timer::now_us() + uint64_t(timeout) * 1000;
+
+    // any wake up ends the wait, including the timeout and signals : the caller checks its futex word again.
+    // The queue might be released once we're woken up, so it isn't touched afterwards
+    bool queued = false;
+    queue->wait_killable([&queued]
+    {
+        const bool woken = queued;
+        queued = true;
+        return woken;
+    }, timeout);
+
+    release_if_unused(key);
+
+    return timeout == 0 || Timer::now_us() < deadline;
+}
+
+size_t futex_wake(uintptr_t key, size_t count)
+{
+    auto it = futexes.find(key);
+    if (it == futexes.end())
+    {
+        return 0;
+    }
+
+    size_t woken { 0 };
+    while (woken < count && it->second->wake_one())
+    {
+        ++woken;
+    }
+
+    release_if_unused(key);
+
+    return woken;
+}
+
+}
@@ -0,0 +1,44 @@
+/*
+futex.hpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef FUTEX_HPP
+#define FUTEX_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace tasking
+{
+
+// Futexes are keyed on the physical address of their word, so that processes sharing memory can use them too.
+// The caller checks the word before waiting, under the kernel lock, so a wake up can't be missed.
+
+// waits on the futex until woken up, timeout in ms, 0 to wait forever. Returns false if it expired
+bool futex_wait(uintptr_t key, uint32_t timeout = 0);
+// wakes up to 'count' waiters, returns how many were woken up
+size_t futex_wake(uintptr_t key, size_t count);
+
+}
+
+#endif // FUTEX_HPP
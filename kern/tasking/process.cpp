@@ -33,26 +33,131 @@ SOFTWARE.
 #include "mem/memmap.hpp"
 #include "mem/meminfo.hpp"
 #include "mem/page_fault.hpp"
+#include "mem/slab.hpp"
 
 #include "utils/messagebus.hpp"
 #include "utils/stlutils.hpp"
 #include "utils/memutils.hpp"
 
 #include "shared_memory.hpp"
+#include "scheduler.hpp"
 
 #include "fs/vfs.hpp"
+#include "futex.hpp"
+#include "waitqueue.hpp"
+
+#include "time/time.hpp"
 
 #include <sys/wait.h>
+#include <sys/vdso.h>
 #include <siginfo.h>
 
 extern "C" void signal_trampoline();
 
 using namespace tasking;
 
+// Number of processes referencing a page shared by fork(), pages absent from this table have a single owner
+static std::unordered_map<uintptr_t, size_t> shared_pages;
+
+static uintptr_t allocate_zeroed_page(gsl::span<const uint8_t> contents = {});
+
+// shared read-only page backing the pages mapped on demand which were only read from
+static uintptr_t zero_page()
+{
+    static uintptr_t page = allocate_zeroed_page();
+    return page;
+}
+
+static void add_page_reference(uintptr_t paddr)
+{
+    if (paddr == zero_page()) return;
+
+    if (auto it = shared_pages.find(paddr); it != shared_pages.end())
+    {
+        ++it->second;
+    }
+    else
+    {
+        shared_pages[paddr] = 2;
+    }
+}
+
+// returns true if the page isn't referenced by anyone else
+static bool drop_page_reference(uintptr_t paddr)
+{
+    if (paddr == zero_page()) return false; // never released
+
+    auto it = shared_pages.find(paddr);
+    if (it == shared_pages.end())
+    {
+        return true;
+    }
+
+    if (--it->second == 1)
+    {
+        shared_pages.erase(it);
+    }
+
+    return false;
+}
+
+// allocates a page filled with 'contents' and padded with zeroes
+static uintptr_t allocate_zeroed_page(gsl::span<const uint8_t> contents)
+{
+    assert(contents.size() <= (int)Memory::page_size());
+
+    uintptr_t paddr = Memory::allocate_physical_page();
+
+    if (!contents.empty()) Memory::phys_write(paddr, contents.data(), contents.size());
+    if (contents.size() < (int)Memory::page_size()) Memory::phys_memset(paddr + contents.size(), 0, Memory::page_size() - contents.size());
+
+    return paddr;
+}
+
+static void release_page(const MemoryMapping& mapping)
+{
+    if (!mapping.owned || (mapping.flags & Memory::OnDemand)) return; // nothing to release
+
+    if (drop_page_reference(mapping.paddr))
+    {
+        Memory::release_physical_page(mapping.paddr);
+    }
+}
+
+static uintptr_t copy_physical_page(uintptr_t src)
+{
+    uintptr_t paddr = Memory::allocate_physical_page();
+
+    Memory::phys_copy(paddr, src, Memory::page_size());
+
+    return paddr;
+}
+
+namespace
+{
+SlabCache process_cache { "process", sizeof(Process) };
+SlabCache process_data_cache { "process_data", sizeof(ProcessData) };
+
+// woken up each time a thread is destroyed
+tasking::WaitQueue thread_exits;
+}
+
+void* Process::operator new(size_t size)
+{
+    return slab_alloc(process_cache, size);
+}
+
+void* ProcessData::operator new(size_t size)
+{
+    return slab_alloc(process_data_cache, size);
+}
+
 Process::Process()
 {
     data = std::make_unique<ProcessData>();
 
+    data->mappings = std::make_shared<std::unordered_map<uintptr_t, MemoryMapping>>();
+    data->shm_list = std::make_shared<std::unordered_map<unsigned int, ShmEntry>>();
     data->pwd = vfs::root;
     data->root = vfs::root;
     init_default_fds();
@@ -95,11 +200,11 @@ void Process::init_sig_handlers()
     }
 }
 
-pid_t Process::find_free_pid()
+pid_t Process::find_free_pid(pid_t first)
 {
-    for (size_t i { 0 }; i < m_processes.size(); ++i)
+    for (size_t i = first; i < m_processes.size(); ++i)
     {
-        if (!m_processes[i]) return i;
+        if (!m_processes[i] && !m_unreaped.count(i)) return i;
     }
 
     return m_processes.size();
@@ -139,6 +244,16 @@ void Process::close_fd(size_t fd)
     (*data->fd_table)[fd].node = nullptr;
 }
 
+bool Process::is_kernel_thread() const
+{
+    return data->kernel_thread;
+}
+
+bool Process::is_thread() const
+{
+    return pid != tgid;
+}
+
 bool Process::is_waiting() const
 {
     return data->waiting_pid.has_value();
@@ -148,10 +263,28 @@ void Process::wait_for(pid_t pid, int *wstatus)
 {
     data->waiting_pid = pid;
     data->wstatus = wstatus;
+    resolve_page_fault((uintptr_t)wstatus, true); // make sure the page is backed by a private physical page
     data->waitstatus_phys = Memory::physical_address(wstatus);
     assert(data->wstatus);
 }
 
+kpp::optional<std::pair<pid_t, int>> Process::take_exit_status(pid_t pid)
+{
+    auto& statuses = data->exit_statuses;
+    for (auto it = statuses.begin(); it != statuses.end(); ++it)
+    {
+        if (pid == -1 || it->first == pid)
+        {
+            const auto status = *it;
+            statuses.erase(it);
+            m_unreaped.erase(status.first);
+            return status;
+        }
+    }
+
+    return {};
+}
+
 bool Process::check_perms(uint16_t perms, uint16_t tgt_uid, uint16_t tgt_gid, uint16_t type)
 {
     uint16_t user_flag  = (type == AccessRequestPerm::ReadRequest ? vfs::UserRead :
@@ -188,7 +321,7 @@ Process &Process::current()
 {
     assert(enabled());
 
-    return *m_current_process;
+    return *m_current_process.get();
 }
 
 size_t Process::count()
@@ -202,6 +335,9 @@ void Process::raise(pid_t target_pid, int signal, const siginfo_t &siginfo)
     assert(proc);
     assert(signal < proc->data->sig_handlers->size());
 
+    if (proc->is_kernel_thread()) return; // kernel threads don't take signals
+    if (proc->data->pending_kill) return; // already dying
+
     log_serial("Sent signal %d to pid %d\n", signal, target_pid);
 
     auto sig = proc->data->sig_handlers->at(signal);
@@ -211,7 +347,7 @@ void Process::raise(pid_t target_pid, int signal, const siginfo_t &siginfo)
             return;
         case SIG_ACTION_CORE:
         case SIG_ACTION_TERM:
-            Process::kill(target_pid, __W_STOPCODE(signal));
+            Process::kill(proc->tgid, __W_STOPCODE(signal)); // the whole process dies
             return;
         case SIG_ACTION_STOP:
             // TODO
@@ -232,8 +368,43 @@ void Process::kill(pid_t pid, int err_code)
     {
         panic("Tried to kill the master process !\n");
     }
+    if (by_pid(pid) && by_pid(pid)->is_kernel_thread())
+    {
+        panic("Tried to kill kernel thread %d ('%s') !\n", pid, by_pid(pid)->data->name.c_str());
+    }
 
     assert(by_pid(pid));
+    auto& proc = *by_pid(pid);
+    if (proc.is_thread())
+    {
+        if (proc.kill_later(err_code)) return;
+
+        // the rest of the process keeps running
+        const pid_t tgid = proc.tgid;
+        destroy(pid, err_code);
+
+        // the process was only waiting for this thread to leave the kernel
+        auto leader = by_pid(tgid);
+        if (leader && leader->data->sched.stopped && !leader->has_other_threads())
+        {
+            kill(leader->pid, *leader->data->pending_kill);
+        }
+        return;
+    }
+
+    // the threads go away with their process
+    proc.kill_other_threads();
+    if (proc.kill_later(err_code)) return;
+    if (proc.has_other_threads())
+    {
+        // it doesn't run anymore, the last of its threads to leave the kernel ends the kill
+        if (!proc.data->pending_kill) proc.data->pending_kill = err_code;
+        proc.data->sched.stopped = true;
+        proc.stop_on_other_cpus();
+        tasking::dequeue(proc);
+        return;
+    }
+
     assert(by_pid(by_pid(pid)->parent));
     auto& parent = *by_pid(by_pid(pid)->parent);
 
@@ -245,12 +416,13 @@ void Process::kill(pid_t pid, int err_code)
     {
         log_serial("Waking up PID %d with PID %d\n", parent.pid, pid);
         parent.wake_up(pid, err_code);
+        tasking::make_ready(parent);
     }
-
-    if (Process::current().pid == pid)
+    else
     {
-        Process::current().unswitch();
-        m_current_process = nullptr;
+        // kept for a later waitpid
+        parent.data->exit_statuses.emplace_back(pid, err_code);
+        m_unreaped.emplace(pid);
     }
 
     siginfo_t info;
@@ -259,18 +431,122 @@ void Process::kill(pid_t pid, int err_code)
     info.si_pid = pid;
     info.si_uid = m_processes[pid]->data->uid;
     info.si_status = err_code;
+
+    destroy(pid, err_code);
+
+    //parent.raise(parent.pid, SIGCHLD, info);
+}
+
+void Process::kill_other_threads()
+{
+    for (pid_t thread : process_list())
+    {
+        auto proc = by_pid(thread);
+        if (thread != pid && proc->tgid == tgid && !proc->kill_later(__W_STOPCODE(SIGKILL)))
+        {
+            destroy(thread, __W_STOPCODE(SIGKILL));
+        }
+    }
+}
+
+bool Process::wait_for_other_threads()
+{
+    return thread_exits.wait_killable([this]{ return !has_other_threads(); });
+}
+
+bool Process::has_other_threads() const
+{
+    for (pid_t thread : process_list())
+    {
+        if (thread != pid && by_pid(thread)->tgid == tgid) return true;
+    }
+
+    return false;
+}
+
+bool Process::kill_later(int err_code)
+{
+    if (!suspended_in_kernel()) return false;
+
+    if (!data->pending_kill) data->pending_kill = err_code;
+    // the waits which could last forever, such as for user input, end now
+    if (data->sched.killable) tasking::wake(*this);
+
+    return true;
+}
+
+void Process::check_pending_kill()
+{
+    if (!data->pending_kill) return;
+
+    kill(pid, *data->pending_kill);
+    tasking::schedule();
+}
+
+void Process::destroy(pid_t pid, int err_code)
+{
+    auto& proc = *m_processes[pid];
+
+    if (proc.is_thread())
+    {
+        // its children are left to the process
+        if (auto leader = by_pid(proc.tgid))
+        {
+            for (pid_t child : proc.data->children)
+            {
+                by_pid(child)->parent = leader->pid;
+                leader->data->children.emplace_back(child);
+            }
+            for (const auto& status : proc.data->exit_statuses)
+            {
+                leader->data->exit_statuses.emplace_back(status);
+            }
+            proc.data->exit_statuses.clear();
+        }
+
+        // tells the threads joining this one that it's gone
+        if (proc.data->clear_child_tid && proc.data->mappings.use_count() > 1)
+        {
+            const uintptr_t addr = proc.data->clear_child_tid;
+            proc.resolve_page_fault(addr, true);
+
+            auto it = proc.data->mappings->find(Memory::page(addr));
+            if (it != proc.data->mappings->end() && !(it->second.flags & Memory::OnDemand))
+            {
+                const pid_t zero { 0 };
+                proc.write_memory(addr, {reinterpret_cast<const uint8_t*>(&zero), sizeof(zero)});
+                tasking::futex_wake(it->second.paddr + Memory::offset(addr), 1);
+            }
+        }
+    }
+
+    // nobody will collect them anymore
+    for (const auto& status : proc.data->exit_statuses)
+    {
+        m_unreaped.erase(status.first);
+    }
+
+    proc.stop_on_other_cpus();
+    if (Process::enabled() && Process::current().pid == pid)
+    {
+        Process::current().unswitch();
+    }
+
+    const bool thread = proc.is_thread();
+
+    tasking::dequeue(proc);
     m_processes[pid].reset();
     --m_process_count;
     assert(!by_pid(pid));
 
-    MessageBus::send(ProcessDestroyedEvent{pid, err_code});
+    if (thread) thread_exits.wake_all();
 
-    //parent.raise(parent.pid, SIGCHLD, info);
+    MessageBus::send(ProcessDestroyedEvent{pid, err_code});
 }
 
 Process *Process::by_pid(pid_t pid)
 {
-    if (pid >= (int)m_processes.size())
+    if (pid < 0 || pid >= (int)m_processes.size())
     {
         return nullptr;
     }
@@ -318,80 +594,113 @@ Process *Process::create(const std::vector<kpp::string>& args)
     return m_processes[free_idx].get();
 }
 
-void Process::map_shm()
+Process *Process::create_kernel_thread(const kpp::string &name, std::function<void ()> entry)
 {
-    for (auto pair : data->shm_list)
+    // pid 0 stays for the first user process
+    if (m_processes.empty()) m_processes.emplace_back(nullptr);
+
+    pid_t free_idx = find_free_pid(1);
+    if (free_idx == (int)m_processes.size())
+    {
+        m_processes.emplace_back(new Process);
+    }
+    else
     {
-        if (pair.second.v_addr) pair.second.shm->map(pair.second.v_addr);
+        m_processes[free_idx].reset(new Process);
     }
+
+    if (m_processes[free_idx] == nullptr) return nullptr;
+
+    auto& thread = *m_processes[free_idx];
+    thread.tgid = free_idx;
+    thread.pid = free_idx;
+    thread.parent = free_idx; // nobody waits for it
+    thread.data->name = name;
+    thread.data->kernel_thread = true;
+    thread.data->thread_entry = std::move(entry);
+    thread.arch_init_kernel_thread();
+
+    ++m_process_count;
+
+    MessageBus::send(ProcessCreatedEvent{free_idx});
+
+    tasking::make_ready(thread);
+
+    return &thread;
 }
 
-void Process::map_code()
+void Process::map_code(gsl::span<const uint8_t> code_to_copy, size_t allocated_size)
 {
-    size_t code_page_amnt = data->code->size() / Memory::page_size() +
-            (data->code->size()%Memory::page_size()?1:0);
+    const size_t code_size = std::max<size_t>(code_to_copy.size(), allocated_size);
+    size_t code_page_amnt = code_size / Memory::page_size() +
+            (code_size%Memory::page_size()?1:0);
 
     for (size_t i { 0 }; i < code_page_amnt; ++i)
     {
-        uintptr_t phys_addr = Memory::physical_address((uint8_t*)data->code->data() + i*Memory::page_size());
-        uint8_t* virt_addr = (uint8_t*)(i * Memory::page_size());
+        // the part after the code to copy is the zeroed allocated part
+        const size_t offset = i*Memory::page_size();
+        const size_t len = offset < (size_t)code_to_copy.size() ? std::min<size_t>(code_to_copy.size() - offset, Memory::page_size()) : 0;
 
-        assert(phys_addr);
-        data->mappings[(uintptr_t)virt_addr] = {phys_addr, Memory::Read|Memory::Write|Memory::Executable|Memory::User, false};
+        uintptr_t phys_addr = allocate_zeroed_page({code_to_copy.data() + offset, static_cast<ptrdiff_t>(len)});
+
+        (*data->mappings)[offset] = {phys_addr, Memory::Read|Memory::Write|Memory::Executable|Memory::User, true};
     }
 }
 
 void Process::map_stack()
 {
-    size_t stack_page_amnt = data->stack.size() / Memory::page_size() +
-            (data->stack.size()%Memory::page_size()?1:0);
+    size_t stack_page_amnt = user_stack_size / Memory::page_size();
 
     for (size_t i { 0 }; i <stack_page_amnt; ++i)
     {
-        uintptr_t phys_addr = Memory::physical_address((uint8_t*)data->stack.data()
-                                                       + (stack_page_amnt-i-1)*Memory::page_size());
-        uint8_t* virt_addr = (uint8_t*)Memory::page(user_stack_top-Memory::page_size()) - i*Memory::page_size();
+        uintptr_t virt_addr = Memory::page(user_stack_top-Memory::page_size()) - i*Memory::page_size();
 
-        assert(phys_addr);
-        data->mappings[(uintptr_t)virt_addr] = {phys_addr, Memory::Read|Memory::Write|Memory::User, false};
+        (*data->mappings)[virt_addr] = {allocate_zeroed_page(), Memory::Read|Memory::Write|Memory::User, true};
     }
 }
 
 void Process::create_mappings()
 {
-    map_code();
-    map_stack();
-    if (!data->mappings.count(argv_virt_page))
+    if (!data->mappings->count(argv_virt_page))
     {
-        data->mappings[argv_virt_page] =
-        {Memory::allocate_physical_page(), Memory::Read|Memory::Write|Memory::User, true};
+        (*data->mappings)[argv_virt_page] =
+        {allocate_zeroed_page(), Memory::Read|Memory::Write|Memory::User, true};
     }
-    if (!data->mappings.count(signal_trampoline_page))
+    if (!data->mappings->count(signal_trampoline_page))
     {
-        data->mappings[signal_trampoline_page] =
+        (*data->mappings)[signal_trampoline_page] =
         {Memory::physical_address((void*)signal_trampoline), Memory::Read|Memory::User, false};
     }
+    if (!data->mappings->count(vdso_data_page))
+    {
+        (*data->mappings)[vdso_data_page] =
+        {allocate_zeroed_page(), Memory::Read|Memory::User, true};
+    }
+
+    update_vdso_data();
 }
 
-void Process::release_mappings()
+void Process::update_vdso_data()
 {
-    for (const auto& pair : data->mappings)
-    {
-        if (pair.second.owned)
-        {
-            Memory::release_physical_page(pair.second.paddr);
-        }
-    }
+    static_assert(VDSO_DATA_ADDR == vdso_data_page, "vdso.h and Process disagree on the data page");
+
+    vdso_data page;
+    page.tsc_base = Time::boot_ticks();
+    page.tsc_mhz = Time::clock_speed();
+    page.boot_epoch_us = Time::boot_epoch_us();
+    page.pid = tgid;
 
-    data->mappings.clear();
+    Memory::phys_write(data->mappings->at(vdso_data_page).paddr, &page, sizeof(page));
 }
 
-void Process::map_address_space()
+void Process::release_mappings()
 {
-    for (const auto& pair : data->mappings)
+    for (const auto& pair : *data->mappings)
     {
-        Memory::map_page(pair.second.paddr, (void*)pair.first, pair.second.flags);
+        release_page(pair.second);
     }
+
+    data->mappings->clear();
 }
 
 void *Process::map_range(uintptr_t phys, size_t len)
@@ -400,8 +709,10 @@ void *Process::map_range(uintptr_t phys, size_t len)
     uintptr_t virt = Memory::allocate_virtual_page(page_count, true);
     for (size_t i { 0 }; i < page_count; ++i)
     {
-        data->mappings[virt + Memory::page_size()*i] = {phys + Memory::page_size()*i,
+        (*data->mappings)[virt + Memory::page_size()*i] = {phys + Memory::page_size()*i,
                 Memory::Read|Memory::Write|Memory::WriteThrough|Memory::User, false};
+        Memory::map_page(phys + Memory::page_size()*i, (void*)(virt + Memory::page_size()*i),
+                         Memory::Read|Memory::Write|Memory::WriteThrough|Memory::User);
     }
 
     return (void*)virt;
@@ -426,7 +737,7 @@ void Process::allocate_user_callback_page()
 {
     auto virt_page = Memory::allocate_virtual_page(1, true);
     Memory::map_page(0, (void*)virt_page, Memory::Sentinel|Memory::User);
-    data->mappings[(uintptr_t)virt_page] = {0, Memory::Sentinel|Memory::User, false};
+    (*data->mappings)[(uintptr_t)virt_page] = {0, Memory::Sentinel|Memory::User, false};
 
     // Mark these new callbacks as free
     for (size_t i { 0 }; i < Memory::page_size(); ++i)
@@ -451,15 +762,15 @@ void Process::allocate_user_callback_page()
 
 uintptr_t Process::allocate_pages(size_t pages)
 {
+    // Only reserve the address range, physical pages are allocated on the first access
     uint8_t* addr = reinterpret_cast<uint8_t*>(Memory::allocate_virtual_page(pages, true));
     for (size_t i { 0 }; i < pages; ++i)
     {
         void* virtual_page  = (uint8_t*)addr + i*Memory::page_size();
-        uintptr_t physical_page = Memory::allocate_physical_page();
-        Memory::map_page(physical_page, virtual_page, Memory::Read|Memory::Write|Memory::User);
+        Memory::map_page(0, virtual_page, Memory::Read|Memory::Write|Memory::User|Memory::OnDemand);
 
-        assert(!data->mappings.count((uintptr_t)virtual_page));
-        data->mappings[(uintptr_t)virtual_page] = {(uintptr_t)physical_page, Memory::Read|Memory::Write|Memory::User, true};
+        assert(!data->mappings->count((uintptr_t)virtual_page));
+        (*data->mappings)[(uintptr_t)virtual_page] = {0, Memory::Read|Memory::Write|Memory::User|Memory::OnDemand, true};
     }
 
     return (uintptr_t)addr;
@@ -472,38 +783,118 @@ bool Process::release_pages(uintptr_t ptr, size_t pages)
     for (size_t i { 0 }; i < pages; ++i)
     {
         void* virtual_page  = (uint8_t*)ptr + i*Memory::page_size();
-        assert(data->mappings.count((uintptr_t)virtual_page));
+        assert(data->mappings->count((uintptr_t)virtual_page));
 
-        uintptr_t physical_page = data->mappings.at((uintptr_t)virtual_page).paddr;
+        const auto& mapping = data->mappings->at((uintptr_t)virtual_page);
+        assert(mapping.owned);
 
-        Memory::release_physical_page(physical_page);
-        if (Memory::is_mapped(virtual_page)) Memory::unmap_page(virtual_page);
+        release_page(mapping);
+        Memory::unmap_page(virtual_page);
 
-        assert(data->mappings.at((uintptr_t)virtual_page).owned);
-        data->mappings.erase((uintptr_t)virtual_page);
+        data->mappings->erase((uintptr_t)virtual_page);
     }
 
     return true;
 }
 
-void Process::copy_allocated_pages(Process &target)
+void Process::share_allocated_pages(Process &target)
 {
-    for (const auto& pair : data->mappings)
+    for (auto& pair : *data->mappings)
     {
-        if (!pair.second.owned)
+        // the child gets its own data page in create_mappings, it holds its pid
+        if (!pair.second.owned || pair.first == vdso_data_page)
             continue;
 
-        target.data->mappings[pair.first] = pair.second;
-        assert(target.data->mappings[pair.first].owned);
-        target.data->mappings[pair.first].paddr = Memory::allocate_physical_page();
+        // pages not faulted in yet stay private to each process
+        if (!(pair.second.flags & Memory::OnDemand))
+        {
+            add_page_reference(pair.second.paddr);
+            if (pair.second.flags & Memory::Write)
+            {
+                pair.second.cow = true;
+            }
+        }
+
+        (*target.data->mappings)[pair.first] = pair.second;
+    }
+}
 
-        auto src_ptr = Memory::mmap(pair.second.paddr, Memory::page_size());
-        auto dest_ptr = Memory::mmap(target.data->mappings[pair.first].paddr, Memory::page_size());
+bool Process::break_cow(uintptr_t v_addr)
+{
+    const uintptr_t page = Memory::page(v_addr);
 
-        aligned_memcpy(dest_ptr, src_ptr, Memory::page_size());
+    auto it = data->mappings->find(page);
+    if (it == data->mappings->end() || !it->second.cow)
+    {
+        return false;
+    }
 
-        Memory::unmap(src_ptr, Memory::page_size());
-        Memory::unmap(dest_ptr, Memory::page_size());
+    auto& mapping = it->second;
+    if (!drop_page_reference(mapping.paddr))
+    {
+        // still used by someone else, make our own copy
+        mapping.paddr = (mapping.paddr == zero_page()) ? allocate_zeroed_page() : copy_physical_page(mapping.paddr);
+    }
+    mapping.cow = false;
+
+    update_mapping(page);
+
+    return true;
+}
+
+bool Process::resolve_page_fault(uintptr_t v_addr, bool write)
+{
+    const uintptr_t page = Memory::page(v_addr);
+
+    auto it = data->mappings->find(page);
+    if (it == data->mappings->end())
+    {
+        return false;
+    }
+
+    auto& mapping = it->second;
+    if (mapping.flags & Memory::OnDemand)
+    {
+        if (write)
+        {
+            mapping.paddr = allocate_zeroed_page();
+        }
+        else
+        {
+            // reads are served by the zero page until the first write
+            mapping.paddr = zero_page();
+            mapping.cow = !!(mapping.flags & Memory::Write);
+        }
+        mapping.flags &= ~Memory::OnDemand;
+
+        update_mapping(page);
+
+        return true;
+    }
+
+    if (write && break_cow(v_addr))
+    {
+        return true;
+    }
+
+    // another thread of the process resolved the fault while this one waited for the kernel lock
+    return data->mappings.use_count() > 1 && (mapping.flags & Memory::Read) &&
+           (!write || (mapping.page_flags() & Memory::Write));
+}
+
+void Process::write_memory(uintptr_t v_addr, gsl::span<const uint8_t> buffer)
+{
+    size_t written { 0 };
+    while (written < (size_t)buffer.size())
+    {
+        const uintptr_t addr = v_addr + written;
+        const size_t len = std::min<size_t>(buffer.size() - written, Memory::page_size() - Memory::offset(addr));
+
+        resolve_page_fault(addr, true);
+        assert(data->mappings->count(Memory::page(addr)));
+        Memory::phys_write(data->mappings->at(Memory::page(addr)).paddr + Memory::offset(addr), buffer.data() + written, len);
+
+        written += len;
     }
 }
 
@@ -547,27 +938,34 @@ void Process::set_args(const std::vector<kpp::string>& args)
 {
     data->args = args;
 
-    auto ptr = Memory::mmap(data->mappings.at(argv_virt_page).paddr, Memory::page_size());
-    populate_argv((uintptr_t)ptr, args);
-    Memory::unmap(ptr, Memory::page_size());
+    std::vector<uint8_t> argv_page(Memory::page_size());
+    populate_argv((uintptr_t)argv_page.data(), args);
+    Memory::phys_write(data->mappings->at(argv_virt_page).paddr, argv_page.data(), argv_page.size());
 }
 
 Process::~Process()
 {
+    // resources shared with other threads stay to them
     // TODO : do this per fd ?
-    for (auto entry : data->user_callbacks->pages)
+    if (data->user_callbacks.use_count() == 1)
     {
-        detach_fault_handler(entry.base);
+        for (auto entry : data->user_callbacks->pages)
+        {
+            detach_fault_handler(entry.base);
+        }
     }
 
-    for (size_t fd { 0 }; fd < data->fd_table->size(); ++fd)
+    if (data->fd_table.use_count() == 1)
     {
-        if (get_fd(fd))
+        for (size_t fd { 0 }; fd < data->fd_table->size(); ++fd)
         {
-            close_fd(fd);
+            if (get_fd(fd))
+            {
+                close_fd(fd);
+            }
         }
     }
 
     //unswitch();
-    cleanup();
+    if (arch_context) cleanup(); // not loaded yet otherwise
 }
@@ -28,6 +28,8 @@ SOFTWARE.
 #include "config.hpp"
 
 #include <vector.hpp>
+#include <unordered_set.hpp>
+#include <optional.hpp>
 #include <functional.hpp>
 
 #include "mem/memmap.hpp"
@@ -42,6 +44,8 @@ SOFTWARE.
 
 #include "kstring/kstrfwd.hpp"
 
+#include "i686/smp/percpu.hpp"
+
 struct ProcessCreatedEvent
 {
     pid_t pid;
@@ -72,7 +76,9 @@ public:
     // Let the upper page free for argv/argc
     static constexpr uintptr_t argv_virt_page         = KERNEL_VIRTUAL_BASE - (1*Memory::page_size());
     static constexpr uintptr_t signal_trampoline_page = KERNEL_VIRTUAL_BASE - (2*Memory::page_size());
-    static constexpr size_t    user_stack_top         = KERNEL_VIRTUAL_BASE - (2*Memory::page_size());
+    static constexpr uintptr_t vdso_data_page         = KERNEL_VIRTUAL_BASE - (3*Memory::page_size());
+    static constexpr size_t    user_stack_top         = KERNEL_VIRTUAL_BASE - (3*Memory::page_size());
+    static constexpr size_t    user_stack_size        = 2*Memory::page_size();
     static constexpr kpp::array<uintptr_t, 64> default_sighandler_actions
     {{
             SIG_ACTION_TERM, // 0
@@ -99,9 +105,14 @@ public:
         }};
 
 public:
+    // from the "process" slab cache
+    static void* operator new(size_t size);
+
     static bool enabled();
 
     static Process* create(const std::vector<kpp::string> &args);
+    // creates a thread running entry in the kernel address space, it must never return
+    static Process* create_kernel_thread(const kpp::string& name, std::function<void()> entry);
     static Process* clone(Process& proc, uint32_t flags = 0);
     static Process& current();
     static size_t   count();
@@ -126,11 +137,33 @@ public:
     tasking::FDInfo *get_fd(size_t fd);
     void close_fd(size_t fd);
 
+    bool is_kernel_thread() const;
+    // not the first thread of its process
+    bool is_thread() const;
+    // called on the first thread, when the process exits or execs
+    void kill_other_threads();
+    // after kill_other_threads(), the threads blocked in the kernel only die once they leave it.
+    // Returns false if the process is killed meanwhile
+    bool wait_for_other_threads();
+    // called on the way back to user mode : a kill which waited for the thread to leave the kernel takes effect,
+    // and doesn't return then
+    void check_pending_kill();
+
     bool is_waiting() const;
     void wait_for(pid_t pid, int* wstatus);
+    // the pid and exit status of a child which exited while nobody waited for it, of any child for -1
+    kpp::optional<std::pair<pid_t, int>> take_exit_status(pid_t pid);
 
     void switch_to();
     void unswitch();
+    // the registers of the syscall being handled are only copied to the saved user context when it's needed :
+    // before the process is suspended, switched from, forked or given a signal handler
+    void save_user_context();
+    // saves the context of the kernel code running for the current process and calls 'next' on the CPU's own stack,
+    // returns once the process is switched to again
+    void suspend(void (*next)());
+    // leaves the current process' kernel stack for the CPU's own one, so that another CPU can resume the process
+    [[noreturn]] static void run_on_cpu_stack(void (*next)());
 
     void* map_range(uintptr_t phys, size_t len);
 
@@ -149,9 +182,27 @@ public:
     uintptr_t allocate_pages(size_t pages);
     bool      release_pages(uintptr_t ptr, size_t pages);
 
+    // gives the process its own copy of a copy-on-write page, returns false if v_addr isn't one
+    bool break_cow(uintptr_t v_addr);
+    // faults in pages mapped on demand and breaks copy-on-write, returns false if the access is invalid
+    bool resolve_page_fault(uintptr_t v_addr, bool write);
+    // writes to the process' memory, which isn't necessarily the current address space
+    void write_memory(uintptr_t v_addr, gsl::span<const uint8_t> buffer);
+
+    // kill() without the parent notification, and only for this thread.
+    // Also for a process which never ran, and which its parent doesn't count among its children yet
+    static void destroy(pid_t pid, int err_code);
+
 private:
     Process();
 
+    // a thread blocked in the kernel might hold locks, or have a device still writing to its buffers :
+    // the kill is recorded and carried out once it returns to user mode. Returns false if it can be destroyed now
+    bool kill_later(int err_code);
+    // the kernel code it runs is suspended, or will be resumed once the signal handler returns
+    bool suspended_in_kernel() const;
+    bool has_other_threads() const;
+
 public:
     pid_t pid { 0 };
     pid_t tgid { 0 };
@@ -160,10 +211,11 @@ public:
     ProcessArchContext* arch_context { nullptr };
 
 private:
-    static pid_t find_free_pid();
+    static pid_t find_free_pid(pid_t first = 0);
 
 private:
     void arch_init(gsl::span<const uint8_t> code_to_copy, size_t allocated_size);
+    void arch_init_kernel_thread();
     void init_default_fds();
     void init_sig_handlers();
 
@@ -185,25 +237,34 @@ private:
 
     void do_user_callback(const std::function<int(const std::vector<uintptr_t>&)>& callback, const std::vector<size_t> &arg_sizes);
 
-    void map_code();
+    void map_code(gsl::span<const uint8_t> code_to_copy, size_t allocated_size);
     void map_stack();
-    void map_shm();
 
     void create_mappings();
     void release_mappings();
+    // fills the data page read by the libc instead of doing time and getpid syscalls, see sys/vdso.h
+    void update_vdso_data();
 
     void map_address_space();
     void unmap_address_space();
+    void update_mapping(uintptr_t v_addr);
+
+    // makes the CPUs running this process give it up, before its context is modified
+    void stop_on_other_cpus();
 
     void free_arch_context();
+    // a killed thread running a signal handler goes back to the kernel code the signal interrupted, so that it ends
+    void drop_signal_contexts();
     void cleanup();
     void wake_up(pid_t child, int err_code);
-    void copy_allocated_pages(Process& target);
+    void share_allocated_pages(Process& target);
 
 private:
-    static inline Process* m_current_process { nullptr };
+    static inline smp::PerCPU<Process*> m_current_process { nullptr };
     static inline std::vector<std::unique_ptr<Process>> m_processes;
     static inline size_t m_process_count { 0 };
+    // exited children whose status hasn't been collected yet : their pids aren't reused meanwhile
+    static inline std::unordered_set<pid_t> m_unreaped;
 };
 
 extern "C" void test_task();
@@ -54,13 +54,24 @@ namespace vfs
 class node;
 }
 
+class Process;
+
 namespace tasking
 {
+class WaitQueue;
+
 struct MemoryMapping
 {
     uintptr_t paddr;
-    uint32_t  flags : 31;
+    uint32_t  flags : 30;
     bool      owned : 1; // TODO : use an enum
+    bool      cow   : 1; // shared read-only with other processes until written to
+
+    // flags the page is actually mapped with
+    uint32_t page_flags() const
+    {
+        return cow ? (flags & ~Memory::Write) : flags;
+    }
 };
 
 struct ShmEntry
@@ -86,6 +97,26 @@ struct UserCallbacks
     std::unordered_map<uintptr_t, CallbackEntry> list;
     std::vector<PageEntry> pages;
 };
+
+// Scheduler bookkeeping, managed by tasking/scheduler.cpp
+struct SchedulingInfo
+{
+    int nice { 0 };
+    size_t remaining_ticks { 0 }; // of the current timeslice
+    uint64_t user_ticks { 0 };
+    uint64_t system_ticks { 0 };
+    bool sleeping { false };
+    WaitQueue* wait_queue { nullptr }; // the process waits on it until woken up
+    bool killable { false }; // the sleep or the wait is cut short when the process is killed
+    bool stopped { false }; // killed, waits for its other threads to leave the kernel before it's destroyed
+    size_t sleep_timeout { size_t(-1) }; // handle in tasking::sleep_queue
+
+    // run queue links
+    int cpu { -1 }; // CPU whose run queue holds the process, or which last ran it
+    int queue { -1 }; // index of the priority array holding the process, -1 if not queued
+    Process* prev { nullptr };
+    Process* next { nullptr };
+};
 }
 
 struct ProcessArchContext;
@@ -95,14 +126,17 @@ struct ProcessData
     template <typename T>
     using shared_resource = std::shared_ptr<T>;
 
-    aligned_vector<uint8_t, Memory::page_size()> stack; // stack is never shared
-    shared_resource<aligned_vector<uint8_t, Memory::page_size()>> code;
+    // from the "process_data" slab cache
+    static void* operator new(size_t size);
 
     kpp::string name { "<INVALID>" };
+    bool kernel_thread { false };
+    std::function<void()> thread_entry; // kernel threads only
     uint32_t uid { 0 };
     uint32_t gid { 0 };
 
     std::vector<pid_t> children;
+    std::vector<std::pair<pid_t, int>> exit_statuses; // of the children which exited while nobody waited for them
 
     kpp::optional<pid_t> waiting_pid;
     int* wstatus { nullptr };
@@ -115,11 +149,14 @@ struct ProcessData
 
     shared_resource<tasking::UserCallbacks> user_callbacks;
 
-    std::unordered_map<uintptr_t, tasking::MemoryMapping> mappings;
+    // shared by the threads of a process
+    shared_resource<std::unordered_map<uintptr_t, tasking::MemoryMapping>> mappings;
 
     std::vector<kpp::string> args;
 
-    std::unordered_map<unsigned int, tasking::ShmEntry> shm_list;
+    shared_resource<std::unordered_map<unsigned int, tasking::ShmEntry>> shm_list;
+
+    uintptr_t clear_child_tid { 0 }; // CLONE_CHILD_CLEARTID address, cleared and woken up when the thread exits
 
     struct SigContext
     {
@@ -128,6 +165,9 @@ struct ProcessData
     };
     std::stack<SigContext> sig_context;
     shared_resource<kpp::array<struct sigaction, SIGRTMAX>> sig_handlers;
+
+    tasking::SchedulingInfo sched;
+    kpp::optional<int> pending_kill; // exit code of a kill waiting for the thread to leave the kernel
 };
 
 #endif // PROCESS_DATA_HPP
@@ -25,61 +25,515 @@ SOFTWARE.
 
 #include "scheduler.hpp"
 
+#include <algorithm.hpp>
+
 #include "utils/logging.hpp"
+#include "utils/env.hpp"
 #include "sys/time.h"
 #include "time/time.hpp"
+#include "time/timer.hpp"
 #include "tasking/process.hpp"
+#include "tasking/process_data.hpp"
+#include "tasking/waitqueue.hpp"
+#include "tasking/workqueue.hpp"
+#include "halt.hpp"
+
+#include "i686/smp/smp.hpp"
 
 #include "utils/messagebus.hpp"
 
 namespace tasking
 {
-DeltaQueue<pid_t> sleep_queue;
 
-time_t elapsed_ticks { 0 };
+namespace
+{
+
+constexpr size_t priority_levels { max_nice - min_nice + 1 };
 
-void scheduler_init()
+// ready processes of each nice level, and a bitmap of the non-empty levels
+struct PriorityArray
+{
+    kpp::array<Process*, priority_levels> heads {};
+    kpp::array<Process*, priority_levels> tails {};
+    kpp::array<uint32_t, 2> bitmap {};
+
+    bool empty() const
+    {
+        return !bitmap[0] && !bitmap[1];
+    }
+
+    size_t first_level() const
+    {
+        return bitmap[0] ? __builtin_ctz(bitmap[0]) : 32 + __builtin_ctz(bitmap[1]);
+    }
+};
+
+// Processes which used up their timeslice go to the expired array, the arrays are swapped once the active one is empty :
+// picking the next process is O(1), and processes with a higher nice value aren't starved
+class RunQueue
+{
+public:
+    void push(Process& proc, bool expired)
+    {
+        auto& sched = proc.data->sched;
+        assert(sched.queue == -1);
+
+        const int index = expired ? !m_active : m_active;
+        auto& array = m_arrays[index];
+        const size_t level = sched.nice - min_nice;
+
+        sched.queue = index;
+        sched.prev = array.tails[level];
+        sched.next = nullptr;
+        if (array.tails[level]) array.tails[level]->data->sched.next = &proc;
+        else array.heads[level] = &proc;
+        array.tails[level] = &proc;
+        array.bitmap[level / 32] |= 1u << (level % 32);
+        ++m_count;
+    }
+
+    void remove(Process& proc)
+    {
+        auto& sched = proc.data->sched;
+        assert(sched.queue != -1);
+
+        auto& array = m_arrays[sched.queue];
+        const size_t level = sched.nice - min_nice;
+
+        if (sched.prev) sched.prev->data->sched.next = sched.next;
+        else array.heads[level] = sched.next;
+        if (sched.next) sched.next->data->sched.prev = sched.prev;
+        else array.tails[level] = sched.prev;
+        if (!array.heads[level]) array.bitmap[level / 32] &= ~(1u << (level % 32));
+
+        sched.queue = -1;
+        sched.prev = sched.next = nullptr;
+        --m_count;
+    }
+
+    // nullptr if no process is ready
+    Process* pop()
+    {
+        if (m_arrays[m_active].empty()) m_active = !m_active; // new epoch
+
+        auto& array = m_arrays[m_active];
+        if (array.empty()) return nullptr;
+
+        Process* proc = array.heads[array.first_level()];
+        remove(*proc);
+
+        return proc;
+    }
+
+    void set_nice(Process& proc, int nice)
+    {
+        auto& sched = proc.data->sched;
+        if (sched.queue == -1)
+        {
+            sched.nice = nice;
+            return;
+        }
+
+        const bool expired = sched.queue != m_active;
+        remove(proc);
+        sched.nice = nice;
+        push(proc, expired);
+    }
+
+    size_t count() const
+    {
+        return m_count;
+    }
+
+private:
+    PriorityArray m_arrays[2];
+    int m_active { 0 };
+    size_t m_count { 0 };
+};
+
+// one run queue per CPU, so that processes keep running where their data is cached
+kpp::array<RunQueue, smp::max_cpus> run_queues;
+kpp::array<volatile bool, smp::max_cpus> idle_cpus {};
+kpp::array<int, smp::max_cpus> running_nice {}; // nice value of the process each CPU runs
+kpp::array<volatile bool, smp::max_cpus> resched_requests {};
+
+size_t base_timeslice { 100 }; // in milliseconds, for a nice value of 0
+MessageBus::RAIIHandle env_handle;
+
+// the bootstrap processor's timer keeps the time : it only stops ticking once every CPU idles
+volatile bool tickless { false };
+time_t tickless_start { 0 };
+uint64_t tickless_start_ticks { 0 };
+
+bool ready(const Process& proc)
 {
+    return !proc.data->sched.sleeping && !proc.data->sched.wait_queue && !proc.is_waiting() && !proc.data->sched.stopped;
 }
 
-void update_sleep_queue()
+size_t timeslice_ticks(int nice)
+{
+    return std::max<size_t>(timeslice(nice) * Timer::freq() / 1000, 1);
+}
+
+void read_timeslice_config()
+{
+    if (auto value = kgetenv("sched_timeslice"))
+    {
+        base_timeslice = std::max<size_t>(kpp::stoul(*value), 1);
+    }
+}
+
+uint64_t now_us()
+{
+    return Time::total_ticks() / Time::clock_speed();
+}
+
+void wake_sleeping(const pid_t& pid)
+{
+    // the timeout is cancelled when a process is destroyed
+    auto proc = Process::by_pid(pid);
+    assert(proc && proc->data->sched.sleeping);
+
+    proc->data->sched.sleeping = false;
+    proc->data->sched.sleep_timeout = sleep_queue.invalid_handle;
+    // the wait timed out
+    if (proc->data->sched.wait_queue) proc->data->sched.wait_queue->remove(*proc);
+    make_ready(*proc);
+}
+
+RunQueue& queue_of(const Process& proc)
+{
+    return run_queues[std::max(proc.data->sched.cpu, 0)];
+}
+
+void enqueue(Process& proc, size_t cpu, bool expired)
+{
+    proc.data->sched.cpu = cpu;
+    run_queues[cpu].push(proc, expired);
+}
+
+// an idle CPU, preferably the one which ran proc last, else the least loaded one
+size_t pick_cpu(const Process& proc)
+{
+    const int last = proc.data->sched.cpu;
+    size_t target = (last >= 0 && size_t(last) < smp::cpu_count()) ? size_t(last) : smp::cpu_index();
+    if (idle_cpus[target]) return target;
+
+    for (size_t i { 0 }; i < smp::cpu_count(); ++i)
+    {
+        if (idle_cpus[i]) return i;
+    }
+    for (size_t i { 0 }; i < smp::cpu_count(); ++i)
+    {
+        if (run_queues[i].count() < run_queues[target].count()) target = i;
+    }
+
+    return target;
+}
+
+// our own queue first, unless another one is clearly longer : then we pull from it, or steal when we have nothing to run
+Process* pick_next(size_t self)
 {
-    time_t current_ticks = Time::total_ticks();
-    time_t microsec_duration = (current_ticks - elapsed_ticks) / (Time::clock_speed());
-    elapsed_ticks = current_ticks;
+    size_t busiest = self;
+    for (size_t i { 0 }; i < smp::cpu_count(); ++i)
+    {
+        if (run_queues[i].count() > run_queues[busiest].count()) busiest = i;
+    }
+
+    if (busiest != self && run_queues[busiest].count() >= run_queues[self].count() + 2)
+    {
+        return run_queues[busiest].pop();
+    }
+    if (auto proc = run_queues[self].pop())
+    {
+        return proc;
+    }
 
-    sleep_queue.decrease(microsec_duration);
+    return run_queues[busiest].pop();
 }
 
-bool process_ready(pid_t pid)
+bool others_idle(size_t self)
 {
-    return !sleep_queue.find(pid) && !Process::by_pid(pid)->is_waiting();
+    for (size_t i { 0 }; i < smp::cpu_count(); ++i)
+    {
+        if (i != self && !idle_cpus[i]) return false;
+    }
+
+    return true;
 }
 
-pid_t find_next_pid()
+// Nothing to run : the next timer interrupt only has to wake the first sleeping process up
+void stop_tick(size_t self)
 {
-    pid_t next_pid = Process::enabled() ? Process::current().pid : 0;
-    // while next_pid is a waiting pid, set next_pid to the next process in the process list
-    do
+    if (self != 0)
     {
-        next_pid = (next_pid + 1) % Process::count();
-    } while (!Process::by_pid(next_pid) || !process_ready(next_pid));
+        smp::stop_local_tick();
+        return;
+    }
 
-    return next_pid;
+    // another CPU in the kernel might be waiting for Timer::ticks() to advance
+    if (!others_idle(self)) return;
+
+    const uint64_t max_delay { 1000000 };
+    uint64_t delay = max_delay;
+    if (!sleep_queue.empty())
+    {
+        const uint64_t now = now_us();
+        delay = sleep_queue.next_deadline() > now ? std::min(sleep_queue.next_deadline() - now, max_delay) : 1;
+    }
+    Timer::set_oneshot(delay);
+
+    if (!tickless)
+    {
+        tickless = true;
+        tickless_start = Time::total_ticks();
+        tickless_start_ticks = Timer::ticks64();
+    }
+}
+
+// called before taking the kernel lock again : its owner might be waiting for ticks
+void restart_tick(size_t self)
+{
+    if (self != 0) smp::start_local_tick();
+    else if (tickless) Timer::set_frequency(Timer::freq());
+}
+
+void leave_idle(size_t self)
+{
+    if (self != 0)
+    {
+        // the bootstrap processor has to tick again for us
+        if (tickless) smp::send_reschedule(0);
+        return;
+    }
+
+    if (!tickless) return;
+    tickless = false;
+
+    const uint64_t elapsed_us = (Time::total_ticks() - tickless_start) / Time::clock_speed();
+    Timer::catch_up(tickless_start_ticks + elapsed_us * Timer::freq() / 1000000);
+}
+
+void update_sleep_queue()
+{
+    sleep_queue.expire(now_us());
+}
+
+[[noreturn]] void switch_to_next();
+
+}
+
+TimeoutQueue<pid_t> sleep_queue { wake_sleeping };
+
+void scheduler_init()
+{
+    read_timeslice_config();
+    env_handle = MessageBus::register_handler<EnvVarChange>([](const EnvVarChange& msg)
+    {
+        if (msg.key == "sched_timeslice") read_timeslice_config();
+    });
+
+    workqueue_init();
 }
 
 void schedule()
 {
+    if (Process::enabled() && Process::current().is_kernel_thread())
+    {
+        suspend_current();
+        return;
+    }
+
+    // the process will be resumed from its saved context, the kernel stack is given up
+    if (Process::enabled()) Process::current().save_user_context();
+
+    // the next process is picked on the CPU's own stack, as another CPU can resume the current one once we switched
+    cli();
+    Process::run_on_cpu_stack(&switch_to_next);
+}
+
+void suspend_current()
+{
+    assert(Process::enabled());
+
+    const bool enabled = interrupts_enabled();
+    cli();
+    Process::current().suspend(&switch_to_next);
+    if (enabled) sti();
+}
+
+void yield()
+{
+    if (!Process::enabled()) return;
+
+    Process::current().data->sched.remaining_ticks = 0; // behind the other ready processes
+    suspend_current();
+}
+
+namespace
+{
+
+void switch_to_next()
+{
+    cli(); // enabled again when entering the next process
+
+    const size_t self = smp::cpu_index();
     Process* current = (Process::enabled() ? &Process::current() : nullptr);
 
-    update_sleep_queue();
+    // the current process keeps its place unless it waits
+    if (current && current->data->sched.queue == -1 && ready(*current))
+    {
+        enqueue(*current, self, current->data->sched.remaining_ticks == 0);
+    }
 
-    pid_t next_pid = find_next_pid();
+    Process* next;
+    while (true)
+    {
+        update_sleep_queue();
+        if ((next = pick_next(self))) break;
 
-    //if (current) log_serial("Switching from PID %d to PID %d (Process count : %d)\n", current->pid, next_pid, Process::count());
+        // nothing to run until an interrupt wakes a process up, meanwhile the other CPUs can enter the kernel,
+        // and resume our process if it's woken up
+        if (current)
+        {
+            current->unswitch();
+            current = nullptr;
+        }
+        idle_cpus[self] = true;
+        stop_tick(self);
+        smp::kernel_lock.unlock_all();
+        sti();
+        // the intermediate interrupts of a one-shot chained up to the next deadline don't need the scheduler,
+        // unless an interrupt handler made a process ready or another CPU left the idle loop meanwhile
+        do { wait_for_interrupts(); } while (Timer::oneshot_chained() && run_queues[self].count() == 0 && others_idle(self));
+        cli();
+        restart_tick(self);
+        smp::kernel_lock.lock();
+        idle_cpus[self] = false;
+        leave_idle(self);
+    }
+
+    //if (current) log_serial("Switching from PID %d to PID %d (Process count : %d)\n", current->pid, next->pid, Process::count());
+
+    resched_requests[self] = false;
 
     if (current) current->unswitch();
-    Process::by_pid(next_pid)->switch_to();
+    next->switch_to();
+}
+
+}
+
+void timer_tick(bool user_mode)
+{
+    update_sleep_queue();
+
+    if (!Process::enabled()) return;
+
+    auto& current = Process::current();
+    auto& sched = current.data->sched;
+    if (!ready(current)) return; // blocked in the kernel, the CPU is actually idle
+
+    if (user_mode) ++sched.user_ticks;
+    else           ++sched.system_ticks;
+
+    if (sched.remaining_ticks) --sched.remaining_ticks;
+
+    // the kernel isn't preemptible
+    if (user_mode && sched.remaining_ticks == 0)
+    {
+        schedule();
+    }
+}
+
+void make_ready(Process &proc)
+{
+    InterruptLock lock;
+
+    if (proc.data->sched.queue == -1 && ready(proc))
+    {
+        const size_t cpu = pick_cpu(proc);
+        enqueue(proc, cpu, false);
+        if (idle_cpus[cpu])
+        {
+            smp::send_reschedule(cpu);
+        }
+        else if (proc.data->sched.nice < running_nice[cpu])
+        {
+            // preempts the running process once that CPU returns to user mode, instead of at the end of its timeslice
+            resched_requests[cpu] = true;
+            smp::send_reschedule(cpu);
+        }
+    }
+}
+
+void set_running(Process &proc)
+{
+    InterruptLock lock;
+
+    dequeue(proc);
+    proc.data->sched.killable = false;
+    proc.data->sched.cpu = smp::cpu_index();
+    running_nice[smp::cpu_index()] = proc.data->sched.nice;
+    if (proc.data->sched.remaining_ticks == 0)
+    {
+        proc.data->sched.remaining_ticks = timeslice_ticks(proc.data->sched.nice);
+    }
+}
+
+void dequeue(Process &proc)
+{
+    InterruptLock lock;
+
+    if (proc.data->sched.queue != -1) queue_of(proc).remove(proc);
+
+    // interrupted by a signal, or destroyed
+    if (proc.data->sched.wait_queue) proc.data->sched.wait_queue->remove(proc);
+    if (proc.data->sched.sleeping)
+    {
+        sleep_queue.remove(proc.data->sched.sleep_timeout);
+        proc.data->sched.sleeping = false;
+        proc.data->sched.sleep_timeout = sleep_queue.invalid_handle;
+    }
+}
+
+void sleep(Process &proc, uint64_t microseconds, bool killable)
+{
+    InterruptLock lock;
+
+    proc.data->sched.sleeping = true;
+    proc.data->sched.killable = killable;
+    proc.data->sched.sleep_timeout = sleep_queue.insert(proc.pid, now_us() + microseconds);
+}
+
+void wake(Process &proc)
+{
+    InterruptLock lock;
+
+    dequeue(proc);
+    make_ready(proc);
+}
+
+bool need_resched()
+{
+    return resched_requests[smp::cpu_index()];
+}
+
+void set_nice(Process &proc, int nice)
+{
+    InterruptLock lock;
+
+    queue_of(proc).set_nice(proc, std::clamp(nice, min_nice, max_nice));
+}
+
+size_t timeslice(int nice)
+{
+    // from twice the base timeslice at -20 to a twentieth of it at 19
+    return std::max<size_t>(base_timeslice * (20 - nice) / 20, 1);
+}
+
+uint64_t ticks_to_ms(uint64_t ticks)
+{
+    return Timer::freq() ? ticks * 1000 / Timer::freq() : 0;
 }
 
 }
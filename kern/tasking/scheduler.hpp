@@ -26,16 +26,50 @@ SOFTWARE.
 #define SCHEDULER_HPP
 
 #include "process.hpp"
-#include "utils/deltaqueue.hpp"
+#include "utils/timeoutqueue.hpp"
 
 namespace tasking
 {
 
+constexpr int min_nice { -20 };
+constexpr int max_nice { 19 };
+
 void scheduler_init();
 
+// switches to the next ready process, only returns to kernel threads, once they're switched to again
 void schedule();
+// switches to the next ready process, and returns once the current one is switched to again :
+// its kernel stack is kept, so it can wait in the middle of a syscall
+void suspend_current();
+// lets the other ready processes run before the current one
+void yield();
+
+// called on each timer interrupt : accounts CPU time and preempts processes running user code at the end of their timeslice
+void timer_tick(bool user_mode);
+
+// puts a process which just became runnable on the run queue
+void make_ready(Process& proc);
+// takes a process out of the run queue, and cancels its sleep, before it runs or is destroyed
+void set_running(Process& proc);
+void dequeue(Process& proc);
+
+// blocks proc until 'microseconds' have elapsed, or until it's killed if killable
+void sleep(Process& proc, uint64_t microseconds, bool killable = false);
+
+// cancels the sleep or the wait of proc and makes it ready, see WaitQueue
+void wake(Process& proc);
+
+// a process with a higher priority than the one running on this CPU became ready,
+// checked before returning to user mode
+bool need_resched();
+
+void set_nice(Process& proc, int nice);
+// timeslice length for a nice value, in milliseconds
+size_t timeslice(int nice);
+uint64_t ticks_to_ms(uint64_t ticks);
 
-extern DeltaQueue<pid_t> sleep_queue;
+// sleeping processes by wake up time, in microseconds
+extern TimeoutQueue<pid_t> sleep_queue;
 
 }
 
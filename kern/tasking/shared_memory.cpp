@@ -38,6 +38,8 @@ SharedMemorySegment::SharedMemorySegment(size_t size_in_pages)
     for (size_t i { 0 }; i < size_in_pages; ++i)
     {
         m_phys_addrs.emplace_back(Memory::allocate_physical_page());
+
+        Memory::phys_memset(m_phys_addrs.back(), 0, Memory::page_size());
     }
 
     log_serial("SHM creation : 0x%x\n", m_phys_addrs[0]);
@@ -44,6 +44,7 @@ public:
     void unmap(void* v_addr);
 
     size_t size() const;
+    const std::vector<uintptr_t>& physical_pages() const { return m_phys_addrs; }
 
 private:
     std::vector<uintptr_t> m_phys_addrs;
@@ -0,0 +1,141 @@
+/*
+waitqueue.cpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "waitqueue.hpp"
+
+#include <algorithm.hpp>
+
+#include "process.hpp"
+#include "process_data.hpp"
+#include "scheduler.hpp"
+#include "workqueue.hpp"
+
+#include "time/timer.hpp"
+#include "mem/slab.hpp"
+#include "utils/nop.hpp"
+#include "i686/interrupts/interrupts.hpp"
+
+namespace tasking
+{
+
+namespace
+{
+SlabCache waitqueue_cache { "waitqueue", sizeof(WaitQueue) };
+}
+
+void* WaitQueue::operator new(size_t size)
+{
+    return slab_alloc(waitqueue_cache, size);
+}
+
+WaitQueue::~WaitQueue()
+{
+    wake_all();
+}
+
+bool WaitQueue::wait(const std::function<bool()> &pred, uint32_t timeout)
+{
+    return wait_impl(pred, timeout, false);
+}
+
+bool WaitQueue::wait_killable(const std::function<bool()> &pred, uint32_t timeout)
+{
+    return wait_impl(pred, timeout, true);
+}
+
+bool WaitQueue::wait_impl(const std::function<bool()> &pred, uint32_t timeout, bool killable)
+{
+    const uint64_t deadline = Timer::now_us() + uint64_t(timeout) * 1000;
+    const auto expired = [&]{ return timeout != 0 && Timer::now_us() >= deadline; };
+
+    if (!Process::enabled())
+    {
+        // during the kernel initialization
+        while (!pred() && !expired())
+        {
+            if (interrupts_enabled()) wait_for_work();
+            else nop();
+        }
+
+        return pred();
+    }
+
+    auto& proc = Process::current();
+
+    InterruptLock lock;
+    while (!pred())
+    {
+        if (expired()) return false;
+        if (killable && proc.data->pending_kill) return false;
+
+        m_waiters.emplace_back(&proc);
+        proc.data->sched.wait_queue = this;
+        proc.data->sched.killable = killable;
+        if (timeout) sleep(proc, deadline - Timer::now_us()); // whichever comes first wakes us up
+
+        suspend_current();
+    }
+
+    return true;
+}
+
+bool WaitQueue::wake_one()
+{
+    InterruptLock lock;
+
+    if (m_waiters.empty()) return false;
+
+    Process* proc = m_waiters.front();
+    m_waiters.pop_front();
+    proc->data->sched.wait_queue = nullptr;
+    wake(*proc);
+
+    return true;
+}
+
+void WaitQueue::wake_all()
+{
+    InterruptLock lock;
+
+    while (wake_one()) {}
+}
+
+void WaitQueue::remove(Process &proc)
+{
+    InterruptLock lock;
+
+    auto it = std::find(m_waiters.begin(), m_waiters.end(), &proc);
+    if (it != m_waiters.end()) m_waiters.erase(it);
+    proc.data->sched.wait_queue = nullptr;
+}
+
+bool WaitQueue::empty() const
+{
+    InterruptLock lock;
+
+    return m_waiters.empty();
+}
+
+}
@@ -0,0 +1,115 @@
+/*
+waitqueue.hpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef WAITQUEUE_HPP
+#define WAITQUEUE_HPP
+
+#include <stdint.h>
+
+#include <deque.hpp>
+#include <functional.hpp>
+
+#include "utils/noncopyable.hpp"
+
+class Process;
+
+namespace tasking
+{
+
+// Processes waiting for a condition, woken up by whatever makes it true.
+// A waiting process keeps its kernel stack and doesn't run until woken up : the other processes run meanwhile.
+class WaitQueue : NonCopyable
+{
+public:
+    // from the "waitqueue" slab cache when allocated on their own, like the futex queues
+    static void* operator new(size_t size);
+
+    ~WaitQueue();
+
+    // waits until pred() returns true, checking it each time the queue is woken up.
+    // timeout in ms, 0 to wait forever, returns false if it expired first.
+    // Mustn't be called from interrupt handlers, busy waits when there is no process to give the CPU up to
+    bool wait(const std::function<bool()>& pred, uint32_t timeout = 0);
+    // also gives up and returns false once the process is killed, for the waits which could last forever
+    // such as for user input : the other waits end before the killed process leaves the kernel
+    bool wait_killable(const std::function<bool()>& pred, uint32_t timeout = 0);
+
+    // can be called from interrupt handlers, wake_one returns false if nobody was waiting
+    bool wake_one();
+    void wake_all();
+
+    // takes proc out of the queue without waking it up, when it's destroyed or its wait is cancelled
+    void remove(Process& proc);
+
+    bool empty() const;
+
+private:
+    bool wait_impl(const std::function<bool()>& pred, uint32_t timeout, bool killable);
+
+private:
+    std::deque<Process*> m_waiters;
+};
+
+// Lock for code which waits while holding it, such as a driver waiting for its device :
+// the kernel lock is given up while waiting, so another process could enter the same code
+class Mutex : NonCopyable
+{
+public:
+    void lock()
+    {
+        m_queue.wait([this]{ return !m_locked; });
+        m_locked = true;
+    }
+
+    void unlock()
+    {
+        m_locked = false;
+        m_queue.wake_one();
+    }
+
+private:
+    WaitQueue m_queue;
+    bool m_locked { false };
+};
+
+class MutexLock : NonCopyable
+{
+public:
+    explicit MutexLock(Mutex& mutex)
+        : m_mutex(mutex)
+    {
+        m_mutex.lock();
+    }
+    ~MutexLock()
+    {
+        m_mutex.unlock();
+    }
+
+private:
+    Mutex& m_mutex;
+};
+
+}
+
+#endif // WAITQUEUE_HPP
@@ -0,0 +1,129 @@
+/*
+workqueue.cpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "workqueue.hpp"
+
+#include <memory.hpp>
+
+#include "process.hpp"
+#include "scheduler.hpp"
+
+#include "kstring/kstring.hpp"
+#include "halt.hpp"
+#include "i686/interrupts/interrupts.hpp"
+
+namespace tasking
+{
+
+namespace
+{
+std::unique_ptr<WorkQueue> system_queue;
+}
+
+WorkQueue::WorkQueue(const kpp::string &name)
+{
+    m_thread = Process::create_kernel_thread(name, [this]{ run(); });
+    assert(m_thread);
+
+    // bottom halves run before user code
+    set_nice(*m_thread, min_nice);
+}
+
+void WorkQueue::queue(std::function<void()> work)
+{
+    InterruptLock lock;
+
+    m_pending.emplace_back(std::move(work));
+    m_wait.wake_one();
+}
+
+size_t WorkQueue::pending() const
+{
+    InterruptLock lock;
+
+    return m_pending.size();
+}
+
+void WorkQueue::run_pending()
+{
+    while (run_one()) {}
+}
+
+void WorkQueue::run()
+{
+    while (true)
+    {
+        m_wait.wait([this]{ return !m_pending.empty(); });
+        run_pending();
+    }
+}
+
+bool WorkQueue::run_one()
+{
+    std::function<void()> work;
+    {
+        InterruptLock lock;
+
+        if (m_pending.empty()) return false;
+
+        work = std::move(m_pending.front());
+        m_pending.pop_front();
+    }
+
+    work();
+
+    return true;
+}
+
+void workqueue_init()
+{
+    system_queue = std::make_unique<WorkQueue>("kworker");
+}
+
+WorkQueue &system_workqueue()
+{
+    assert(system_queue);
+    return *system_queue;
+}
+
+void defer(std::function<void()> work)
+{
+    if (!system_queue)
+    {
+        work();
+        return;
+    }
+
+    system_queue->queue(std::move(work));
+}
+
+void wait_for_work()
+{
+    if (!system_queue || !system_queue->pending()) wait_for_interrupts();
+
+    if (system_queue) system_queue->run_pending();
+}
+
+}
@@ -0,0 +1,83 @@
+/*
+workqueue.hpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef WORKQUEUE_HPP
+#define WORKQUEUE_HPP
+
+#include <deque.hpp>
+#include <functional.hpp>
+
+#include "kstring/kstrfwd.hpp"
+#include "utils/noncopyable.hpp"
+
+#include "waitqueue.hpp"
+
+class Process;
+
+namespace tasking
+{
+
+// Runs functions in a kernel thread, so that interrupt handlers only do what can't wait and return
+class WorkQueue : NonCopyable
+{
+public:
+    explicit WorkQueue(const kpp::string& name);
+
+    // can be called from interrupt handlers, work runs with interrupts enabled
+    void queue(std::function<void()> work);
+    // runs the pending work in the caller's context
+    void run_pending();
+
+    size_t pending() const;
+    Process& thread() const
+    {
+        return *m_thread;
+    }
+
+private:
+    [[noreturn]] void run();
+    // returns false if there was nothing to run
+    bool run_one();
+
+private:
+    Process* m_thread { nullptr };
+    std::deque<std::function<void()>> m_pending;
+    WaitQueue m_wait;
+};
+
+void workqueue_init();
+
+// shared by the drivers, created by workqueue_init()
+WorkQueue& system_workqueue();
+
+// queues work on the system workqueue, or runs it right away if it doesn't exist yet
+void defer(std::function<void()> work);
+
+// The workqueue thread can't run while kernel code busy waits for an interrupt, as the kernel isn't preemptible :
+// code which can't use a WaitQueue calls this instead of wait_for_interrupts(), to run the work the interrupt handlers deferred
+void wait_for_work();
+
+}
+
+#endif // WORKQUEUE_HPP
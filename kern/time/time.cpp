@@ -120,6 +120,13 @@ size_t epoch()
     return to_unix(get_time_of_day());
 }
 
+uint64_t boot_epoch_us()
+{
+    // the RTC only counts seconds, read it once and let the callers follow the TSC from there
+    static uint64_t value = uint64_t(epoch())*1'000'000 - uint64_t(uptime()*1'000'000);
+    return value;
+}
+
 const char* to_string(const Date &date)
 {
     static char buf[256];
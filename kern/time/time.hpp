@@ -60,8 +60,12 @@ size_t to_unix(const Date& date);
 double uptime();
 uint64_t clock_speed();
 uint64_t total_ticks();
+// value of total_ticks() at uptime 0
+uint64_t boot_ticks();
 
 size_t epoch();
+// UNIX time at uptime 0, in microseconds
+uint64_t boot_epoch_us();
 
 const char *to_string(const Date& date);
 
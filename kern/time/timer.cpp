@@ -0,0 +1,219 @@
+/*
+timer.cpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include "timer.hpp"
+
+#include "i686/interrupts/interrupts.hpp"
+#include "tasking/process.hpp"
+#include "tasking/scheduler.hpp"
+
+void Timer::sleep(uint32_t time)
+{
+    if (!Process::enabled())
+    {
+        udelay(time * 1000);
+        return;
+    }
+
+    InterruptLock lock;
+
+    tasking::sleep(Process::current(), uint64_t(time) * 1000);
+    tasking::suspend_current();
+}
+
+bool Timer::sleep_until(const std::function<bool()> &callback, uint32_t timeout)
+{
+    const uint64_t deadline = now_us() + uint64_t(timeout) * 1000;
+    while (!callback() && (timeout == 0 || now_us() < deadline))
+    {
+        if (Process::enabled()) tasking::yield();
+        else nop();
+    }
+
+    return callback();
+}
+
+void Timer::arm_oneshot_step()
+{
+    const uint32_t step = std::min<uint32_t>(m_oneshot_left, m_max_oneshot);
+    m_oneshot_left -= step;
+    m_set_oneshot_callback(step);
+}
+
+bool Timer::continue_oneshot()
+{
+    if (m_oneshot_left == 0) return false;
+
+    arm_oneshot_step();
+    return true;
+}
+
+void Timer::catch_up(uint64_t ticks)
+{
+    InterruptLock lock;
+
+    if (ticks <= m_ticks) return;
+
+    // one turn of the wheel visits every slot
+    if (ticks - m_ticks > wheel_size) m_ticks = ticks - wheel_size;
+    while (m_ticks != ticks)
+    {
+        ++m_ticks;
+        run_slot();
+    }
+}
+
+Timer::CallbackHandle Timer::register_callback(uint32_t duration, std::function<void()> callback, bool oneshot)
+{
+    InterruptLock lock;
+
+    if (!freq())
+    {
+        return m_running.end();
+    }
+
+    const uint32_t ticks = std::max<uint32_t>((uint64_t(duration) * freq() + 999) / 1000, 1);
+
+    // built in m_running, then moved to its slot : list iterators stay valid when splicing
+    m_running.push_front(Callback{m_ticks + ticks, oneshot ? 0 : ticks, std::move(callback), running_slot});
+    auto it = m_running.begin();
+    arm(it);
+
+    return it;
+}
+
+Timer::CallbackHandle Timer::register_hr_callback(uint32_t duration, std::function<void()> callback)
+{
+    if (!m_set_hr_oneshot_callback)
+    {
+        return register_callback((duration + 999) / 1000, std::move(callback));
+    }
+
+    InterruptLock lock;
+
+    const uint64_t expires = now_us() + duration;
+    m_hr_callbacks.push_front(Callback{expires, 0, std::move(callback), hr_slot});
+    auto it = m_hr_callbacks.begin();
+    it->timeout = m_hr_queue.insert(it, expires);
+
+    if (m_hr_queue.next_deadline() == expires) rearm_hr();
+
+    return it;
+}
+
+void Timer::remove_callback(const CallbackHandle &it)
+{
+    InterruptLock lock;
+
+    if (it == m_running.end()) return;
+
+    if (it->slot == running_slot)
+    {
+        // being called, run_expired() erases it
+        it->cancelled = true;
+    }
+    else if (it->slot == hr_slot)
+    {
+        m_hr_queue.remove(it->timeout);
+        m_hr_callbacks.erase(it);
+    }
+    else
+    {
+        m_wheel[it->slot].erase(it);
+    }
+}
+
+void Timer::hr_interrupt()
+{
+    m_hr_queue.expire(now_us());
+    run_expired();
+    rearm_hr();
+}
+
+void Timer::irq_callback()
+{
+    ++m_ticks;
+    run_slot();
+}
+
+void Timer::arm(CallbackHandle it)
+{
+    auto& list = (it->slot == running_slot ? m_running : m_wheel[it->slot]);
+
+    it->slot = it->expires % wheel_size;
+    m_wheel[it->slot].splice(m_wheel[it->slot].begin(), list, it);
+}
+
+void Timer::run_slot()
+{
+    auto& slot = m_wheel[m_ticks % wheel_size];
+    for (auto it = slot.begin(); it != slot.end();)
+    {
+        auto next = std::next(it);
+        // the others expire on a later turn of the wheel
+        if (it->expires <= m_ticks)
+        {
+            it->slot = running_slot;
+            m_running.splice(m_running.end(), slot, it);
+        }
+        it = next;
+    }
+
+    run_expired();
+}
+
+void Timer::run_expired()
+{
+    // callbacks might register or remove other callbacks, or themselves
+    while (!m_running.empty())
+    {
+        auto it = m_running.begin();
+        if (!it->cancelled) it->callback();
+
+        if (it->cancelled || it->period == 0)
+        {
+            m_running.erase(it);
+        }
+        else
+        {
+            it->expires = m_ticks + it->period;
+            arm(it);
+        }
+    }
+}
+
+void Timer::rearm_hr()
+{
+    if (m_hr_queue.empty()) return;
+
+    const uint64_t now = now_us();
+    const uint64_t deadline = m_hr_queue.next_deadline();
+    m_set_hr_oneshot_callback(deadline > now ? std::min<uint64_t>(deadline - now, uint32_t(-1)) : 1);
+}
+
+TimeoutQueue<Timer::CallbackHandle> Timer::m_hr_queue { [](const CallbackHandle& it)
+{
+    it->slot = running_slot;
+    m_running.splice(m_running.end(), m_hr_callbacks, it);
+}};
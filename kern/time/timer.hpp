@@ -26,36 +26,35 @@ SOFTWARE.
 #define TIMER_HPP
 
 #include <stdint.h>
+#include <stddef.h>
 
 #include "utils/nop.hpp"
+#include "utils/timeoutqueue.hpp"
+#include "time/time.hpp"
 
 #include <functional.hpp>
 #include <list.hpp>
+#include <array.hpp>
 #include <algorithm.hpp>
 
 #include "panic.hpp"
 #include <stdio.h>
 
+// Callbacks are kept in a hashed timing wheel : each tick only looks at the slot of the current tick, which holds
+// the callbacks expiring at that tick and the ones one or more whole wheel turns later.
+// High resolution callbacks have their own queue, driven by a one-shot hardware timer when the platform has one.
 class Timer
 {
 
 private:
     struct Callback
     {
-        Callback() = default;
-
-        Callback(uint32_t istart, uint32_t iduration, std::function<void()> icallback, bool ioneshot)
-            : start(istart), duration(iduration), callback(std::move(icallback)),
-              oneshot(ioneshot)
-        {
-
-        }
-
-        uint32_t start;
-        uint32_t duration;
+        uint64_t expires; // absolute, in ticks, or in microseconds for high resolution callbacks
+        uint32_t period; // in ticks, 0 for oneshot callbacks
         std::function<void()> callback;
-        bool oneshot;
-        bool to_be_deleted { false };
+        size_t slot; // wheel slot, or running_slot/hr_slot
+        size_t timeout { 0 }; // handle in m_hr_queue
+        bool cancelled { false };
     };
 
 public:
@@ -69,6 +68,7 @@ public:
     static inline void set_frequency(uint32_t freq)
     {
         Timer::m_freq = freq;
+        m_oneshot_left = 0;
         if (!m_set_frequency_callback)
         {
             panic("set_frequency_callback is not set !");
@@ -76,52 +76,70 @@ public:
         m_set_frequency_callback(freq);
     }
 
-    // time in ms
-    static inline void sleep(uint32_t time)
+    // a single interrupt after 'microseconds', until set_frequency() is called again. Delays the hardware can't
+    // count at once are chained, continue_oneshot() re-arms the timer on the intermediate interrupts
+    static inline void set_oneshot(uint32_t microseconds)
+    {
+        if (!m_set_oneshot_callback)
+        {
+            panic("set_oneshot_callback is not set !");
+        }
+        m_oneshot_left = microseconds;
+        arm_oneshot_step();
+    }
+
+    // a chained one-shot hasn't reached its deadline yet
+    static inline bool oneshot_chained()
     {
-        uint32_t interval = time/(1000/freq());
-        m_ticks = 0;
-        while (m_ticks < interval) { nop(); }
+        return m_oneshot_left != 0;
     }
 
-    static inline bool sleep_until(const std::function<bool()>& callback, uint32_t timeout = 0)
+    // the periodic interrupts were stopped for a while, 'ticks' is what ticks() would have reached
+    static void catch_up(uint64_t ticks);
+
+    // microseconds since boot, from the TSC calibrated against the timer : much finer than ticks()
+    static inline uint64_t now_us()
     {
-        uint32_t interval = timeout/(1000/freq());
-        m_ticks = 0;
-        while (!callback() && (timeout == 0 || m_ticks < interval)) { nop(); }
+        return Time::total_ticks() / Time::clock_speed();
+    }
 
-        return callback();
+    // busy-waits, for hardware delays shorter than a tick
+    static inline void udelay(uint32_t microseconds)
+    {
+        const uint64_t deadline = now_us() + microseconds;
+        while (now_us() < deadline) { nop(); }
     }
 
+    // time in ms, the other processes run meanwhile
+    static void sleep(uint32_t time);
+
+    // timeout in ms, 0 to wait forever. Polls callback, letting the other processes run between the polls :
+    // conditions an interrupt handler makes true should be waited for with a tasking::WaitQueue instead
+    static bool sleep_until(const std::function<bool()>& callback, uint32_t timeout = 0);
+
     static inline bool sleep_until_int(const std::function<bool()>& callback, uint32_t timeout = 0)
     {
-        uint32_t interval = timeout/(1000/freq());
-        m_ticks = 0;
-        while (!callback() && (timeout == 0 || m_ticks < interval)) { wait_for_interrupts(); }
+        const uint64_t deadline = now_us() + uint64_t(timeout) * 1000;
+        while (!callback() && (timeout == 0 || now_us() < deadline)) { wait_for_interrupts(); }
 
         return callback();
     }
 
-    // time in ms
-    static inline CallbackHandle register_callback(uint32_t duration, std::function<void()> callback, bool oneshot = true)
-    {
-        if (freq())
-        {
-            m_callbacks.emplace_back(m_ticks, duration/(1000/freq()), callback, oneshot);
-            return std::prev(m_callbacks.end());
-        }
-        else
-        {
-            return m_callbacks.end();
-        }
-    }
+    // Callbacks run in the timer interrupt, slow ones should hand their work to tasking::defer()
+    // time in ms, rounded up to the timer period
+    static CallbackHandle register_callback(uint32_t duration, std::function<void()> callback, bool oneshot = true);
+    // time in us, falls back to register_callback() without a high resolution timer
+    static CallbackHandle register_hr_callback(uint32_t duration, std::function<void()> callback);
+    static void remove_callback(const CallbackHandle& it);
 
-    static inline void remove_callback(const CallbackHandle& it)
+    // wraps after ~50 days at 1kHz, as the existing callers expect
+    static inline uint32_t ticks()
     {
-        m_callbacks.erase(it);
+        return uint32_t(m_ticks);
     }
 
-    static inline uint32_t ticks()
+    // what the callbacks expire against, never wraps
+    static inline uint64_t ticks64()
     {
         return m_ticks;
     }
@@ -131,40 +149,39 @@ public:
         return m_freq;
     }
 
+    // called on the high resolution timer interrupt
+    static void hr_interrupt();
+
     static inline std::function<void(uint32_t)> m_set_frequency_callback;
+    static inline std::function<void(uint32_t)> m_set_oneshot_callback;
+    static inline uint32_t m_max_oneshot { uint32_t(-1) }; // longest one-shot the hardware can count, in us
+    // programs the high resolution timer to interrupt once after the given microseconds, unset if there is none
+    static inline std::function<void(uint32_t)> m_set_hr_oneshot_callback;
 
 protected:
-    static inline void irq_callback()
-    {
-        ++m_ticks;
-        // do not always check, it is costly
-        if ((m_ticks % 8) == 0) handle_callbacks();
-    }
+    static void irq_callback();
+    // on the timer interrupt : true if it was an intermediate one of a chained one-shot, which has been re-armed
+    static bool continue_oneshot();
 
 private:
-    static inline void handle_callbacks()
-    {
-        for (auto& callback : m_callbacks)
-        {
-            if (m_ticks - callback.start >= callback.duration)
-            {
-                callback.callback();
-                callback.start = m_ticks;
-                if (callback.oneshot)
-                {
-                    callback.to_be_deleted = true;
-                }
-            }
-        }
-
-        // remove used callbacks
-        m_callbacks.remove_if([](const Callback& c) { return c.to_be_deleted;});
-    }
+    static void arm(CallbackHandle it);
+    static void run_slot();
+    static void run_expired();
+    static void rearm_hr();
+    static void arm_oneshot_step();
 
 private:
-    static inline std::list<Callback> m_callbacks;
-    static inline uint32_t m_ticks { 0 };
+    static constexpr size_t wheel_size { 256 };
+    static constexpr size_t running_slot { wheel_size };
+    static constexpr size_t hr_slot { wheel_size + 1 };
+
+    static inline kpp::array<std::list<Callback>, wheel_size> m_wheel;
+    static inline std::list<Callback> m_running; // expired, being called
+    static inline std::list<Callback> m_hr_callbacks;
+    static TimeoutQueue<CallbackHandle> m_hr_queue;
+    static inline uint64_t m_ticks { 0 };
     static inline uint32_t m_freq { 0 };
+    static inline uint32_t m_oneshot_left { 0 }; // microseconds after the current one-shot step
 };
 
 #endif // TIMER_HPP
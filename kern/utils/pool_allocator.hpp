@@ -0,0 +1,104 @@
+/*
+pool_allocator.hpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef POOL_ALLOCATOR_HPP
+#define POOL_ALLOCATOR_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "panic.hpp"
+
+// Allocator handing out single objects from a fixed size static pool.
+// Meant for containers used while allocating kernel memory, which therefore can't use the kernel heap.
+template <typename T, size_t Capacity>
+class PoolAllocator
+{
+public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind
+    {
+        using other = PoolAllocator<U, Capacity>;
+    };
+
+public:
+    PoolAllocator() = default;
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U, Capacity>&)
+    {}
+
+    T* allocate(size_t n)
+    {
+        assert(n == 1);
+
+        if (m_free_list)
+        {
+            auto slot = m_free_list;
+            m_free_list = slot->next;
+            return reinterpret_cast<T*>(slot);
+        }
+
+        if (m_next_unused == Capacity)
+        {
+            panic("Pool allocator exhausted (capacity %d)\n", Capacity);
+        }
+
+        return reinterpret_cast<T*>(&m_storage[m_next_unused++]);
+    }
+
+    void deallocate(T* ptr, size_t n)
+    {
+        assert(n == 1);
+
+        auto slot = reinterpret_cast<Slot*>(ptr);
+        slot->next = m_free_list;
+        m_free_list = slot;
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U, Capacity>&) const
+    {
+        return true;
+    }
+    template <typename U>
+    bool operator!=(const PoolAllocator<U, Capacity>&) const
+    {
+        return false;
+    }
+
+private:
+    union Slot
+    {
+        Slot* next;
+        alignas(T) uint8_t data[sizeof(T)];
+    };
+
+    static inline Slot m_storage[Capacity];
+    static inline Slot* m_free_list { nullptr };
+    static inline size_t m_next_unused { 0 };
+};
+
+#endif // POOL_ALLOCATOR_HPP
@@ -0,0 +1,196 @@
+/*
+timeoutqueue.hpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef TIMEOUTQUEUE_HPP
+#define TIMEOUTQUEUE_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector.hpp>
+#include <functional.hpp>
+
+#include <assert.h>
+
+// Elements expiring at an absolute deadline, kept in a binary min-heap :
+// insert, remove and expire are O(log n), the next deadline is O(1).
+// insert() returns a handle the owner of the element keeps to cancel it.
+template <typename T>
+class TimeoutQueue
+{
+public:
+    using Handle = size_t;
+    static constexpr Handle invalid_handle = Handle(-1);
+
+    TimeoutQueue(std::function<void(const T&)> expire_callback = {})
+     : m_expire_callback(expire_callback)
+    {}
+
+    Handle insert(const T& el, uint64_t deadline);
+    // does nothing if the element already expired
+    void remove(Handle handle);
+    bool contains(Handle handle) const;
+    // pops and calls the callback on every element whose deadline is <= now
+    void expire(uint64_t now);
+
+    bool empty() const { return m_heap.empty(); }
+    size_t size() const { return m_heap.size(); }
+    uint64_t next_deadline() const { return m_heap.front().deadline; }
+
+private:
+    struct Entry
+    {
+        uint64_t deadline;
+        T value;
+        Handle handle;
+    };
+
+    void place(size_t index, Entry entry);
+    void sift_up(size_t index);
+    void sift_down(size_t index);
+    void erase_at(size_t index);
+
+private:
+    std::function<void(const T&)> m_expire_callback;
+    std::vector<Entry> m_heap;
+    std::vector<size_t> m_positions; // index in m_heap for each handle, npos if it's free
+    std::vector<Handle> m_free_handles;
+
+    static constexpr size_t npos = size_t(-1);
+};
+
+template<typename T>
+typename TimeoutQueue<T>::Handle TimeoutQueue<T>::insert(const T &el, uint64_t deadline)
+{
+    Handle handle;
+    if (!m_free_handles.empty())
+    {
+        handle = m_free_handles.back();
+        m_free_handles.pop_back();
+    }
+    else
+    {
+        handle = m_positions.size();
+        m_positions.push_back(npos);
+    }
+
+    m_heap.push_back(Entry{deadline, el, handle});
+    m_positions[handle] = m_heap.size() - 1;
+    sift_up(m_heap.size() - 1);
+
+    return handle;
+}
+
+template<typename T>
+void TimeoutQueue<T>::remove(Handle handle)
+{
+    if (!contains(handle)) return;
+
+    erase_at(m_positions[handle]);
+}
+
+template<typename T>
+bool TimeoutQueue<T>::contains(Handle handle) const
+{
+    return handle < m_positions.size() && m_positions[handle] != npos;
+}
+
+template<typename T>
+void TimeoutQueue<T>::expire(uint64_t now)
+{
+    while (!m_heap.empty() && m_heap.front().deadline <= now)
+    {
+        T value = m_heap.front().value;
+        erase_at(0);
+
+        // the callback might insert new elements
+        if (m_expire_callback) m_expire_callback(value);
+    }
+}
+
+template<typename T>
+void TimeoutQueue<T>::place(size_t index, Entry entry)
+{
+    m_positions[entry.handle] = index;
+    m_heap[index] = std::move(entry);
+}
+
+template<typename T>
+void TimeoutQueue<T>::sift_up(size_t index)
+{
+    Entry entry = std::move(m_heap[index]);
+    while (index > 0)
+    {
+        const size_t parent = (index - 1) / 2;
+        if (m_heap[parent].deadline <= entry.deadline) break;
+
+        place(index, std::move(m_heap[parent]));
+        index = parent;
+    }
+    place(index, std::move(entry));
+}
+
+template<typename T>
+void TimeoutQueue<T>::sift_down(size_t index)
+{
+    Entry entry = std::move(m_heap[index]);
+    while (true)
+    {
+        size_t child = 2*index + 1;
+        if (child >= m_heap.size()) break;
+        if (child + 1 < m_heap.size() && m_heap[child + 1].deadline < m_heap[child].deadline) ++child;
+        if (entry.deadline <= m_heap[child].deadline) break;
+
+        place(index, std::move(m_heap[child]));
+        index = child;
+    }
+    place(index, std::move(entry));
+}
+
+template<typename T>
+void TimeoutQueue<T>::erase_at(size_t index)
+{
+    assert(index < m_heap.size());
+
+    const Handle handle = m_heap[index].handle;
+    m_positions[handle] = npos;
+    m_free_handles.push_back(handle);
+
+    const size_t last = m_heap.size() - 1;
+    if (index != last)
+    {
+        place(index, std::move(m_heap[last]));
+        m_heap.pop_back();
+
+        // the moved element might belong above or below its new place
+        if (index > 0 && m_heap[index].deadline < m_heap[(index - 1) / 2].deadline) sift_up(index);
+        else sift_down(index);
+    }
+    else
+    {
+        m_heap.pop_back();
+    }
+}
+
+#endif // TIMEOUTQUEUE_HPP
@@ -30,3 +30,31 @@ do_%1_syscall:
 
 ADD_SYSCALL_GATE ludos, 0x70
 ADD_SYSCALL_GATE linux, 0x80
+
+; Same registers as 'int' : eax holds the syscall number, ebx, ecx, edx, esi, edi and ebp the arguments,
+; everything but eax is preserved. sysexit clobbers ecx and edx, and the kernel finds the return address,
+; the interrupt vector and the sixth argument on the stack ebp points to.
+%macro ADD_SYSENTER_GATE 2
+global __%1_sysenter
+__%1_sysenter:
+    push ecx
+    push edx
+    push ebp
+    push dword %2
+    push dword %%return
+
+    ; the kernel restarts interrupted syscalls from this 'mov', keep in sync with syscall_restart_size()
+    mov ebp, esp
+    sysenter
+
+%%return:
+    add esp, 8
+    pop ebp
+    pop edx
+    pop ecx
+
+    ret
+%endmacro
+
+ADD_SYSENTER_GATE ludos, 0x70
+ADD_SYSENTER_GATE linux, 0x80
@@ -42,16 +42,32 @@ SOFTWARE.
 , "b" (arg1), "c" (arg2), "d" (arg3), "S" (arg4), "D" (arg5), "bp" (arg6)
 
 #define DO_LINUX_SYSCALL(sys_no, cnt, ...) \
-        DO_SYSCALL_IMPL(0x80, sys_no, cnt, __VA_ARGS__)
+        DO_SYSCALL_IMPL(0x80, __linux_sysenter, sys_no, cnt, __VA_ARGS__)
 #define DO_LUDOS_SYSCALL(sys_no, cnt, ...) \
-        DO_SYSCALL_IMPL(0x70, sys_no, cnt, __VA_ARGS__)
+        DO_SYSCALL_IMPL(0x70, __ludos_sysenter, sys_no, cnt, __VA_ARGS__)
 
-#define DO_SYSCALL_IMPL(int_no, sys_no, cnt, ...) \
+#ifdef LUDOS_USER
+// 1 if syscalls go through the sysenter gates of do_syscall.asm, 0 through the interrupt gates, -1 until checked
+extern int __sysenter_state;
+int __check_sysenter(void);
+
+#define USE_SYSENTER() \
+    (__builtin_expect(__sysenter_state >= 0, 1) ? __sysenter_state : __check_sysenter())
+
+#define DO_SYSCALL_IMPL(int_no, gate, sys_no, cnt, ...) \
+    (USE_SYSENTER() ? DO_SYSCALL_INSN("call " #gate, sys_no, cnt, __VA_ARGS__) : \
+                      DO_SYSCALL_INSN("int $" #int_no, sys_no, cnt, __VA_ARGS__))
+#else
+#define DO_SYSCALL_IMPL(int_no, gate, sys_no, cnt, ...) \
+    DO_SYSCALL_INSN("int $" #int_no, sys_no, cnt, __VA_ARGS__)
+#endif
+
+#define DO_SYSCALL_INSN(insn, sys_no, cnt, ...) \
     ({ \
     int ret_val; \
     asm volatile \
     ("mov %1, %%eax\n" \
-     "int $" #int_no "\n" \
+     insn "\n" \
     :"=a"(ret_val) \
     :"i"(sys_no)\
     ASMFMT_##cnt(__VA_ARGS__)\
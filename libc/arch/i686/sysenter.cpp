@@ -0,0 +1,50 @@
+/*
+sysenter.cpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "syscall.h"
+
+#include <stdint.h>
+
+#ifdef LUDOS_USER
+
+int __sysenter_state = -1;
+
+// keep in sync with sysenter::available() in the kernel, which only sets sysenter up if it's supported
+int __check_sysenter(void)
+{
+    uint32_t eax, ebx, ecx, edx;
+    asm volatile ("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+
+    const uint32_t family = (eax >> 8) & 0xF;
+    const uint32_t model = (eax >> 4) & 0xF;
+    const uint32_t stepping = eax & 0xF;
+
+    // the first Pentium Pro report SEP without supporting it
+    __sysenter_state = (edx & (1 << 11)) && !(family == 6 && model < 3 && stepping < 3);
+
+    return __sysenter_state;
+}
+
+#endif
@@ -0,0 +1,60 @@
+/*
+vdso.h
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef VDSO_H
+#define VDSO_H
+
+#include <stdint.h>
+#include <sys/vdso.h>
+
+static inline const struct vdso_data* __vdso(void)
+{
+    return (const struct vdso_data*)VDSO_DATA_ADDR;
+}
+
+// callers fall back to the syscall if there is no filled data page, always the case in libk
+static inline int __vdso_available(void)
+{
+#ifdef LUDOS_USER
+    return __vdso()->tsc_mhz != 0;
+#else
+    return 0;
+#endif
+}
+
+// microseconds since boot, follows Time::uptime() in the kernel
+static inline uint64_t __vdso_uptime_us(void)
+{
+    uint64_t tsc;
+    __asm__ __volatile__ ("rdtsc" : "=A"(tsc));
+
+    return (tsc - __vdso()->tsc_base) / __vdso()->tsc_mhz;
+}
+
+static inline uint64_t __vdso_epoch_us(void)
+{
+    return __vdso()->boot_epoch_us + __vdso_uptime_us();
+}
+
+#endif // VDSO_H
@@ -73,21 +73,38 @@ int liballoc_free(void* ptr, size_t pages)
 
 #include <syscalls/syscall_list.hpp>
 
-#include "tasking/spinlock.hpp"
+#include <sys/thread.h>
 
-DECLARE_LOCK(liballoc_lock);
+// 0 : unlocked, 1 : locked, 2 : locked and someone might be waiting on the futex
+static int liballoc_lock_state = 0;
 
 extern "C"
 {
 int liballoc_lock()
 {
-    LOCK(liballoc_lock);
+    int state = __sync_val_compare_and_swap(&liballoc_lock_state, 0, 1);
+    if (state == 0) return 0;
+
+    // contended : mark it so that the owner wakes us up, and sleep until it's released
+    if (state != 2) state = __sync_lock_test_and_set(&liballoc_lock_state, 2);
+    while (state != 0)
+    {
+        futex(&liballoc_lock_state, FUTEX_WAIT|FUTEX_PRIVATE_FLAG, 2, nullptr);
+        state = __sync_lock_test_and_set(&liballoc_lock_state, 2);
+    }
+
     return 0;
 }
 
 int liballoc_unlock()
 {
-    UNLOCK(liballoc_lock);
+    if (__sync_fetch_and_sub(&liballoc_lock_state, 1) != 1)
+    {
+        // there might be waiters
+        __sync_lock_release(&liballoc_lock_state);
+        futex(&liballoc_lock_state, FUTEX_WAKE|FUTEX_PRIVATE_FLAG, 1, nullptr);
+    }
+
     return 0;
 }
 
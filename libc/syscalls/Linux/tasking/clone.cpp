@@ -0,0 +1,66 @@
+/*
+clone.cpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "syscalls/syscall_list.hpp"
+
+#include <errno.h>
+
+int clone(int (*fn)(void*), void* stack, int flags, void* arg, pid_t* ptid, pid_t* ctid)
+{
+    if (!fn || !stack)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // the child starts on its own stack, with fn and arg already pushed on it : it doesn't need anything from ours.
+    // arg ends up 16-byte aligned when fn is called
+    uintptr_t* sp = (uintptr_t*)(((uintptr_t)stack & ~0xF) - 16);
+    sp[0] = (uintptr_t)arg;
+    *--sp = (uintptr_t)fn;
+
+    int ret_val;
+    // always through the interrupt gate : the sysenter one returns through the stack of the caller
+    asm volatile ("int $0x80\n"
+                  "test %%eax, %%eax\n"
+                  "jnz 1f\n"
+                  "pop %%eax\n"
+                  "call *%%eax\n"
+                  "mov %%eax, %%ebx\n"
+                  "mov %[exit_no], %%eax\n"
+                  "int $0x80\n"
+                  "1:\n"
+                  : "=a"(ret_val)
+                  : "0"(SYS_clone), "b"(flags), "c"(sp), "d"(ptid), "S"(0), "D"(ctid), [exit_no]"i"(SYS_exit)
+                  : "memory");
+
+    if (ret_val < 0)
+    {
+        errno = -ret_val;
+        return -1;
+    }
+
+    return ret_val;
+}
@@ -27,13 +27,20 @@ SOFTWARE.
 
 #include "syscall.h"
 
-
+#include "arch/i686/vdso.h"
 
 int getpid()
 {
+    if (__vdso_available())
+    {
+        return __vdso()->pid;
+    }
+
     return DO_LINUX_SYSCALL(SYS_getpid, 0);
 }
 
+// threads share the data page of their process, so this one has to ask the kernel
+
 int gettid()
 {
     return DO_LINUX_SYSCALL(SYS_gettid, 0);
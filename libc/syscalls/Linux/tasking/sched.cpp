@@ -34,3 +34,15 @@ void sched_yield()
 {
     DO_LINUX_SYSCALL(SYS_sched_yield, 0);
 }
+
+int nice(int inc)
+{
+    int ret = DO_LINUX_SYSCALL(SYS_nice, 1, inc);
+    if (ret < 0)
+    {
+        errno = -ret;
+        return -1;
+    }
+
+    return 0;
+}
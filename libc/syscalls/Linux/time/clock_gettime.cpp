@@ -0,0 +1,67 @@
+/*
+clock_gettime.cpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <time.h>
+#include <sys/time.h>
+#include <errno.h>
+
+#include "syscalls/syscalls.hpp"
+
+#include "syscall.h"
+
+#include "arch/i686/vdso.h"
+
+namespace
+{
+uint64_t clock_us(clockid_t clock_id)
+{
+    if (clock_id == CLOCK_MONOTONIC)
+    {
+        return __vdso_available() ? __vdso_uptime_us() : DO_LUDOS_SYSCALL(SYS_uptime, 0);
+    }
+
+    if (__vdso_available())
+    {
+        return __vdso_epoch_us();
+    }
+
+    return uint64_t(DO_LINUX_SYSCALL(SYS_time, 1, nullptr)) * 1'000'000;
+}
+}
+
+int clock_gettime(clockid_t clock_id, struct timespec *tp)
+{
+    if (clock_id != CLOCK_REALTIME && clock_id != CLOCK_MONOTONIC)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const uint64_t us = clock_us(clock_id);
+    tp->tv_sec = us / 1'000'000;
+    tp->tv_nsec = (us % 1'000'000) * 1000;
+
+    return 0;
+}
@@ -28,4 +28,24 @@ SOFTWARE.
 
 #include "errno.h"
 
-LINUX_SYSCALL_DEFAULT_IMPL(time, 1, time_t, (time_t* t_loc), t_loc)
+#include "arch/i686/vdso.h"
+
+time_t time(time_t* t_loc)
+{
+    if (__vdso_available())
+    {
+        time_t t = __vdso_epoch_us() / 1'000'000;
+        if (t_loc) *t_loc = t;
+
+        return t;
+    }
+
+    auto ret_val = DO_LINUX_SYSCALL(SYS_time, 1, t_loc);
+    if (ret_val < 0)
+    {
+        errno = -ret_val;
+        return (time_t)-1;
+    }
+
+    return (time_t)ret_val;
+}
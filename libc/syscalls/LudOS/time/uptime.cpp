@@ -29,9 +29,14 @@ SOFTWARE.
 
 #include "syscall.h"
 
-
+#include "arch/i686/vdso.h"
 
 uint64_t uptime()
 {
+    if (__vdso_available())
+    {
+        return __vdso_uptime_us();
+    }
+
     return DO_LUDOS_SYSCALL(SYS_uptime, 0);
 }
@@ -36,18 +36,29 @@ Supporting OS subroutine required: Some implementations require
 
 #include <stdint.h>
 
+#ifdef LUDOS_USER
+#include <sys/time.h>
+#endif
+
 time_t
 _DEFUN (time, (t),
         time_t * t)
 {
     time_t tmp;
 
+#ifdef LUDOS_USER
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    tmp = ts.tv_sec;
+#else
     uint64_t val;
 
     // TODO : implement
     __asm__ __volatile__ ( "rdtsc" : "=A"(val) );
 
     tmp = val;
+#endif
 
     if (t) *t = tmp;
 
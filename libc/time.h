@@ -128,6 +128,23 @@ extern char *_tzname[2];
 #include <cygwin/time.h>
 #endif /*__CYGWIN__*/
 
+#if !defined(_POSIX_TIMERS)
+
+/* No POSIX timers, but clock_gettime is answered from the kernel data page, see sys/vdso.h */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct timespec;
+int _EXFUN(clock_gettime, (clockid_t clock_id, struct timespec *tp));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !_POSIX_TIMERS */
+
 #if defined(_POSIX_TIMERS)
 
 #include <signal.h>
@@ -235,7 +252,7 @@ extern "C" {
 
 #endif
 
-#if defined(_POSIX_MONOTONIC_CLOCK)
+#if defined(_POSIX_MONOTONIC_CLOCK) || !defined(_POSIX_TIMERS)
 
 /*  The identifier for the system-wide monotonic clock, which is defined
  *      as a clock whose value cannot be set via clock_settime() and which
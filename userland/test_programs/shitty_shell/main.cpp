@@ -39,31 +39,20 @@ int exec_cmd(const std::string& cmd)
 {
     int cmd_ret;
 
-    auto ret = fork();
+    const char* argv[] = {0};
+    auto ret = spawn(cmd.c_str(), argv, nullptr, 0);
     if (ret == -1)
     {
-        perror("fork");
+        perror("spawn");
         return -1;
     }
-    else if (ret == 0) // Child
-    {
-        const char* argv[] = {0};
-        const char* envp[] = {0};
-        if (execve(cmd.c_str(), argv, envp) == -1)
-        {
-            perror("execve");
-            exit(22);
-        }
-    }
-    else // Parent
+
+    if (waitpid(ret, &cmd_ret, 0) == -1)
     {
-        if (waitpid(ret, &cmd_ret, 0) == -1)
-        {
-            perror("waitpid");
-            return -2;
-        }
-        return WEXITSTATUS(cmd_ret);
+        perror("waitpid");
+        return -2;
     }
+    return WEXITSTATUS(cmd_ret);
 }
 
 std::string read_str()
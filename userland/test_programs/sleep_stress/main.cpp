@@ -0,0 +1,105 @@
+/*
+main.cpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <syscalls/syscall_list.hpp>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/wait.h>
+
+// Hundreds of processes sleeping at once : none of them may wake up before its deadline
+
+constexpr size_t processes = 300;
+constexpr size_t rounds = 10;
+
+int sleeper(size_t index)
+{
+    const uint32_t duration = (index % 17 + 1) * 1000; // 1 to 17 ms
+    timespec req;
+    req.tv_sec = 0;
+    req.tv_nsec = duration * 1000;
+
+    for (size_t i { 0 }; i < rounds; ++i)
+    {
+        const uint32_t start = uptime();
+        if (nanosleep(&req, nullptr) < 0) return 2;
+
+        if (uint32_t(uptime()) - start < duration) return 1;
+    }
+
+    return 0;
+}
+
+int main()
+{
+    const uint32_t start = uptime();
+
+    for (size_t i { 0 }; i < processes; ++i)
+    {
+        int ret = fork();
+        if (ret < 0)
+        {
+            printf("Error : %s\n", strerror(errno));
+            return 1;
+        }
+        else if (ret == 0)
+        {
+            exit(sleeper(i));
+        }
+    }
+
+    size_t early = 0, failed = 0;
+    for (size_t i { 0 }; i < processes; ++i)
+    {
+        int status;
+        if (waitpid(-1, &status, 0) < 0)
+        {
+            perror("waitpid");
+            return 1;
+        }
+
+        if (!WIFEXITED(status)) ++failed;
+        else if (WEXITSTATUS(status) == 1) ++early;
+        else if (WEXITSTATUS(status) != 0) ++failed;
+    }
+
+    // all the sleepers have exited and been waited for
+    int status;
+    if (waitpid(-1, &status, 0) >= 0 || errno != ECHILD)
+    {
+        printf("Sleepers left after waiting for %d of them\n", (int)processes);
+        return 1;
+    }
+
+    printf("%d sleepers, %d rounds : %d ms\n", (int)processes, (int)rounds, (int)((uint32_t(uptime()) - start) / 1000));
+    if (early)  printf("%d processes woke up too early\n", (int)early);
+    if (failed) printf("%d processes failed\n", (int)failed);
+
+    return early || failed;
+}
@@ -0,0 +1,116 @@
+/*
+main.cpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <syscalls/syscall_list.hpp>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/wait.h>
+
+// CPU-bound work : N workers should take about as long as a single one with N processors available
+
+constexpr size_t iterations = 200000000;
+
+inline uint64_t total_ticks()
+{
+    uint64_t ret;
+    asm volatile ( "rdtsc" : "=A"(ret) );
+    return ret;
+}
+
+void work()
+{
+    volatile uint32_t value = 1;
+    for (size_t i { 0 }; i < iterations; ++i)
+    {
+        value = value * 1103515245 + 12345;
+    }
+}
+
+uint64_t run(size_t workers)
+{
+    const uint64_t start = total_ticks();
+
+    for (size_t i { 0 }; i < workers; ++i)
+    {
+        int ret = fork();
+        if (ret < 0)
+        {
+            printf("Error : %s\n", strerror(errno));
+            exit(1);
+        }
+        else if (ret == 0)
+        {
+            work();
+            exit(0);
+        }
+    }
+
+    for (size_t i { 0 }; i < workers; ++i)
+    {
+        int status;
+        if (waitpid(-1, &status, 0) < 0)
+        {
+            perror("waitpid");
+            exit(1);
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            printf("Worker failed : status 0x%x\n", status);
+            exit(1);
+        }
+    }
+
+    // every worker has been waited for
+    int status;
+    if (waitpid(-1, &status, 0) >= 0 || errno != ECHILD)
+    {
+        printf("Workers left after waiting for them\n");
+        exit(1);
+    }
+
+    return total_ticks() - start;
+}
+
+int main(int argc, char* argv[])
+{
+    const size_t workers = argc > 1 ? strtoul(argv[1], nullptr, 10) : 4;
+
+    const uint64_t single = run(1);
+    printf("1 worker : %llu cycles\n", single);
+
+    const uint64_t parallel = run(workers);
+    printf("%d workers : %llu cycles\n", (int)workers, parallel);
+
+    // ~1x with one CPU per worker, ~Nx on a single CPU
+    printf("Speedup : %d.%02d\n", (int)(single * workers / parallel),
+                                  (int)(single * workers * 100 / parallel % 100));
+
+    return 0;
+}
@@ -0,0 +1,77 @@
+/*
+main.cpp
+
+Copyright (c) 17 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <syscall.h>
+#include <syscalls/syscall_list.hpp>
+
+// Cost of a syscall round trip through 'int' and through sysenter, when the CPU has it
+
+constexpr size_t iterations = 100000;
+
+inline uint64_t total_ticks()
+{
+    uint64_t ret;
+    asm volatile ( "rdtsc" : "=A"(ret) );
+    return ret;
+}
+
+uint64_t measure(int use_sysenter)
+{
+    __sysenter_state = use_sysenter;
+
+    const uint64_t start = total_ticks();
+    for (size_t i { 0 }; i < iterations; ++i)
+    {
+        syscall_nop();
+    }
+
+    return (total_ticks() - start) / iterations;
+}
+
+int main(int argc, char* argv[])
+{
+    const int sysenter = __check_sysenter();
+
+    const uint64_t int_cycles = measure(0);
+    printf("int : %llu cycles per syscall\n", int_cycles);
+
+    if (sysenter)
+    {
+        const uint64_t sysenter_cycles = measure(1);
+        printf("sysenter : %llu cycles per syscall\n", sysenter_cycles);
+    }
+    else
+    {
+        printf("sysenter isn't supported\n");
+    }
+
+    __sysenter_state = sysenter;
+
+    return 0;
+}
@@ -57,32 +57,21 @@ void ensure(bool cond)
 
 int execute_program(const char* path)
 {
-    int ret = fork();
+    const char* argv[] = {0};
+    int ret = spawn(path, argv, nullptr, 0);
     if (ret < 0)
     {
-        perror("fork");
+        perror("spawn");
         return -1;
     }
-    else if (ret == 0)
-    {
-        const char* argv[] = {0};
-        const char* envp[] = {0};
-        if (execve(path, argv, envp) == -1)
-        {
-            perror("execve");
-        }
-        return -2;
-    }
-    else
+
+    int status;
+    printf("Parent with child PID %d\n", ret);
+    if (waitpid(ret, &status, 0) < 0)
     {
-        int status;
-        printf("Parent with child PID %d\n", ret);
-        if (waitpid(ret, &status, 0) < 0)
-        {
-            perror("waitpid");
-        }
-        return WEXITSTATUS(status);
+        perror("waitpid");
     }
+    return WEXITSTATUS(status);
 }
 
 void fork_test()
@@ -190,6 +179,20 @@ int main(int argc, char* argv[])
 
     fork_test();
 
+    // a failed spawn leaves no child behind
+    const char* no_argv[] = {0};
+    ensure(spawn("/initrd/test.txt", no_argv, nullptr, 0) < 0);
+    int status;
+    ensure(waitpid(-1, &status, 0) < 0 && errno == ECHILD);
+
+    // the slab caches the processes were allocated from show up in alloc_dump's statistics
+    int slabinfo = open("/proc/slabinfo", O_RDONLY, 0);
+    ensure(slabinfo >= 0);
+    std::vector<char> slab_stats(4096);
+    ensure(read(slabinfo, slab_stats.data(), slab_stats.size() - 1) > 0);
+    ensure(strstr(slab_stats.data(), "process : ") && strstr(slab_stats.data(), "allocations"));
+    close(slabinfo);
+
     uint64_t total_test_ticks = 0;
 
     for (size_t i { 0 }; i < 100; ++i)